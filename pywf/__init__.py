@@ -3,6 +3,10 @@ from .cpp_pyworkflow import *
 from .mysql_iterator import MySQLResultSetIterator
 from .mysql_iterator import MySQLRowIterator
 from .mysql_iterator import MySQLRowObjectIterator
+from .mysql_stream import MySQLStreamReader
+from .redis_cluster import RedisClusterClient
+from .redis_cluster import RedisClusterReply
+from .redis_stream import RedisStreamReader
 
 
 inner_init()
@@ -0,0 +1,148 @@
+'''Read large mysql results page by page with bounded memory'''
+import collections
+import threading
+
+from .cpp_pyworkflow import MYSQL_STATUS_GET_RESULT
+from .cpp_pyworkflow import MySQLResultCursor
+from .cpp_pyworkflow import MySQLStatement
+from .cpp_pyworkflow import WFT_STATE_SUCCESS
+from .cpp_pyworkflow import create_mysql_task
+
+
+class MySQLStreamReader:
+    '''
+    Run a keyset paginated query repeatedly and pass each page to process as
+    a list of tuples. sql has exactly one ? for the last key of the previous
+    page, such as
+
+        SELECT id, name FROM t WHERE id > ? ORDER BY id LIMIT 1000
+
+    The next page is requested while the current one is processed, but at
+    most max_pending pages are kept, so memory is bounded by the page size.
+    The stream ends when a page is empty, process returns False, or a query
+    fails. Then callback is called with the reader.
+    '''
+
+    def __init__(self, url, sql, process, callback=None, first_key=0, key_column=0,
+                 max_pending=2, encoding=None, retry_max=0, pool=None):
+        self._stmt = MySQLStatement(sql)
+        if self._stmt.get_param_count() != 1:
+            raise ValueError('sql must have exactly one placeholder for the last key')
+        self._url = url
+        self._pool = pool
+        self._process = process
+        self._callback = callback
+        self._key_column = key_column
+        self._max_pending = max(1, max_pending)
+        self._encoding = encoding
+        self._retry_max = retry_max
+
+        self._lock = threading.Lock()
+        self._next_key = first_key
+        self._pages = collections.deque()
+        self._in_flight = False
+        self._processing = False
+        self._done = False
+        self._finished = False
+
+        self._rows = 0
+        self._state = WFT_STATE_SUCCESS
+        self._error = 0
+        self._error_msg = None
+
+    def start(self):
+        self._fetch()
+
+    def stop(self):
+        '''Stop after the page being processed, queued pages are dropped'''
+        with self._lock:
+            self._done = True
+            self._pages.clear()
+        self._try_finish()
+
+    def get_rows(self):
+        return self._rows
+
+    def get_state(self):
+        return self._state
+
+    def get_error(self):
+        return self._error
+
+    def get_error_msg(self):
+        '''Error message of mysql, or None'''
+        return self._error_msg
+
+    def _fetch(self):
+        with self._lock:
+            if self._in_flight or self._done or len(self._pages) >= self._max_pending:
+                return
+            self._in_flight = True
+            key = self._next_key
+
+        if self._pool is not None:
+            task = self._pool.create_execute_task(self._stmt, [key], self._on_page)
+        else:
+            task = create_mysql_task(self._url, self._retry_max, self._on_page)
+            task.get_req().set_query(self._stmt.format([key]))
+        task.start()
+
+    def _on_page(self, task):
+        rows = None
+        state = task.get_state()
+        resp = task.get_resp()
+        if state != WFT_STATE_SUCCESS:
+            self._fail(state, task.get_error(), None)
+        elif resp.is_error_packet():
+            self._fail(state, resp.get_error_code(), resp.get_error_msg())
+        else:
+            cursor = MySQLResultCursor(resp)
+            if cursor.get_cursor_status() == MYSQL_STATUS_GET_RESULT:
+                rows = cursor.fetch_all_tuples(encoding=self._encoding)
+
+        with self._lock:
+            self._in_flight = False
+            if not rows:
+                self._done = True
+            elif not self._done:
+                self._next_key = rows[-1][self._key_column]
+                self._pages.append(rows)
+
+        # Request the next page before processing this one
+        self._fetch()
+        self._drain()
+
+    def _fail(self, state, error, msg):
+        with self._lock:
+            self._state = state
+            self._error = error
+            self._error_msg = msg
+
+    def _drain(self):
+        with self._lock:
+            if self._processing:
+                return
+            self._processing = True
+
+        while True:
+            with self._lock:
+                if not self._pages:
+                    self._processing = False
+                    break
+                rows = self._pages.popleft()
+
+            self._fetch()
+            self._rows += len(rows)
+            if self._process(rows) is False:
+                self.stop()
+
+        self._try_finish()
+
+    def _try_finish(self):
+        with self._lock:
+            if self._finished or not self._done or self._in_flight or \
+                    self._processing or self._pages:
+                return
+            self._finished = True
+        if self._callback:
+            self._callback(self)
@@ -0,0 +1,280 @@
+'''Redis Cluster client built on RedisTask'''
+import threading
+import time
+from urllib.parse import urlsplit
+
+from .cpp_pyworkflow import RedisValue
+from .cpp_pyworkflow import WFT_STATE_SUCCESS
+from .cpp_pyworkflow import create_parallel_work
+from .cpp_pyworkflow import create_redis_task
+from .cpp_pyworkflow import create_series_work
+from .cpp_pyworkflow import redis_key_slot
+from .cpp_pyworkflow import series_of
+
+REDIS_CLUSTER_SLOTS = 16384
+
+# Commands without keys, they can be sent to any node
+_KEYLESS_COMMANDS = {
+    'PING', 'ECHO', 'INFO', 'TIME', 'DBSIZE', 'CLUSTER', 'COMMAND', 'CONFIG',
+    'SCRIPT', 'FUNCTION', 'RANDOMKEY', 'KEYS', 'SCAN', 'PUBLISH', 'LASTSAVE',
+}
+
+# Multi-key commands that are split by node, the value is the number of
+# params taken by each key
+_SPLIT_COMMANDS = {
+    'MGET': 1, 'DEL': 1, 'UNLINK': 1, 'EXISTS': 1, 'TOUCH': 1, 'MSET': 2,
+}
+
+_EVAL_COMMANDS = {'EVAL', 'EVALSHA', 'EVAL_RO', 'EVALSHA_RO', 'FCALL', 'FCALL_RO'}
+
+
+def _command_key(cmd, params):
+    if cmd in _KEYLESS_COMMANDS or not params:
+        return None
+    if cmd in _EVAL_COMMANDS:
+        if len(params) > 2 and int(params[1]) > 0:
+            return params[2]
+        return None
+    if cmd in ('XREAD', 'XREADGROUP'):
+        for i, p in enumerate(params):
+            name = p.decode() if isinstance(p, bytes) else p
+            if name.upper() == 'STREAMS' and i + 1 < len(params):
+                return params[i + 1]
+        return None
+    return params[0]
+
+
+def _parse_redirect(err):
+    # MOVED 3999 127.0.0.1:6381 or ASK 3999 127.0.0.1:6381
+    parts = err.split(b' ')
+    if len(parts) != 3 or parts[0] not in (b'MOVED', b'ASK'):
+        return None
+    host, _, port = parts[2].decode().rpartition(':')
+    return parts[0].decode(), int(parts[1]), host, port
+
+
+class RedisClusterReply:
+    '''The final reply of a command sent by RedisClusterClient'''
+    __slots__ = ('_state', '_error', '_result')
+
+    def __init__(self, state, error, result):
+        self._state = state
+        self._error = error
+        self._result = result
+
+    def get_state(self):
+        return self._state
+
+    def get_error(self):
+        return self._error
+
+    def get_result(self):
+        return self._result
+
+
+class RedisClusterClient:
+    '''
+    Route commands to redis cluster nodes by hash slot.
+
+    startup_nodes is a list of urls such as redis://:password@127.0.0.1:7000,
+    scheme and password of the first url are used for all nodes.
+    '''
+
+    def __init__(self, startup_nodes, retry_max=0, max_redirects=5, refresh_interval=30):
+        if not startup_nodes:
+            raise ValueError('startup_nodes is empty')
+        first = urlsplit(startup_nodes[0])
+        self._scheme = first.scheme or 'redis'
+        self._auth = first.netloc.rpartition('@')[0]
+        if self._auth:
+            self._auth += '@'
+        self._startup_nodes = [self._node_url(*self._split_addr(u)) for u in startup_nodes]
+        self._retry_max = retry_max
+        self._max_redirects = max_redirects
+        self._refresh_interval = refresh_interval
+
+        self._lock = threading.Lock()
+        self._slots = [None] * REDIS_CLUSTER_SLOTS
+        self._refreshing = False
+        self._last_refresh = 0.0
+
+    def refresh(self, wait=True):
+        '''
+        Reload the slot map by CLUSTER SLOTS. Do not wait in callbacks,
+        the reply is handled by the same threads.
+        '''
+        event = threading.Event() if wait else None
+        with self._lock:
+            started = not self._refreshing
+            self._refreshing = True
+            self._last_refresh = time.monotonic()
+        if started:
+            self._start_refresh(list(self._startup_nodes) + self.get_nodes(), event)
+            if event:
+                event.wait()
+            return
+
+        # Another refresh is running, wait for it
+        while wait:
+            with self._lock:
+                if not self._refreshing:
+                    break
+            time.sleep(0.01)
+
+    def get_nodes(self):
+        with self._lock:
+            return sorted(set(url for url in self._slots if url is not None))
+
+    def get_node_url(self, key):
+        slot = redis_key_slot(key)
+        with self._lock:
+            url = self._slots[slot]
+        return url if url is not None else self._startup_nodes[0]
+
+    def create_task(self, command, params, callback):
+        '''
+        Create a task sends command to the node owning its key. The callback
+        receives a RedisClusterReply after redirections are followed. For
+        MGET, MSET, DEL, UNLINK, EXISTS and TOUCH with keys on different
+        nodes, the returned task is a ParallelWork and replies are merged.
+        '''
+        self._maybe_refresh(False)
+        cmd = command.upper()
+        params = list(params)
+
+        def done(state, error, result):
+            if callback:
+                callback(RedisClusterReply(state, error, result))
+
+        step = _SPLIT_COMMANDS.get(cmd)
+        if step and len(params) > step and len(params) % step == 0:
+            groups = {}
+            for i in range(0, len(params), step):
+                groups.setdefault(self.get_node_url(params[i]), []).append(i // step)
+            if len(groups) > 1:
+                return self._create_split_task(cmd, command, params, step, groups, done)
+
+        key = _command_key(cmd, params)
+        url = self.get_node_url(key) if key is not None else self._startup_nodes[0]
+        return self._create_node_task(url, command, params, done, 0, False)
+
+    def _split_addr(self, url):
+        u = urlsplit(url if '//' in url else '//' + url)
+        return u.hostname, u.port or 6379
+
+    def _node_url(self, host, port):
+        if ':' in host:
+            host = '[' + host + ']'
+        return '{}://{}{}:{}'.format(self._scheme, self._auth, host, port)
+
+    def _maybe_refresh(self, force):
+        now = time.monotonic()
+        with self._lock:
+            if self._refreshing:
+                return
+            # Refresh at most once a second even if redirected
+            if now - self._last_refresh < (1.0 if force else self._refresh_interval):
+                return
+            self._refreshing = True
+            self._last_refresh = now
+        self._start_refresh(list(self._startup_nodes) + self.get_nodes(), None)
+
+    def _start_refresh(self, urls, event):
+        # Try nodes one by one until one of them replies
+        url = urls.pop(0)
+
+        def on_slots(task):
+            result = task.get_resp().get_result()
+            if task.get_state() == WFT_STATE_SUCCESS and result.is_array():
+                host = self._split_addr(url)[0]
+                slots = [None] * REDIS_CLUSTER_SLOTS
+                for entry in result.as_object():
+                    start, end, master = entry[0], entry[1], entry[2]
+                    node = self._node_url(master[0].decode() or host, master[1])
+                    slots[start:end + 1] = [node] * (end - start + 1)
+                with self._lock:
+                    self._slots = slots
+            elif urls:
+                self._start_refresh(urls, event)
+                return
+
+            with self._lock:
+                self._refreshing = False
+            if event:
+                event.set()
+
+        t = create_redis_task(url, self._retry_max, on_slots)
+        t.get_req().set_request('CLUSTER', ['SLOTS'])
+        t.start()
+
+    def _create_node_task(self, url, command, params, done, redirects, asking):
+        def on_reply(task):
+            state = task.get_state()
+            result = task.get_resp().get_result()
+            redirect = None
+            if state == WFT_STATE_SUCCESS and result.is_error():
+                redirect = _parse_redirect(result.string_value())
+
+            if redirect and redirects < self._max_redirects:
+                kind, slot, host, port = redirect
+                node = self._node_url(host or self._split_addr(url)[0], port)
+                if kind == 'MOVED':
+                    with self._lock:
+                        self._slots[slot] = node
+                    self._maybe_refresh(True)
+                next_task = self._create_node_task(node, command, params, done,
+                                                   redirects + 1, kind == 'ASK')
+                series_of(task).push_front(next_task)
+                return
+
+            done(state, task.get_error(), result)
+
+        t = create_redis_task(url, self._retry_max, on_reply)
+        t.get_req().set_request(command, params)
+        if asking:
+            t.get_req().set_asking(True)
+        return t
+
+    def _create_split_task(self, cmd, command, params, step, groups, done):
+        parts = []
+
+        def on_parallel(pwork):
+            nkeys = len(params) // step
+            merged = RedisValue()
+            if cmd == 'MGET':
+                merged.set_array(nkeys)
+            elif cmd == 'MSET':
+                merged.set_status('OK')
+            else:
+                merged.set_int(0)
+
+            total = 0
+            for indexes, state, error, result in parts:
+                if state != WFT_STATE_SUCCESS:
+                    done(state, error, result)
+                    return
+                if result.is_error():
+                    done(state, error, result)
+                    return
+                if cmd == 'MGET':
+                    for pos, index in enumerate(indexes):
+                        merged[index] = result[pos]
+                elif cmd != 'MSET':
+                    total += result.int_value()
+
+            if cmd not in ('MGET', 'MSET'):
+                merged.set_int(total)
+            done(WFT_STATE_SUCCESS, 0, merged)
+
+        pwork = create_parallel_work(on_parallel)
+        for url, indexes in groups.items():
+            sub_params = []
+            for index in indexes:
+                sub_params.extend(params[index * step:(index + 1) * step])
+
+            def sub_done(state, error, result, indexes=indexes):
+                parts.append((indexes, state, error, result))
+
+            task = self._create_node_task(url, command, sub_params, sub_done, 0, False)
+            pwork.add_series(create_series_work(task, None))
+        return pwork
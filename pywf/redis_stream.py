@@ -0,0 +1,135 @@
+'''Read redis streams with XREAD BLOCK in a loop'''
+import threading
+
+from .cpp_pyworkflow import WFT_STATE_SUCCESS
+from .cpp_pyworkflow import create_redis_task
+from .cpp_pyworkflow import create_timer_task
+from .cpp_pyworkflow import series_of
+
+
+def _to_str(s):
+    return s.decode() if isinstance(s, bytes) else s
+
+
+class RedisStreamReader:
+    '''
+    Keep one XREAD BLOCK request in flight and pass the entries of each reply
+    to process as one list of (stream, id, fields) tuples, where fields is a
+    dict of bytes. Streams can be added or removed at any time, the change
+    takes effect from the next XREAD.
+    '''
+
+    def __init__(self, url, streams, process, count=100, block_ms=1000,
+                 retry_max=0, retry_interval_ms=1000):
+        self._url = url
+        self._process = process
+        self._count = count
+        self._block_ms = block_ms
+        self._retry_max = retry_max
+        self._retry_interval_ms = retry_interval_ms
+        self._lock = threading.Lock()
+        self._streams = {_to_str(n): _to_str(i) for n, i in dict(streams).items()}
+        self._running = False
+
+    def add_stream(self, name, last_id='$'):
+        with self._lock:
+            self._streams[_to_str(name)] = _to_str(last_id)
+
+    def remove_stream(self, name):
+        with self._lock:
+            self._streams.pop(_to_str(name), None)
+
+    def get_streams(self):
+        with self._lock:
+            return dict(self._streams)
+
+    def start(self):
+        with self._lock:
+            if self._running:
+                return
+            self._running = True
+        self._create_task().start()
+
+    def stop(self):
+        '''
+        Stop reading, the request in flight finishes in block_ms,
+        use wf.wait_finish() to wait for it.
+        '''
+        with self._lock:
+            self._running = False
+
+    def _create_task(self):
+        with self._lock:
+            names = list(self._streams.keys())
+            ids = [self._streams[n] for n in names]
+        if not names:
+            # Nothing to read, check again later
+            return create_timer_task(self._block_ms * 1000, self._on_idle)
+
+        # Resolve $ to the last id first, or entries added between two XREAD are lost
+        for name, last_id in zip(names, ids):
+            if last_id == '$':
+                t = create_redis_task(self._url, self._retry_max,
+                                      lambda task, name=name: self._on_last_id(task, name))
+                t.get_req().set_request('XREVRANGE', [name, '+', '-', 'COUNT', '1'])
+                return t
+
+        params = ['COUNT', str(self._count), 'BLOCK', str(self._block_ms), 'STREAMS']
+        params.extend(names)
+        params.extend(ids)
+        t = create_redis_task(self._url, self._retry_max, self._on_reply)
+        t.get_req().set_request('XREAD', params)
+        # The reply may come after block_ms
+        t.set_receive_timeout(self._block_ms + 5000)
+        return t
+
+    def _next(self, task):
+        with self._lock:
+            running = self._running
+        if running:
+            series_of(task).push_back(self._create_task())
+
+    def _on_idle(self, task):
+        self._next(task)
+
+    def _on_last_id(self, task, name):
+        result = task.get_resp().get_result()
+        if task.get_state() != WFT_STATE_SUCCESS or result.is_error():
+            self._on_reply(task)
+            return
+
+        entries = result.as_object()
+        last_id = entries[0][0].decode() if entries else '0-0'
+        with self._lock:
+            if self._streams.get(name) == '$':
+                self._streams[name] = last_id
+        self._next(task)
+
+    def _on_reply(self, task):
+        result = task.get_resp().get_result()
+        if task.get_state() != WFT_STATE_SUCCESS or result.is_error():
+            with self._lock:
+                running = self._running
+            if running:
+                series_of(task).push_back(
+                    create_timer_task(self._retry_interval_ms * 1000, self._on_idle))
+            return
+
+        entries = []
+        # Nil means timeout, otherwise [[stream, [[id, [field, value, ...]], ...]], ...]
+        for stream, items in (result.as_object() or []):
+            last_id = None
+            for entry_id, kv in items:
+                fields = dict(zip(kv[0::2], kv[1::2])) if kv else {}
+                entries.append((stream, entry_id, fields))
+                last_id = entry_id
+
+            if last_id is not None:
+                name = stream.decode()
+                with self._lock:
+                    if name in self._streams:
+                        self._streams[name] = last_id.decode()
+
+        if entries:
+            self._process(entries)
+        self._next(task)
@@ -0,0 +1,112 @@
+"""
+Compare throughput and latency of file engines by random preads.
+
+    python scripts/bench_file_engine.py --file /data/big.bin --block 4096 \
+        --concurrency 64 --seconds 10
+
+Each engine runs in its own process, since the engine is selected once by
+WORKFLOW_library_init. Use a file larger than the page cache, or drop caches
+between runs, to measure the disk instead of memory.
+"""
+import argparse
+import json
+import os
+import random
+import subprocess
+import sys
+import threading
+import time
+
+import pywf as wf
+
+
+def percentile(sorted_values, p):
+    if not sorted_values:
+        return 0.0
+    index = min(len(sorted_values) - 1, int(len(sorted_values) * p / 100))
+    return sorted_values[index]
+
+
+def run(args):
+    settings = wf.get_global_settings()
+    engine = wf.FILE_ENGINE_IO_URING if args.engine == "io_uring" else wf.FILE_ENGINE_DEFAULT
+    wf.WORKFLOW_library_init(settings, engine)
+    if wf.get_file_engine() != engine:
+        print(json.dumps({"engine": args.engine, "error": "unavailable"}))
+        return
+
+    fd = os.open(args.file, os.O_RDONLY)
+    blocks = max(1, os.fstat(fd).st_size // args.block)
+    deadline = time.monotonic() + args.seconds
+    latencies = []
+    lock = threading.Lock()
+    done = threading.Semaphore(0)
+
+    def start_read(buffer):
+        offset = random.randrange(blocks) * args.block
+        task = wf.create_preadinto_task(fd, buffer, offset, on_read)
+        task.set_user_data((buffer, time.perf_counter()))
+        task.start()
+
+    def on_read(task):
+        buffer, begin = task.get_user_data()
+        latency = time.perf_counter() - begin
+        with lock:
+            latencies.append(latency)
+        if task.get_retval() < 0 or time.monotonic() >= deadline:
+            done.release()
+        else:
+            start_read(buffer)
+
+    begin = time.monotonic()
+    for _ in range(args.concurrency):
+        start_read(bytearray(args.block))
+    for _ in range(args.concurrency):
+        done.acquire()
+    elapsed = time.monotonic() - begin
+    os.close(fd)
+
+    latencies.sort()
+    print(
+        json.dumps(
+            {
+                "engine": args.engine,
+                "ops": len(latencies) / elapsed,
+                "mbps": len(latencies) * args.block / elapsed / 1024 / 1024,
+                "p50_us": percentile(latencies, 50) * 1e6,
+                "p99_us": percentile(latencies, 99) * 1e6,
+            }
+        )
+    )
+
+
+def compare(args):
+    print("{:<10}{:>12}{:>12}{:>12}{:>12}".format("engine", "ops/s", "MB/s", "p50(us)", "p99(us)"))
+    for engine in ("default", "io_uring"):
+        cmd = [sys.executable, __file__, "--engine", engine, "--file", args.file]
+        cmd += ["--block", str(args.block), "--concurrency", str(args.concurrency)]
+        cmd += ["--seconds", str(args.seconds)]
+        out = subprocess.run(cmd, check=True, stdout=subprocess.PIPE).stdout
+        result = json.loads(out.decode().strip().splitlines()[-1])
+        if "error" in result:
+            print("{:<10}{:>12}".format(engine, result["error"]))
+            continue
+        print(
+            "{:<10}{:>12.0f}{:>12.1f}{:>12.1f}{:>12.1f}".format(
+                engine, result["ops"], result["mbps"], result["p50_us"], result["p99_us"]
+            )
+        )
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("--file", required=True)
+    parser.add_argument("--block", type=int, default=4096)
+    parser.add_argument("--concurrency", type=int, default=64)
+    parser.add_argument("--seconds", type=float, default=10)
+    parser.add_argument("--engine", choices=("default", "io_uring"))
+    args = parser.parse_args()
+    if args.engine:
+        run(args)
+    else:
+        compare(args)
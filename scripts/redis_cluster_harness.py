@@ -0,0 +1,232 @@
+"""
+Start a local Redis Cluster and check RedisClusterClient against it.
+
+    python scripts/redis_cluster_harness.py --nodes 3 --base-port 30001
+
+The nodes are started by redis-server in a temporary directory and joined
+by redis-cli --cluster create, then routing, multi-key splitting, MOVED and
+ASK redirects are checked, and the nodes are stopped. With --keep the
+cluster is left running until Ctrl-C, for manual tests.
+"""
+import argparse
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+import pywf as wf
+
+
+class Cluster:
+    def __init__(self, args):
+        self.args = args
+        self.ports = [args.base_port + i for i in range(args.nodes)]
+        self.dir = tempfile.mkdtemp(prefix="pywf-redis-cluster-")
+        self.procs = []
+
+    def cli(self, port, *argv):
+        cmd = [self.args.redis_cli, "-p", str(port)] + [str(a) for a in argv]
+        out = subprocess.run(cmd, check=True, stdout=subprocess.PIPE).stdout
+        return out.decode().strip()
+
+    def start(self):
+        for port in self.ports:
+            cmd = [self.args.redis_server, "--port", str(port), "--cluster-enabled", "yes"]
+            cmd += ["--cluster-config-file", "nodes-{}.conf".format(port)]
+            cmd += ["--dir", self.dir, "--save", "", "--appendonly", "no"]
+            log = open(os.path.join(self.dir, "redis-{}.log".format(port)), "w")
+            self.procs.append(subprocess.Popen(cmd, stdout=log, stderr=subprocess.STDOUT))
+
+        for port in self.ports:
+            self.wait(lambda: self.cli(port, "ping") == "PONG", "node {} up".format(port))
+
+        nodes = ["127.0.0.1:{}".format(port) for port in self.ports]
+        subprocess.run(
+            [self.args.redis_cli, "--cluster", "create"] + nodes
+            + ["--cluster-replicas", "0", "--cluster-yes"],
+            check=True,
+            stdout=subprocess.DEVNULL,
+        )
+        for port in self.ports:
+            self.wait(
+                lambda: "cluster_state:ok" in self.cli(port, "cluster", "info"),
+                "cluster state ok on {}".format(port),
+            )
+
+    def stop(self):
+        for proc in self.procs:
+            proc.terminate()
+        for proc in self.procs:
+            proc.wait()
+        shutil.rmtree(self.dir, ignore_errors=True)
+
+    def urls(self):
+        return ["redis://127.0.0.1:{}".format(port) for port in self.ports]
+
+    def node_id(self, port):
+        return self.cli(port, "cluster", "myid")
+
+    def slot_owner(self, slot):
+        for port in self.ports:
+            for line in self.cli(port, "cluster", "nodes").splitlines():
+                fields = line.split()
+                if "myself" not in fields[2]:
+                    continue
+                for r in fields[8:]:
+                    lo, _, hi = r.partition("-")
+                    if lo.isdigit() and int(lo) <= slot <= int(hi or lo):
+                        return port
+        raise RuntimeError("slot {} has no owner".format(slot))
+
+    def begin_migration(self, slot, src, dst):
+        self.cli(dst, "cluster", "setslot", slot, "importing", self.node_id(src))
+        self.cli(src, "cluster", "setslot", slot, "migrating", self.node_id(dst))
+
+    def end_migration(self, slot, src, dst):
+        keys = self.cli(src, "cluster", "getkeysinslot", slot, 1000).split()
+        for key in keys:
+            self.cli(src, "migrate", "127.0.0.1", dst, key, 0, 5000)
+        dst_id = self.node_id(dst)
+        for port in self.ports:
+            self.cli(port, "cluster", "setslot", slot, "node", dst_id)
+
+    @staticmethod
+    def wait(cond, what, timeout=10):
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            try:
+                if cond():
+                    return
+            except subprocess.CalledProcessError:
+                pass
+            time.sleep(0.1)
+        raise RuntimeError("timeout waiting for " + what)
+
+
+def call(client, command, *params):
+    event = threading.Event()
+    box = []
+
+    def callback(reply):
+        box.append(reply)
+        event.set()
+
+    client.create_task(command, list(params), callback).start()
+    if not event.wait(10):
+        raise AssertionError("{} timed out".format(command))
+    reply = box[0]
+    if reply.get_state() != wf.WFT_STATE_SUCCESS:
+        raise AssertionError("{} state {} error {}".format(command, reply.get_state(), reply.get_error()))
+    result = reply.get_result()
+    if result.is_error():
+        raise AssertionError("{} replied {}".format(command, result.string_value()))
+    return result.as_object()
+
+
+def check_routing(cluster, client):
+    keys = ["key:{}".format(i) for i in range(200)]
+    for key in keys:
+        call(client, "SET", key, key)
+    for key in keys:
+        assert call(client, "GET", key) == key.encode(), key
+    owners = set(cluster.slot_owner(wf.redis_key_slot(key)) for key in keys)
+    assert len(owners) == len(cluster.ports), "keys are not spread over all nodes"
+
+
+def check_multi_key(cluster, client):
+    params = []
+    for i in range(50):
+        params += ["multi:{}".format(i), str(i)]
+    assert call(client, "MSET", *params) == b"OK"
+    keys = params[0::2]
+    assert call(client, "MGET", *keys) == [str(i).encode() for i in range(50)]
+    assert call(client, "EXISTS", *keys) == 50
+    assert call(client, "DEL", *keys) == 50
+    assert call(client, "MGET", *keys) == [None] * 50
+
+
+def check_moved(cluster, client):
+    key = "moved:{tag}"
+    call(client, "SET", key, "before")
+    slot = wf.redis_key_slot(key)
+    src = cluster.slot_owner(slot)
+    dst = next(port for port in cluster.ports if port != src)
+    cluster.begin_migration(slot, src, dst)
+    cluster.end_migration(slot, src, dst)
+    # The slot map of the client is stale, the node replies MOVED
+    assert call(client, "GET", key) == b"before"
+    call(client, "SET", key, "after")
+    assert cluster.cli(dst, "get", key) == "after"
+
+
+def check_ask(cluster, client):
+    old_key = "ask:{slot}:old"
+    new_key = "ask:{slot}:new"
+    call(client, "SET", old_key, "old")
+    slot = wf.redis_key_slot(old_key)
+    src = cluster.slot_owner(slot)
+    dst = next(port for port in cluster.ports if port != src)
+    cluster.begin_migration(slot, src, dst)
+    try:
+        # The key is still on src, which answers directly
+        assert call(client, "GET", old_key) == b"old"
+        # A missing key of a migrating slot is redirected by ASK
+        call(client, "SET", new_key, "new")
+        assert call(client, "GET", new_key) == b"new"
+        assert cluster.cli(src, "exists", new_key) == "0"
+    finally:
+        cluster.end_migration(slot, src, dst)
+    assert call(client, "GET", old_key) == b"old"
+    assert cluster.cli(dst, "get", new_key) == "new"
+
+
+def check_refresh(cluster, client):
+    client.refresh()
+    expected = sorted(cluster.urls())
+    assert client.get_nodes() == expected, client.get_nodes()
+
+
+CHECKS = [check_routing, check_multi_key, check_moved, check_ask, check_refresh]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("--nodes", type=int, default=3)
+    parser.add_argument("--base-port", type=int, default=30001)
+    parser.add_argument("--redis-server", default="redis-server")
+    parser.add_argument("--redis-cli", default="redis-cli")
+    parser.add_argument("--keep", action="store_true", help="keep the cluster running")
+    args = parser.parse_args()
+    if args.nodes < 3:
+        parser.error("redis cluster needs at least 3 masters")
+
+    cluster = Cluster(args)
+    failed = 0
+    try:
+        cluster.start()
+        if args.keep:
+            print("cluster is running:", " ".join(cluster.urls()))
+            while True:
+                time.sleep(3600)
+
+        client = wf.RedisClusterClient(cluster.urls()[:1])
+        client.refresh()
+        for check in CHECKS:
+            try:
+                check(cluster, client)
+                print("PASS", check.__name__)
+            except AssertionError as e:
+                failed += 1
+                print("FAIL", check.__name__, e)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        cluster.stop()
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,86 @@
+#include "buffer_pool.h"
+#include <unistd.h>
+#include <cstdlib>
+#include <new>
+
+size_t AlignedBufferPool::get_alignment() {
+    static const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    return page_size;
+}
+
+size_t AlignedBufferPool::round_up(size_t size) {
+    size_t align = get_alignment();
+    if(size == 0) return align;
+    return (size + align - 1) / align * align;
+}
+
+void *AlignedBufferPool::get(size_t size) {
+    size = round_up(size);
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = free_lists.find(size);
+        if(it != free_lists.end() && !it->second.empty()) {
+            void *buf = it->second.back();
+            it->second.pop_back();
+            cached -= size;
+            return buf;
+        }
+    }
+
+    void *buf;
+    if(posix_memalign(&buf, get_alignment(), size) != 0) return nullptr;
+    return buf;
+}
+
+void AlignedBufferPool::put(void *buf, size_t size) {
+    size = round_up(size);
+    std::lock_guard<std::mutex> lock(mtx);
+    if(cached + size > max_bytes) {
+        free(buf);
+        return;
+    }
+
+    free_lists[size].push_back(buf);
+    cached += size;
+}
+
+void AlignedBufferPool::trim_locked() {
+    auto it = free_lists.begin();
+    while(cached > max_bytes && it != free_lists.end()) {
+        std::vector<void *> &bufs = it->second;
+        while(cached > max_bytes && !bufs.empty()) {
+            free(bufs.back());
+            bufs.pop_back();
+            cached -= it->first;
+        }
+        if(bufs.empty())
+            it = free_lists.erase(it);
+        else
+            ++it;
+    }
+}
+
+void AlignedBufferPool::set_params(size_t max_bytes) {
+    std::lock_guard<std::mutex> lock(mtx);
+    this->max_bytes = max_bytes;
+    trim_locked();
+}
+
+void AlignedBufferPool::clear() {
+    std::lock_guard<std::mutex> lock(mtx);
+    for(auto &kv : free_lists) {
+        for(void *buf : kv.second) free(buf);
+    }
+    free_lists.clear();
+    cached = 0;
+}
+
+size_t AlignedBufferPool::size() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return cached;
+}
+
+AlignedBuffer::AlignedBuffer(size_t size) : size(size) {
+    buf = (char *)AlignedBufferPool::get_instance()->get(size);
+    if(buf == nullptr) throw std::bad_alloc();
+}
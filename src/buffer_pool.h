@@ -0,0 +1,62 @@
+#ifndef PYWF_BUFFER_POOL_H
+#define PYWF_BUFFER_POOL_H
+#include <cstddef>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * AlignedBufferPool keeps freed page aligned buffers for reuse, keyed by the
+ * size rounded up to pages, until max_bytes are kept. Files opened with
+ * O_DIRECT need aligned buffers, and allocating them for every task is slow.
+ */
+class AlignedBufferPool {
+public:
+    // Never destructed, buffers may be put back after exit starts
+    static AlignedBufferPool *get_instance() {
+        static AlignedBufferPool *pool = new AlignedBufferPool;
+        return pool;
+    }
+
+    static size_t get_alignment();
+
+    // Return nullptr on failure, the buffer holds at least size bytes
+    void *get(size_t size);
+    void put(void *buf, size_t size);
+
+    void set_params(size_t max_bytes);
+    void clear();
+    // Bytes of the buffers kept for reuse
+    size_t size();
+
+private:
+    AlignedBufferPool() = default;
+    static size_t round_up(size_t size);
+    void trim_locked();
+
+    std::mutex mtx;
+    size_t max_bytes{64 * 1024 * 1024};
+    size_t cached{0};
+    std::unordered_map<size_t, std::vector<void *>> free_lists;
+};
+
+/**
+ * AlignedBuffer owns a buffer of AlignedBufferPool, and puts it back when
+ * destructed. It is exported to python with the buffer protocol.
+ */
+class AlignedBuffer {
+public:
+    explicit AlignedBuffer(size_t size);
+    ~AlignedBuffer() { AlignedBufferPool::get_instance()->put(buf, size); }
+    AlignedBuffer(const AlignedBuffer&) = delete;
+    AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+    char *data() const { return buf; }
+    size_t get_size() const { return size; }
+
+private:
+    char *buf;
+    size_t size;
+};
+
+#endif // PYWF_BUFFER_POOL_H
@@ -1,4 +1,5 @@
 #include "common_types.h"
+#include "file_engine.h"
 #include "workflow/EndpointParams.h"
 #include "workflow/WFGlobal.h"
 #include "workflow/WFTask.h"
@@ -73,8 +74,9 @@ void start_parallel_work(std::vector<PySeriesWork> &v, py_parallel_callback_t cb
     });
 }
 
-void PyWorkflow_library_init(const struct WFGlobalSettings s) {
+void PyWorkflow_library_init(const struct WFGlobalSettings s, int file_engine) {
     WORKFLOW_library_init(&s);
+    FileEngine::init(file_engine);
 }
 
 WFGlobalSettings get_global_settings() {
@@ -115,6 +117,9 @@ void init_common_types(py::module_ &wf) {
     wf.attr("WFT_STATE_TASK_ERROR")  = (int)WFT_STATE_TASK_ERROR;
     wf.attr("WFT_STATE_ABORTED")     = (int)WFT_STATE_ABORTED;
 
+    wf.attr("FILE_ENGINE_DEFAULT")   = (int)FILE_ENGINE_DEFAULT;
+    wf.attr("FILE_ENGINE_IO_URING")  = (int)FILE_ENGINE_IO_URING;
+
     wf.attr("TOR_NOT_TIMEOUT")       = (int)TOR_NOT_TIMEOUT;
     wf.attr("TOR_WAIT_TIMEOUT")      = (int)TOR_WAIT_TIMEOUT;
     wf.attr("TOR_CONNECT_TIMEOUT")   = (int)TOR_CONNECT_TIMEOUT;
@@ -214,7 +219,9 @@ void init_common_types(py::module_ &wf) {
         .def("get_context",  &PyParallelWork::get_context)
     ;
 
-    wf.def("WORKFLOW_library_init", &PyWorkflow_library_init);
+    wf.def("WORKFLOW_library_init", &PyWorkflow_library_init, py::arg("settings"),
+                                     py::arg("file_engine") = (int)FILE_ENGINE_DEFAULT);
+    wf.def("get_file_engine",       &FileEngine::get_engine);
     wf.def("get_global_settings",   &get_global_settings);
     wf.def("series_of",             &py_series_of);
 
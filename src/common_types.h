@@ -72,9 +72,12 @@ public:
         return nullptr;
     }
     ~TaskDeleterWrapper() {
+        void *context = this->get_context();
+        // Nothing refers to python, no need to acquire gil
+        if(!f && context == nullptr) return;
+
         py::gil_scoped_acquire acquire;
         if(f) f = nullptr;
-        void *context = this->get_context();
         if(context != nullptr) {
             delete static_cast<py::object*>(context);
         }
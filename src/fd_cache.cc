@@ -0,0 +1,168 @@
+#include "fd_cache.h"
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+
+#ifndef O_DIRECT
+// Not supported on this platform, the page cache is used
+#define O_DIRECT 0
+#endif
+
+int64_t FdCache::now_ms() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// A quarter of the fd limit, the rest is left to sockets and the user
+size_t FdCache::default_max_files() {
+    struct rlimit rl;
+    if(getrlimit(RLIMIT_NOFILE, &rl) < 0 || rl.rlim_cur == RLIM_INFINITY)
+        return 128;
+    return rl.rlim_cur / 4 > 0 ? rl.rlim_cur / 4 : 1;
+}
+
+void FdCache::touch_locked(Entry *entry) {
+    entry->refs++;
+    lru.splice(lru.begin(), lru, entry->pos);
+}
+
+// Remove from the cache, the fd is closed when it is not used
+void FdCache::drop_locked(Entry *entry) {
+    index.erase(entry->key);
+    lru.erase(entry->pos);
+    entry->cached = false;
+    if(entry->refs == 0) {
+        close(entry->fd);
+        delete entry;
+    }
+}
+
+FdCache::Entry *FdCache::acquire(const std::string &path, int flags) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = index.find(make_key(path, flags));
+    if(it == index.end() || now_ms() - it->second->checked_at >= revalidate_ms)
+        return nullptr;
+
+    touch_locked(it->second);
+    return it->second;
+}
+
+FdCache::Entry *FdCache::open(const std::string &path, int flags) {
+    std::string key = make_key(path, flags);
+    struct stat st;
+    bool exists = ::stat(path.c_str(), &st) == 0;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = index.find(key);
+        if(it != index.end()) {
+            Entry *entry = it->second;
+            if(exists && entry->dev == st.st_dev && entry->ino == st.st_ino) {
+                entry->checked_at = now_ms();
+                touch_locked(entry);
+                return entry;
+            }
+            // The file is removed or replaced
+            drop_locked(entry);
+        }
+    }
+
+    int fd = ::open(path.c_str(), flags | O_CLOEXEC, 0644);
+    if(fd < 0) return nullptr;
+    if(fstat(fd, &st) < 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return nullptr;
+    }
+
+    Entry *entry = new Entry;
+    entry->key = key;
+    entry->fd = fd;
+    entry->dev = st.st_dev;
+    entry->ino = st.st_ino;
+    entry->checked_at = now_ms();
+    entry->refs = 1;
+    entry->cached = true;
+
+    std::lock_guard<std::mutex> lock(mtx);
+    // Another task may have opened it at the same time
+    auto it = index.find(key);
+    if(it != index.end()) drop_locked(it->second);
+
+    lru.push_front(entry);
+    entry->pos = lru.begin();
+    index[key] = entry;
+    while(index.size() > max_files)
+        drop_locked(lru.back());
+    return entry;
+}
+
+void FdCache::release(Entry *entry) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if(--entry->refs == 0 && !entry->cached) {
+        close(entry->fd);
+        delete entry;
+    }
+}
+
+void FdCache::set_params(size_t max_files, int revalidate_ms) {
+    std::lock_guard<std::mutex> lock(mtx);
+    this->max_files = max_files;
+    this->revalidate_ms = revalidate_ms;
+    while(index.size() > max_files)
+        drop_locked(lru.back());
+}
+
+void FdCache::clear() {
+    std::lock_guard<std::mutex> lock(mtx);
+    while(!lru.empty())
+        drop_locked(lru.back());
+}
+
+size_t FdCache::size() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return index.size();
+}
+
+void PathFileIOTask::dispatch() {
+    int flags = write ? O_WRONLY | O_CREAT : O_RDONLY;
+    if(direct) flags |= O_DIRECT;
+    FdCache *cache = FdCache::get_instance();
+    entry = cache->acquire(path, flags);
+    if(entry) {
+        start_io();
+        return;
+    }
+
+    // open and stat may block, never run them on the handler threads
+    WFGoTask *task = WFTaskFactory::create_go_task("pywf_fd_cache", [this, cache, flags]() {
+        entry = cache->open(path, flags);
+        if(entry)
+            start_io();
+        else
+            this->handle(WFT_STATE_SYS_ERROR, errno);
+    });
+    task->start();
+}
+
+void PathFileIOTask::start_io() {
+    WFFileIOTask *task;
+    this->args.fd = entry->fd;
+    if(write)
+        task = FileEngine::create_pwrite_task(entry->fd, this->args.buf, this->args.count,
+            this->args.offset);
+    else
+        task = FileEngine::create_pread_task(entry->fd, this->args.buf, this->args.count,
+            this->args.offset);
+
+    task->set_callback([this](WFFileIOTask *t) {
+        this->result = FileEngine::get_retval(t);
+        FdCache::get_instance()->release(entry);
+        entry = nullptr;
+        this->handle(t->get_state(), t->get_error());
+    });
+    task->start();
+}
@@ -0,0 +1,94 @@
+#ifndef PYWF_FD_CACHE_H
+#define PYWF_FD_CACHE_H
+#include "file_engine.h"
+#include <sys/types.h>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * FdCache keeps recently used files open, keyed by path and open flags, and
+ * evicts the least recently used ones beyond max_files. An entry is trusted
+ * for revalidate_ms after it is checked, then the path is stat again and the
+ * file is reopened if it is replaced. Evicted fds are closed when the last
+ * task using them finishes.
+ */
+class FdCache {
+public:
+    struct Entry {
+        std::string key;
+        int fd;
+        dev_t dev;
+        ino_t ino;
+        int64_t checked_at;
+        size_t refs;
+        bool cached;
+        std::list<Entry *>::iterator pos;
+    };
+
+    static FdCache *get_instance() {
+        static FdCache cache;
+        return &cache;
+    }
+
+    // Return a referenced entry without any syscall, or nullptr if not trusted
+    Entry *acquire(const std::string &path, int flags);
+    // Stat and open the path if needed, return nullptr with errno on failure
+    Entry *open(const std::string &path, int flags);
+    void release(Entry *entry);
+
+    void set_params(size_t max_files, int revalidate_ms);
+    void clear();
+    size_t size();
+
+private:
+    FdCache() : max_files(default_max_files()) {}
+    static int64_t now_ms();
+    static size_t default_max_files();
+    static std::string make_key(const std::string &path, int flags) {
+        return std::to_string(flags) + ':' + path;
+    }
+
+    void touch_locked(Entry *entry);
+    void drop_locked(Entry *entry);
+
+    std::mutex mtx;
+    size_t max_files;
+    int revalidate_ms{1000};
+    std::list<Entry *> lru;
+    std::unordered_map<std::string, Entry *> index;
+};
+
+/**
+ * PathFileIOTask reads or writes a file by path, the fd comes from FdCache,
+ * and the file is opened on a compute thread if it is not cached. The io is
+ * done by a task of FileEngine on the fd. A direct task opens the file with
+ * O_DIRECT, its buf, count and offset should be aligned to the block size.
+ */
+class PathFileIOTask : public WFFileTask<FileIOArgs>, public FileTaskResult {
+public:
+    PathFileIOTask(const std::string &path, bool write, void *buf, size_t count, off_t offset,
+        bool direct)
+        : WFFileTask(nullptr, nullptr), path(path), write(write), direct(direct) {
+        this->args.fd = -1;
+        this->args.buf = buf;
+        this->args.count = count;
+        this->args.offset = offset;
+    }
+
+    virtual void dispatch();
+
+private:
+    // Not used, the task is never requested to IOService
+    virtual int prepare() { return 0; }
+    void start_io();
+
+    std::string path;
+    bool write;
+    bool direct;
+    FdCache::Entry *entry{nullptr};
+};
+
+#endif // PYWF_FD_CACHE_H
@@ -0,0 +1,231 @@
+#include "file_copy.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+
+static const size_t COPY_DEFAULT_CHUNK = 1024 * 1024;
+
+static ssize_t sys_copy_file_range(int fd_in, loff_t *off_in, int fd_out, loff_t *off_out,
+    size_t len) {
+#ifdef SYS_copy_file_range
+    return syscall(SYS_copy_file_range, fd_in, off_in, fd_out, off_out, len, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+FileCopyTask::FileCopyTask(const std::string &src, const std::string &dst, off_t src_offset,
+    off_t dst_offset, long long length, size_t chunk_size, int parallelism, callback_t &&cb)
+    : src_path(src), dst_path(dst), src_offset(src_offset), dst_offset(dst_offset),
+      length(length), chunk_size(chunk_size ? chunk_size : COPY_DEFAULT_CHUNK),
+      parallelism(std::max(parallelism, 1)), callback(std::move(cb)) {}
+
+FileCopyTask::~FileCopyTask() {
+    for(Worker &w : workers) free(w.buf);
+    if(src_fd >= 0) close(src_fd);
+    if(dst_fd >= 0) close(dst_fd);
+}
+
+void FileCopyTask::dispatch() {
+    // open and stat may block, never run them on the handler threads
+    WFGoTask *task = WFTaskFactory::create_go_task("pywf_file_copy", [this]() {
+        int error = open_files();
+        if(error != 0) {
+            this->state = WFT_STATE_SYS_ERROR;
+            this->error = error;
+            this->subtask_done();
+            return;
+        }
+
+        use_range = try_copy_range();
+        start_workers();
+    });
+    task->start();
+}
+
+// Return 0 or errno
+int FileCopyTask::open_files() {
+    struct stat src_st, dst_st;
+    src_fd = open(src_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(src_fd < 0 || fstat(src_fd, &src_st) < 0) return errno;
+
+    total = src_st.st_size > src_offset ? src_st.st_size - src_offset : 0;
+    if(length >= 0 && (unsigned long long)length < total) total = length;
+
+    dst_fd = open(dst_path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if(dst_fd < 0 || fstat(dst_fd, &dst_st) < 0) return errno;
+
+    // Copy a whole file, dst is replaced
+    if(src_offset == 0 && dst_offset == 0 && length < 0) {
+        if(src_st.st_dev == dst_st.st_dev && src_st.st_ino == dst_st.st_ino) return EINVAL;
+        if(ftruncate(dst_fd, 0) < 0) return errno;
+    }
+    return 0;
+}
+
+/**
+ * Copy the first chunk by copy_file_range, it may be unsupported by the
+ * kernel or the filesystems of the two files, then the buffered pipeline is
+ * used, which also reports real io errors.
+ */
+bool FileCopyTask::try_copy_range() {
+    if(total == 0) return false;
+
+    loff_t in = src_offset;
+    loff_t out = dst_offset;
+    ssize_t ret = sys_copy_file_range(src_fd, &in, dst_fd, &out, std::min(chunk_size, total));
+    if(ret <= 0) return false;
+
+    next = ret;
+    add_copied(ret);
+    return true;
+}
+
+bool FileCopyTask::claim(Worker *w) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if(stopped || next >= total) return false;
+
+    size_t n = std::min(chunk_size, total - next);
+    w->src = src_offset + next;
+    w->dst = dst_offset + next;
+    w->left = n;
+    next += n;
+    return true;
+}
+
+void FileCopyTask::start_workers() {
+    size_t chunks = (total - next + chunk_size - 1) / chunk_size;
+    int n = (int)std::min(chunks, (size_t)parallelism);
+    if(n == 0) {
+        this->state = WFT_STATE_SUCCESS;
+        this->error = 0;
+        this->subtask_done();
+        return;
+    }
+
+    workers.resize(n);
+    for(Worker &w : workers)
+        w.buf = use_range ? nullptr : (char *)malloc(chunk_size);
+
+    // The task may finish once the last worker starts, never touch it then
+    running = n;
+    Worker *w = workers.data();
+    for(int i = 0; i < n; i++, w++) {
+        if(!claim(w))
+            worker_done(WFT_STATE_SUCCESS, 0);
+        else if(use_range)
+            copy_range(w);
+        else
+            start_read(w);
+    }
+}
+
+void FileCopyTask::copy_range(Worker *w) {
+    WFGoTask *task = WFTaskFactory::create_go_task("pywf_file_copy", [this, w]() {
+        loff_t in = w->src;
+        loff_t out = w->dst;
+        size_t count = w->left;
+        while(w->left > 0) {
+            ssize_t ret = sys_copy_file_range(src_fd, &in, dst_fd, &out, w->left);
+            if(ret < 0) {
+                worker_done(WFT_STATE_SYS_ERROR, errno);
+                return;
+            }
+            // src is truncated during copying
+            if(ret == 0) break;
+            w->left -= ret;
+        }
+
+        add_copied(count - w->left);
+        if(w->left == 0 && claim(w))
+            copy_range(w);
+        else
+            worker_done(WFT_STATE_SUCCESS, 0);
+    });
+    task->start();
+}
+
+void FileCopyTask::start_read(Worker *w) {
+    WFFileIOTask *task = FileEngine::create_pread_task(src_fd, w->buf, w->left, w->src);
+    task->set_callback([this, w](WFFileIOTask *t) { this->on_read(w, t); });
+    task->start();
+}
+
+void FileCopyTask::on_read(Worker *w, WFFileIOTask *task) {
+    long ret = FileEngine::get_retval(task);
+    if(task->get_state() != WFT_STATE_SUCCESS || ret < 0) {
+        worker_done(task->get_state(), task->get_error());
+        return;
+    }
+
+    // src is truncated during copying
+    if(ret == 0) {
+        worker_done(WFT_STATE_SUCCESS, 0);
+        return;
+    }
+
+    w->filled = ret;
+    w->written = 0;
+    start_write(w);
+}
+
+void FileCopyTask::start_write(Worker *w) {
+    WFFileIOTask *task = FileEngine::create_pwrite_task(dst_fd, w->buf + w->written,
+        w->filled - w->written, w->dst + w->written);
+    task->set_callback([this, w](WFFileIOTask *t) { this->on_write(w, t); });
+    task->start();
+}
+
+void FileCopyTask::on_write(Worker *w, WFFileIOTask *task) {
+    long ret = FileEngine::get_retval(task);
+    if(task->get_state() != WFT_STATE_SUCCESS || ret <= 0) {
+        bool ok = task->get_state() == WFT_STATE_SUCCESS;
+        worker_done(ok ? WFT_STATE_SYS_ERROR : task->get_state(), ok ? EIO : task->get_error());
+        return;
+    }
+
+    w->written += ret;
+    if(w->written < w->filled) {
+        start_write(w);
+        return;
+    }
+
+    w->src += w->filled;
+    w->dst += w->filled;
+    w->left -= w->filled;
+    add_copied(w->filled);
+    if(w->left > 0 || claim(w))
+        start_read(w);
+    else
+        worker_done(WFT_STATE_SUCCESS, 0);
+}
+
+void FileCopyTask::add_copied(size_t n) {
+    // Keep the progress in order when chunks finish at the same time
+    std::lock_guard<std::mutex> lock(progress_mtx);
+    copied += n;
+    if(progress) progress(copied, total);
+}
+
+void FileCopyTask::worker_done(int state, int error) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(state != WFT_STATE_SUCCESS) {
+            if(!stopped) {
+                fail_state = state;
+                fail_error = error;
+            }
+            stopped = true;
+        }
+        if(--running > 0) return;
+    }
+
+    this->state = fail_state;
+    this->error = fail_error;
+    this->subtask_done();
+}
@@ -0,0 +1,91 @@
+#ifndef PYWF_FILE_COPY_H
+#define PYWF_FILE_COPY_H
+#include "file_engine.h"
+#include <sys/types.h>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * FileCopyTask copies a byte range of a file to another file. The files are
+ * opened on a compute thread, then copy_file_range is used if the kernel
+ * supports it for the two files, so the data never reaches user space.
+ * Otherwise up to parallelism chunks are read and written at the same time
+ * by tasks of FileEngine. Progress is reported after each chunk is written.
+ */
+class FileCopyTask : public WFGenericTask {
+public:
+    using callback_t = std::function<void (FileCopyTask *)>;
+    using progress_t = std::function<void (size_t copied, size_t total)>;
+
+    // A negative length copies to the end of src
+    FileCopyTask(const std::string &src, const std::string &dst, off_t src_offset,
+        off_t dst_offset, long long length, size_t chunk_size, int parallelism,
+        callback_t &&cb);
+    virtual ~FileCopyTask();
+
+    size_t get_copied() const { return copied; }
+    size_t get_total() const { return total; }
+    void set_callback(callback_t cb) { callback = std::move(cb); }
+    void set_progress(progress_t cb) { progress = std::move(cb); }
+
+protected:
+    virtual void dispatch();
+    virtual SubTask *done() {
+        SeriesWork *series = series_of(this);
+        if(callback) callback(this);
+        delete this;
+        return series->pop();
+    }
+
+private:
+    struct Worker {
+        char *buf;
+        off_t src;
+        off_t dst;
+        size_t left;
+        size_t filled;
+        size_t written;
+    };
+
+    int open_files();
+    bool try_copy_range();
+    bool claim(Worker *w);
+    void start_workers();
+    void copy_range(Worker *w);
+    void start_read(Worker *w);
+    void on_read(Worker *w, WFFileIOTask *task);
+    void start_write(Worker *w);
+    void on_write(Worker *w, WFFileIOTask *task);
+    void add_copied(size_t n);
+    void worker_done(int state, int error);
+
+    std::string src_path;
+    std::string dst_path;
+    off_t src_offset;
+    off_t dst_offset;
+    long long length;
+    size_t chunk_size;
+    int parallelism;
+    int src_fd{-1};
+    int dst_fd{-1};
+    bool use_range{false};
+
+    std::mutex mtx;
+    size_t next{0};
+    int running{0};
+    bool stopped{false};
+    int fail_state{WFT_STATE_SUCCESS};
+    int fail_error{0};
+    std::vector<Worker> workers;
+
+    std::mutex progress_mtx;
+    std::atomic<size_t> copied{0};
+    size_t total{0};
+    callback_t callback;
+    progress_t progress;
+};
+
+#endif // PYWF_FILE_COPY_H
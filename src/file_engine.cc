@@ -0,0 +1,500 @@
+#include "file_engine.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define PYWF_HAVE_IO_URING 1
+#endif
+#endif
+
+#ifdef PYWF_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const unsigned URING_ENTRIES = 512;
+
+/**
+ * UringEngine drives one io_uring by raw syscalls. Requests are put into the
+ * submission queue under a lock, or held back when the completion queue may
+ * overflow. Only the reaper thread enters the ring, it submits everything
+ * queued and waits for completions in one io_uring_enter. A poll on an
+ * eventfd is kept in the ring, so the first request queued while the reaper
+ * waits wakes it, and the requests queued until it enters again share one
+ * submission. Each completion is handed to the handler threads of workflow
+ * by a timer of zero, as IOService does, so a slow or blocking callback never
+ * stalls the other file tasks.
+ */
+class UringEngine {
+public:
+    static UringEngine *instance;
+
+    int init(unsigned entries);
+    void submit(UringFileRequest *req);
+    int register_files(const std::vector<int> &fds);
+    int register_buffers(const std::vector<struct iovec> &iovs);
+
+private:
+    int enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+        return (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags,
+            nullptr, 0);
+    }
+    int do_register(unsigned opcode, const void *arg, unsigned nr_args) {
+        return (int)syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args);
+    }
+
+    bool push_locked(UringFileRequest *req);
+    void prep_locked(struct io_uring_sqe *sqe, UringFileRequest *req);
+    bool arm_wakeup_locked();
+    void reap();
+    static void post(UringFileRequest *req, int res);
+
+    int ring_fd{-1};
+    int event_fd{-1};
+    unsigned sq_entries;
+    unsigned cq_entries;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+
+    std::mutex mtx;
+    unsigned local_tail{0};
+    unsigned to_submit{0};
+    unsigned inflight{0};
+    // Set while the reaper is awake, or the eventfd is written
+    bool awake{true};
+    bool wakeup_armed{false};
+    std::deque<UringFileRequest *> backlog;
+    std::unordered_map<int, int> fixed_files;
+    std::vector<struct iovec> fixed_buffers;
+};
+
+UringEngine *UringEngine::instance = nullptr;
+
+int UringEngine::init(unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof p);
+    event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(event_fd < 0) return -1;
+    ring_fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if(ring_fd < 0) {
+        int error = errno;
+        close(event_fd);
+        errno = error;
+        return -1;
+    }
+
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof (unsigned);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+    bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+    if(single_mmap) sq_size = cq_size = std::max(sq_size, cq_size);
+
+    void *sq_ptr = mmap(nullptr, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        ring_fd, IORING_OFF_SQ_RING);
+    void *cq_ptr = sq_ptr;
+    if(sq_ptr != MAP_FAILED && !single_mmap) {
+        cq_ptr = mmap(nullptr, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            ring_fd, IORING_OFF_CQ_RING);
+    }
+    void *sqe_ptr = MAP_FAILED;
+    if(sq_ptr != MAP_FAILED && cq_ptr != MAP_FAILED) {
+        sqe_ptr = mmap(nullptr, p.sq_entries * sizeof (struct io_uring_sqe),
+            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    }
+    if(sqe_ptr == MAP_FAILED) {
+        int error = errno;
+        if(cq_ptr != MAP_FAILED && cq_ptr != sq_ptr) munmap(cq_ptr, cq_size);
+        if(sq_ptr != MAP_FAILED) munmap(sq_ptr, sq_size);
+        close(ring_fd);
+        close(event_fd);
+        ring_fd = -1;
+        errno = error;
+        return -1;
+    }
+
+    char *sq = static_cast<char *>(sq_ptr);
+    char *cq = static_cast<char *>(cq_ptr);
+    sq_entries = p.sq_entries;
+    cq_entries = p.cq_entries;
+    sq_head  = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+    sq_tail  = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+    sq_mask  = reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+    cq_head  = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+    cq_tail  = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+    cq_mask  = reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+    cqes     = reinterpret_cast<struct io_uring_cqe *>(cq + p.cq_off.cqes);
+    sqes     = static_cast<struct io_uring_sqe *>(sqe_ptr);
+    local_tail = *sq_tail;
+    arm_wakeup_locked();
+
+    // The ring lives until the process exits, as the other services of workflow
+    std::thread(&UringEngine::reap, this).detach();
+    return 0;
+}
+
+void UringEngine::prep_locked(struct io_uring_sqe *sqe, UringFileRequest *req) {
+    memset(sqe, 0, sizeof *sqe);
+    auto it = req->fixed_file ? fixed_files.find(req->fd) : fixed_files.end();
+    if(it != fixed_files.end()) {
+        sqe->fd = it->second;
+        sqe->flags |= IOSQE_FIXED_FILE;
+    }
+    else
+        sqe->fd = req->fd;
+
+    switch(req->op) {
+    case UringFileRequest::READ:
+    case UringFileRequest::WRITE:
+    {
+        bool is_read = req->op == UringFileRequest::READ;
+        sqe->off = req->offset;
+        if(req->iovcnt == 1) {
+            const char *base = static_cast<const char *>(req->iov->iov_base);
+            for(size_t i = 0; i < fixed_buffers.size(); i++) {
+                const char *start = static_cast<const char *>(fixed_buffers[i].iov_base);
+                if(base >= start && base + req->iov->iov_len <= start + fixed_buffers[i].iov_len) {
+                    sqe->opcode = is_read ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+                    sqe->addr = (unsigned long)base;
+                    sqe->len = req->iov->iov_len;
+                    sqe->buf_index = i;
+                    break;
+                }
+            }
+            if(sqe->opcode != 0) break;
+        }
+        sqe->opcode = is_read ? IORING_OP_READV : IORING_OP_WRITEV;
+        sqe->addr = (unsigned long)req->iov;
+        sqe->len = req->iovcnt;
+        break;
+    }
+    case UringFileRequest::FSYNC:
+        sqe->opcode = IORING_OP_FSYNC;
+        break;
+    case UringFileRequest::FDSYNC:
+        sqe->opcode = IORING_OP_FSYNC;
+        sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+        break;
+    }
+    sqe->user_data = (unsigned long)req;
+}
+
+// One completion is reserved for the wakeup poll
+bool UringEngine::push_locked(UringFileRequest *req) {
+    if(inflight + 1 >= cq_entries) return false;
+
+    unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    if(local_tail - head >= sq_entries) return false;
+
+    unsigned index = local_tail & *sq_mask;
+    prep_locked(&sqes[index], req);
+    sq_array[index] = index;
+    local_tail++;
+    __atomic_store_n(sq_tail, local_tail, __ATOMIC_RELEASE);
+    to_submit++;
+    inflight++;
+    return true;
+}
+
+// The poll on eventfd completes once, its user_data is 0
+bool UringEngine::arm_wakeup_locked() {
+    unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    if(local_tail - head >= sq_entries) return false;
+
+    unsigned index = local_tail & *sq_mask;
+    struct io_uring_sqe *sqe = &sqes[index];
+    memset(sqe, 0, sizeof *sqe);
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = event_fd;
+    sqe->poll_events = POLLIN;
+    sqe->user_data = 0;
+    sq_array[index] = index;
+    local_tail++;
+    __atomic_store_n(sq_tail, local_tail, __ATOMIC_RELEASE);
+    to_submit++;
+    wakeup_armed = true;
+    return true;
+}
+
+void UringEngine::submit(UringFileRequest *req) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if(!backlog.empty() || !push_locked(req)) {
+        // Pushed by the reaper after the next completions
+        backlog.push_back(req);
+        return;
+    }
+
+    // Only the first request since the reaper began to wait wakes it
+    if(!awake) {
+        uint64_t one = 1;
+        awake = true;
+        if(write(event_fd, &one, sizeof one) < 0) {}
+    }
+}
+
+void UringEngine::post(UringFileRequest *req, int res) {
+    WFTimerTask *timer = WFTaskFactory::create_timer_task(0, [req, res](WFTimerTask *) {
+        req->complete(res);
+    });
+    timer->start();
+}
+
+void UringEngine::reap() {
+    std::vector<std::pair<UringFileRequest *, int>> done;
+    while(true) {
+        unsigned n;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            n = to_submit;
+            awake = false;
+        }
+
+        // Submit all queued requests and wait in one call, it returns at once
+        // without waiting if the submission fails
+        int ret = enter(n, 1, IORING_ENTER_GETEVENTS);
+        bool stalled = ret < 0 && errno != EINTR && n > 0;
+
+        bool woken = false;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            awake = true;
+            if(ret > 0) to_submit -= ret;
+
+            unsigned head = *cq_head;
+            unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+            while(head != tail) {
+                const struct io_uring_cqe *cqe = &cqes[head & *cq_mask];
+                if(cqe->user_data == 0)
+                    woken = true;
+                else
+                    done.emplace_back((UringFileRequest *)cqe->user_data, cqe->res);
+                head++;
+            }
+            __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+            inflight -= done.size();
+
+            if(woken) {
+                uint64_t value;
+                if(read(event_fd, &value, sizeof value) < 0) {}
+                wakeup_armed = false;
+            }
+            if(!wakeup_armed) arm_wakeup_locked();
+            while(!backlog.empty() && push_locked(backlog.front()))
+                backlog.pop_front();
+        }
+
+        for(auto &d : done)
+            post(d.first, d.second);
+        done.clear();
+
+        // Out of resources, such as EAGAIN or EBUSY, retry a little later
+        // instead of leaving the requests in the queue
+        if(stalled) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+int UringEngine::register_files(const std::vector<int> &fds) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if(!fixed_files.empty()) {
+        do_register(IORING_UNREGISTER_FILES, nullptr, 0);
+        fixed_files.clear();
+    }
+    if(fds.empty()) return 0;
+    if(do_register(IORING_REGISTER_FILES, fds.data(), fds.size()) < 0) return -1;
+
+    for(size_t i = 0; i < fds.size(); i++)
+        fixed_files[fds[i]] = (int)i;
+    return 0;
+}
+
+int UringEngine::register_buffers(const std::vector<struct iovec> &iovs) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if(!fixed_buffers.empty()) {
+        do_register(IORING_UNREGISTER_BUFFERS, nullptr, 0);
+        fixed_buffers.clear();
+    }
+    if(iovs.empty()) return 0;
+    if(do_register(IORING_REGISTER_BUFFERS, iovs.data(), iovs.size()) < 0) return -1;
+
+    fixed_buffers = iovs;
+    return 0;
+}
+
+template<class Args>
+class UringFileTask : public WFFileTask<Args>, public UringFileRequest {
+public:
+    UringFileTask(int op, int fd, const struct iovec *iov, int iovcnt, off_t offset,
+        bool fixed_file)
+        : WFFileTask<Args>(nullptr, nullptr),
+          UringFileRequest(op, fd, iov, iovcnt, offset, fixed_file) {}
+
+    virtual void dispatch() { UringEngine::instance->submit(this); }
+
+protected:
+    virtual void complete(int res) {
+        if(res < 0) {
+            this->handle(WFT_STATE_SYS_ERROR, -res);
+        }
+        else {
+            this->result = res;
+            this->handle(WFT_STATE_SUCCESS, 0);
+        }
+    }
+
+private:
+    // Not used, the task is never requested to IOService
+    virtual int prepare() { return 0; }
+};
+
+class UringFileIOTask : public UringFileTask<FileIOArgs> {
+public:
+    UringFileIOTask(int op, int fd, void *buf, size_t count, off_t offset, bool fixed_file)
+        : UringFileTask(op, fd, &vec, 1, offset, fixed_file) {
+        vec.iov_base = buf;
+        vec.iov_len = count;
+        this->args.fd = fd;
+        this->args.buf = buf;
+        this->args.count = count;
+        this->args.offset = offset;
+    }
+
+private:
+    struct iovec vec;
+};
+
+class UringFileVIOTask : public UringFileTask<FileVIOArgs> {
+public:
+    UringFileVIOTask(int op, int fd, const struct iovec *iov, int iovcnt, off_t offset,
+        bool fixed_file)
+        : UringFileTask(op, fd, iov, iovcnt, offset, fixed_file) {
+        this->args.fd = fd;
+        this->args.iov = iov;
+        this->args.iovcnt = iovcnt;
+        this->args.offset = offset;
+    }
+};
+
+class UringFileSyncTask : public UringFileTask<FileSyncArgs> {
+public:
+    UringFileSyncTask(int op, int fd, bool fixed_file)
+        : UringFileTask(op, fd, nullptr, 0, 0, fixed_file) {
+        this->args.fd = fd;
+    }
+};
+
+#endif // PYWF_HAVE_IO_URING
+
+static int file_engine = FILE_ENGINE_DEFAULT;
+
+int FileEngine::init(int engine) {
+#ifdef PYWF_HAVE_IO_URING
+    static std::mutex init_mtx;
+    std::lock_guard<std::mutex> lock(init_mtx);
+    if(engine == FILE_ENGINE_IO_URING && UringEngine::instance == nullptr) {
+        UringEngine *uring = new UringEngine;
+        if(uring->init(URING_ENTRIES) == 0)
+            UringEngine::instance = uring;
+        else
+            delete uring;
+    }
+    if(engine == FILE_ENGINE_IO_URING && UringEngine::instance)
+        file_engine = FILE_ENGINE_IO_URING;
+    else
+        file_engine = FILE_ENGINE_DEFAULT;
+#endif
+    return file_engine;
+}
+
+int FileEngine::get_engine() {
+    return file_engine;
+}
+
+WFFileIOTask *FileEngine::create_pread_task(int fd, void *buf, size_t count, off_t offset, bool fixed_file) {
+#ifdef PYWF_HAVE_IO_URING
+    if(file_engine == FILE_ENGINE_IO_URING)
+        return new UringFileIOTask(UringFileRequest::READ, fd, buf, count, offset, fixed_file);
+#endif
+    return WFTaskFactory::create_pread_task(fd, buf, count, offset, nullptr);
+}
+
+WFFileIOTask *FileEngine::create_pwrite_task(int fd, const void *buf, size_t count,
+    off_t offset, bool fixed_file) {
+#ifdef PYWF_HAVE_IO_URING
+    if(file_engine == FILE_ENGINE_IO_URING) {
+        return new UringFileIOTask(UringFileRequest::WRITE, fd, const_cast<void *>(buf),
+            count, offset, fixed_file);
+    }
+#endif
+    return WFTaskFactory::create_pwrite_task(fd, buf, count, offset, nullptr);
+}
+
+WFFileVIOTask *FileEngine::create_preadv_task(int fd, const struct iovec *iov, int iovcnt,
+    off_t offset, bool fixed_file) {
+#ifdef PYWF_HAVE_IO_URING
+    if(file_engine == FILE_ENGINE_IO_URING)
+        return new UringFileVIOTask(UringFileRequest::READ, fd, iov, iovcnt, offset,
+            fixed_file);
+#endif
+    return WFTaskFactory::create_preadv_task(fd, iov, iovcnt, offset, nullptr);
+}
+
+WFFileVIOTask *FileEngine::create_pwritev_task(int fd, const struct iovec *iov, int iovcnt,
+    off_t offset, bool fixed_file) {
+#ifdef PYWF_HAVE_IO_URING
+    if(file_engine == FILE_ENGINE_IO_URING)
+        return new UringFileVIOTask(UringFileRequest::WRITE, fd, iov, iovcnt, offset,
+            fixed_file);
+#endif
+    return WFTaskFactory::create_pwritev_task(fd, iov, iovcnt, offset, nullptr);
+}
+
+WFFileSyncTask *FileEngine::create_fsync_task(int fd, bool fixed_file) {
+#ifdef PYWF_HAVE_IO_URING
+    if(file_engine == FILE_ENGINE_IO_URING)
+        return new UringFileSyncTask(UringFileRequest::FSYNC, fd, fixed_file);
+#endif
+    return WFTaskFactory::create_fsync_task(fd, nullptr);
+}
+
+WFFileSyncTask *FileEngine::create_fdsync_task(int fd, bool fixed_file) {
+#ifdef PYWF_HAVE_IO_URING
+    if(file_engine == FILE_ENGINE_IO_URING)
+        return new UringFileSyncTask(UringFileRequest::FDSYNC, fd, fixed_file);
+#endif
+    return WFTaskFactory::create_fdsync_task(fd, nullptr);
+}
+
+int FileEngine::register_files(const std::vector<int> &fds) {
+#ifdef PYWF_HAVE_IO_URING
+    if(file_engine == FILE_ENGINE_IO_URING)
+        return UringEngine::instance->register_files(fds);
+#endif
+    errno = ENOSYS;
+    return -1;
+}
+
+int FileEngine::register_buffers(const std::vector<struct iovec> &iovs) {
+#ifdef PYWF_HAVE_IO_URING
+    if(file_engine == FILE_ENGINE_IO_URING)
+        return UringEngine::instance->register_buffers(iovs);
+#endif
+    errno = ENOSYS;
+    return -1;
+}
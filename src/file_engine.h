@@ -0,0 +1,101 @@
+#ifndef PYWF_FILE_ENGINE_H
+#define PYWF_FILE_ENGINE_H
+#include "workflow/WFTask.h"
+#include "workflow/WFTaskFactory.h"
+#include <sys/uio.h>
+#include <vector>
+
+enum {
+    FILE_ENGINE_DEFAULT  = 0,
+    FILE_ENGINE_IO_URING = 1,
+};
+
+/**
+ * The result of a WFFileTask which is not run by IOService, the one of
+ * WFFileTask can only be set by IOService, see FileEngine::get_retval.
+ */
+class FileTaskResult {
+public:
+    long get_result() const { return result; }
+    virtual ~FileTaskResult() {}
+
+protected:
+    long result{-1};
+};
+
+/**
+ * A file task on the io_uring engine. The tasks are still WFFileTask so the
+ * python wrappers are shared.
+ */
+class UringFileRequest : public FileTaskResult {
+public:
+    enum { READ, WRITE, FSYNC, FDSYNC };
+
+protected:
+    UringFileRequest(int op, int fd, const struct iovec *iov, int iovcnt, long long offset,
+        bool fixed_file)
+        : op(op), fd(fd), iov(iov), iovcnt(iovcnt), offset(offset), fixed_file(fixed_file) {}
+
+    // Called with res of the cqe, a negative errno on failure
+    virtual void complete(int res) = 0;
+
+    int op;
+    int fd;
+    const struct iovec *iov;
+    int iovcnt;
+    long long offset;
+    bool fixed_file;
+
+    friend class UringEngine;
+};
+
+/**
+ * FileEngine creates file tasks on the engine selected when the library is
+ * initialized. The default engine is the IOService of workflow, which runs
+ * buffered (non O_DIRECT) files synchronously, io_uring is truly async for
+ * them, and the requests queued while its reaper is busy are submitted by
+ * one system call.
+ */
+class FileEngine {
+public:
+    // Return the engine in use, io_uring falls back to default if unavailable
+    static int init(int engine);
+    static int get_engine();
+
+    /**
+     * With fixed_file, a fd registered by register_files is used by its slot.
+     * Only fds owned by the user should set it, the fds opened and closed by
+     * this library may reuse the number of a registered fd already closed.
+     */
+    static WFFileIOTask *create_pread_task(int fd, void *buf, size_t count, off_t offset,
+        bool fixed_file = false);
+    static WFFileIOTask *create_pwrite_task(int fd, const void *buf, size_t count, off_t offset,
+        bool fixed_file = false);
+    static WFFileVIOTask *create_preadv_task(int fd, const struct iovec *iov, int iovcnt,
+        off_t offset, bool fixed_file = false);
+    static WFFileVIOTask *create_pwritev_task(int fd, const struct iovec *iov, int iovcnt,
+        off_t offset, bool fixed_file = false);
+    static WFFileSyncTask *create_fsync_task(int fd, bool fixed_file = false);
+    static WFFileSyncTask *create_fdsync_task(int fd, bool fixed_file = false);
+
+    template<class Args>
+    static long get_retval(WFFileTask<Args> *task) {
+        auto *req = dynamic_cast<FileTaskResult *>(task);
+        if(req == nullptr) return task->get_retval();
+        return task->get_state() == WFT_STATE_SUCCESS ? req->get_result() : -1;
+    }
+
+    /**
+     * Register fds and buffers to io_uring, later requests on them skip the
+     * fd lookup and the page pinning of each request. Each call replaces the
+     * previous ones, and should be made when no file task is running. The
+     * slot keeps the file registered, so a registered fd must be unregistered
+     * by another call before it is closed, or its number may be reused by
+     * another file while requests still go to the slot.
+     * Return 0 on success, or -1 with errno set.
+     */
+    static int register_files(const std::vector<int> &fds);
+    static int register_buffers(const std::vector<struct iovec> &iovs);
+};
+
+#endif // PYWF_FILE_ENGINE_H
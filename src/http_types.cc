@@ -1,4 +1,6 @@
 #include "http_types.h"
+#include "workflow/WFComplexClientTask.h"
+#include <cstring>
 
 void __network_helper::client_prepare(WFHttpTask *p) {
     auto resp = p->get_resp();
@@ -19,10 +21,250 @@ void __network_helper::server_prepare(WFHttpTask *p) {
     pytask.set_callback(nullptr);
 }
 
+static inline int __hex_value(char c) {
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Invalid escapes are kept as is, the same as urllib.parse.unquote
+static py::str __percent_decode(const char *p, size_t n, bool plus_as_space) {
+    std::string s;
+    s.reserve(n);
+    for(size_t i = 0; i < n; i++) {
+        char c = p[i];
+        if(c == '%' && i + 2 < n) {
+            int hi = __hex_value(p[i + 1]);
+            int lo = __hex_value(p[i + 2]);
+            if(hi >= 0 && lo >= 0) {
+                s.push_back((char)(hi * 16 + lo));
+                i += 2;
+                continue;
+            }
+        }
+        s.push_back((plus_as_space && c == '+') ? ' ' : c);
+    }
+    PyObject *o = PyUnicode_DecodeUTF8(s.data(), (ssize_t)s.size(), "replace");
+    if(o == nullptr) throw py::error_already_set();
+    return py::reinterpret_steal<py::str>(o);
+}
+
+// Split request uri into path and query, fragment is dropped
+static void __split_uri(const char *uri, const char **path, size_t *path_len,
+    const char **query, size_t *query_len) {
+    const char *end = uri ? uri + strlen(uri) : nullptr;
+    *path = uri;
+    *path_len = 0;
+    *query = nullptr;
+    *query_len = 0;
+    if(uri == nullptr) return;
+
+    const char *hash = strchr(uri, '#');
+    if(hash) end = hash;
+    const char *q = (const char *)memchr(uri, '?', end - uri);
+    if(q) {
+        *path_len = q - uri;
+        *query = q + 1;
+        *query_len = end - q - 1;
+    }
+    else {
+        *path_len = end - uri;
+    }
+}
+
+/**
+ * Call f(key, key_len, value, value_len) for each field separated by sep,
+ * value is nullptr if there is no '=' in the field.
+ */
+template<typename Func>
+static void __for_each_pair(const char *p, size_t n, char sep, Func &&f) {
+    const char *end = p + n;
+    while(p < end) {
+        const char *next = (const char *)memchr(p, sep, end - p);
+        if(next == nullptr) next = end;
+        const char *k = p;
+        const char *kend = next;
+        if(sep == ';') {
+            // Cookie pairs are separated by "; "
+            while(k < kend && (*k == ' ' || *k == '\t')) k++;
+            while(kend > k && (kend[-1] == ' ' || kend[-1] == '\t')) kend--;
+        }
+        if(kend > k) {
+            const char *eq = (const char *)memchr(k, '=', kend - k);
+            if(eq) f(k, (size_t)(eq - k), eq + 1, (size_t)(kend - eq - 1));
+            else f(k, (size_t)(kend - k), nullptr, 0);
+        }
+        p = next + 1;
+    }
+}
+
+HttpAttachment *PyHttpRequest::get_cache() const {
+    auto attach = static_cast<HttpAttachment*>(this->get()->get_attachment());
+    if(attach == nullptr) {
+        attach = new HttpAttachment();
+        this->get()->set_attachment(attach);
+    }
+    return attach;
+}
+
+// Parse the request uri if it is not parsed or changed since last time
+HttpAttachment *PyHttpRequest::parse_uri() const {
+    HttpAttachment *cache = get_cache();
+    const char *uri = this->get()->get_request_uri();
+    if(uri == nullptr) uri = "";
+    if(cache->uri_parsed && cache->parsed_uri == uri) return cache;
+
+    const char *path, *query;
+    size_t path_len, query_len;
+    py::dict d;
+    __split_uri(uri, &path, &path_len, &query, &query_len);
+    if(query) {
+        __for_each_pair(query, query_len, '&', [&d](const char *k, size_t klen,
+            const char *v, size_t vlen) {
+            py::str key = __percent_decode(k, klen, true);
+            py::str value = v ? __percent_decode(v, vlen, true) : py::str();
+            PyObject *lst = PyDict_GetItem(d.ptr(), key.ptr()); // borrowed
+            if(lst) {
+                if(PyList_Append(lst, value.ptr()) != 0) throw py::error_already_set();
+            }
+            else {
+                py::list l(1);
+                l[0] = value;
+                d[key] = l;
+            }
+        });
+    }
+
+    cache->path = __percent_decode(path, path_len, false);
+    cache->query_string = query ? py::str(query, query_len) : py::str();
+    cache->query = d;
+    cache->parsed_uri = uri;
+    cache->uri_parsed = true;
+    return cache;
+}
+
+py::str PyHttpRequest::get_path() const {
+    return parse_uri()->path;
+}
+
+py::str PyHttpRequest::get_query_string() const {
+    return parse_uri()->query_string;
+}
+
+// A copy of the cached one, the lists may be changed by the caller
+py::dict PyHttpRequest::get_query() const {
+    py::dict d;
+    for(auto item : parse_uri()->query) {
+        PyObject *lst = PySequence_List(item.second.ptr());
+        if(lst == nullptr) throw py::error_already_set();
+        d[item.first] = py::reinterpret_steal<py::list>(lst);
+    }
+    return d;
+}
+
+// The first value if the name appears more than once
+py::object PyHttpRequest::get_query_param(const std::string &name) const {
+    PyObject *lst = PyDict_GetItem(parse_uri()->query.ptr(), py::str(name).ptr());
+    if(lst == nullptr || !PyList_Check(lst) || PyList_GET_SIZE(lst) == 0) return py::none();
+    return py::reinterpret_borrow<py::object>(PyList_GET_ITEM(lst, 0));
+}
+
+py::dict PyHttpRequest::get_cookies() const {
+    HttpAttachment *cache = get_cache();
+    if(cache->cookies) return cache->cookies;
+
+    py::dict d;
+    protocol::HttpHeaderCursor cursor(this->get());
+    std::string name, value;
+    while(cursor.next(name, value)) {
+        if(strcasecmp(name.c_str(), "Cookie") != 0) continue;
+        __for_each_pair(value.data(), value.size(), ';', [&d](const char *k, size_t klen,
+            const char *v, size_t vlen) {
+            if(v == nullptr) return;
+            if(vlen >= 2 && v[0] == '"' && v[vlen - 1] == '"') {
+                v++;
+                vlen -= 2;
+            }
+            py::str key(k, klen);
+            // The first one wins if there are duplicate names
+            if(!d.contains(key)) d[key] = __percent_decode(v, vlen, false);
+        });
+    }
+    cache->cookies = d;
+    return d;
+}
+
+py::object PyHttpRequest::get_cookie(const std::string &name) const {
+    py::dict cookies = get_cookies();
+    py::str key(name);
+    if(cookies.contains(key)) return cookies[key];
+    return py::none();
+}
+
+/**
+ * A http client task on unix domain socket. As the tasks created by
+ * WFTaskFactory::create_http_task, the request is sent with a Connection
+ * and a Content-Length header if the user does not set them, and the
+ * connection is reused only if both the request and the response allow.
+ */
+class UnixHttpTask : public WFComplexClientTask<protocol::HttpRequest, protocol::HttpResponse> {
+public:
+    UnixHttpTask(int retry_max) : WFComplexClientTask(retry_max, nullptr) {}
+
+protected:
+    virtual CommMessageOut *message_out() {
+        auto *req = this->get_req();
+        size_t body_size = req->get_output_body_size();
+        if(body_size > 0 && !req->is_chunked() && !req->has_content_length_header())
+            req->add_header_pair("Content-Length", std::to_string(body_size));
+
+        if(!req->has_connection_header())
+            req->add_header_pair("Connection", "Keep-Alive");
+        else if(!req->is_keep_alive())
+            this->keep_alive_timeo = 0;
+
+        return this->WFComplexClientTask::message_out();
+    }
+
+    virtual CommMessageIn *message_in() {
+        auto *resp = this->get_resp();
+        if(strcmp(this->get_req()->get_method(), HttpMethodHead) == 0)
+            resp->parse_zero_body();
+        return this->WFComplexClientTask::message_in();
+    }
+
+    virtual int keep_alive_timeout() {
+        return this->get_resp()->is_keep_alive() ? this->keep_alive_timeo : 0;
+    }
+};
+
+/**
+ * Create a http task on unix domain socket, the request is initialized as
+ * "GET / HTTP/1.1", user can set request uri and headers before start.
+ */
+static WFHttpTask *create_unix_http_task(const struct sockaddr_un &addr,
+    socklen_t addrlen, int retry_max) {
+    UnixHttpTask *ptr = new UnixHttpTask(retry_max);
+    ptr->init(TT_TCP, (const struct sockaddr *)&addr, addrlen, "");
+    auto *req = ptr->get_req();
+    req->set_method(HttpMethodGet);
+    req->set_request_uri("/");
+    req->set_http_version(HttpVersion11);
+    req->set_header_pair("Host", "localhost");
+    ptr->set_keep_alive(60 * 1000);
+    return ptr;
+}
+
 PyWFHttpTask create_http_task(const std::string &url, int redirect_max,
     int retry_max, py_http_callback_t cb) {
-    WFHttpTask *ptr = WFTaskFactory::create_http_task(url, redirect_max,
-        retry_max, nullptr);
+    WFHttpTask *ptr;
+    struct sockaddr_un addr;
+    socklen_t addrlen;
+    if(__network_helper::unix_url_addr(url, &addr, &addrlen))
+        ptr = create_unix_http_task(addr, addrlen, retry_max);
+    else
+        ptr = WFTaskFactory::create_http_task(url, redirect_max, retry_max, nullptr);
     PyWFHttpTask t(ptr);
     t.set_callback(std::move(cb));
     return t;
@@ -38,6 +280,68 @@ PyWFHttpTask create_http_proxy_task(const std::string &url,
     return t;
 }
 
+static void forward_reply(WFHttpTask *server_task, WFHttpTask *t, bool keep_alive) {
+    static const char bad_gateway[] = "<html>502 Bad Gateway</html>";
+    auto *resp = server_task->get_resp();
+    if(t->get_state() == WFT_STATE_SUCCESS) {
+        __network_helper::client_prepare(t);
+        *resp = std::move(*t->get_resp());
+    }
+    else {
+        resp->set_status_code("502");
+        resp->set_reason_phrase("Bad Gateway");
+        resp->append_output_body_nocopy(bad_gateway, sizeof (bad_gateway) - 1);
+    }
+    if(!keep_alive) resp->set_header_pair("Connection", "close");
+}
+
+/**
+ * Forward the request of server_task to upstream_url and reply the
+ * upstream response, without entering python. The forward task is pushed
+ * to the series of server_task, and callback is called after the reply
+ * is moved into server_task's response.
+ */
+PyWFHttpTask create_forward_task(PyWFHttpTask &server_task, const std::string &upstream_url,
+    const std::map<std::string, std::string> &rewrite_rules, py_http_callback_t cb) {
+    WFHttpTask *srv = server_task.get();
+    protocol::HttpRequest *srv_req = srv->get_req();
+    std::string url = upstream_url;
+    const char *uri = srv_req->get_request_uri();
+    if(uri && uri[0] == '/') {
+        if(!url.empty() && url.back() == '/') url.pop_back();
+        url.append(uri);
+    }
+
+    bool keep_alive = srv_req->is_keep_alive();
+    WFHttpTask *ptr = WFTaskFactory::create_http_task(url, 0, 0, nullptr);
+    auto deleter = std::make_shared<PyWFHttpTask::_deleter_t>(std::move(cb), ptr);
+    ptr->set_callback([deleter, srv, keep_alive](WFHttpTask *t) {
+        forward_reply(srv, t, keep_alive);
+        if(deleter->get_func()) {
+            py_callback_wrapper(deleter->get_func(), PyWFHttpTask(t));
+        }
+    });
+
+    // The factory has set request uri and Host for upstream, keep them
+    protocol::HttpRequest *req = ptr->get_req();
+    std::string request_uri = __as_string(req->get_request_uri());
+    std::string host;
+    {
+        protocol::HttpHeaderCursor cursor(req);
+        cursor.find("Host", host);
+    }
+
+    *req = std::move(*srv_req);
+    req->set_request_uri(request_uri);
+    if(!host.empty()) req->set_header_pair("Host", host.c_str());
+    for(const auto &kv : rewrite_rules) {
+        req->set_header_pair(kv.first.c_str(), kv.second.c_str());
+    }
+
+    series_of(srv)->push_back(ptr);
+    return PyWFHttpTask(ptr);
+}
+
 void init_http_types(py::module_ &wf) {
     py::class_<PyWFHttpTask, PySubTask>(wf, "HttpTask")
         .def("start",               &PyWFHttpTask::start)
@@ -70,6 +374,12 @@ void init_http_types(py::module_ &wf) {
         .def("end_parsing",          &PyHttpRequest::end_parsing)
         .def("set_method",           &PyHttpRequest::set_method)
         .def("set_request_uri",      &PyHttpRequest::set_request_uri)
+        .def("get_path",             &PyHttpRequest::get_path)
+        .def("get_query_string",     &PyHttpRequest::get_query_string)
+        .def("get_query",            &PyHttpRequest::get_query)
+        .def("get_query_param",      &PyHttpRequest::get_query_param, py::arg("name"))
+        .def("get_cookies",          &PyHttpRequest::get_cookies)
+        .def("get_cookie",           &PyHttpRequest::get_cookie, py::arg("name"))
         .def("set_http_version",     &PyHttpRequest::set_http_version)
         .def("add_header_pair",      &PyHttpRequest::add_header_pair)
         .def("set_header_pair",      &PyHttpRequest::set_header_pair)
@@ -109,6 +419,8 @@ void init_http_types(py::module_ &wf) {
             py::arg("key_file") = std::string())
         .def("start", &PyWFHttpServer::start_2, py::arg("family"), py::arg("host"), py::arg("port"),
             py::arg("cert_file") = std::string(), py::arg("key_file") = std::string())
+        .def("start_unix", &PyWFHttpServer::start_unix, py::arg("path"),
+            py::arg("cert_file") = std::string(), py::arg("key_file") = std::string())
         .def("shutdown", &PyWFHttpServer::shutdown, py::call_guard<py::gil_scoped_release>())
         .def("wait_finish", &PyWFHttpServer::wait_finish, py::call_guard<py::gil_scoped_release>())
         .def("stop",  &PyWFHttpServer::stop, py::call_guard<py::gil_scoped_release>())
@@ -117,4 +429,6 @@ void init_http_types(py::module_ &wf) {
         py::arg("retry_max"), py::arg("callback"));
     wf.def("create_http_task", &create_http_proxy_task, py::arg("url"), py::arg("proxy_url"),
         py::arg("redirect_max"), py::arg("retry_max"), py::arg("callback"));
+    wf.def("create_forward_task", &create_forward_task, py::arg("server_task"), py::arg("upstream_url"),
+        py::arg("rewrite_rules") = std::map<std::string, std::string>(), py::arg("callback") = py::none());
 }
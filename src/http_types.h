@@ -9,6 +9,11 @@ static inline std::string __as_string(const char *p) {
     return s;
 }
 
+/**
+ * HttpAttachment holds the output body appended by python, and caches the
+ * request uri and cookies parsed by PyHttpRequest, since the python wrapper
+ * of a message is created for each access.
+ */
 class HttpAttachment final : public protocol::ProtocolMessage::Attachment {
 public:
     HttpAttachment() : total_size(0) {}
@@ -17,10 +22,18 @@ public:
         {
             py::gil_scoped_acquire acquire;
             pybytes.clear();
+            path = py::object();
+            query_string = py::object();
+            query = py::object();
+            cookies = py::object();
         }
         nocopy_body.clear();
     }
 
+    // False if the attachment is only used as a cache, the body is parsed one
+    bool has_body() const { return body_set; }
+    void set_body() { body_set = true; }
+
     // I suppose the caller has GIL for append, get_body, clear
     void append(py::bytes b, const char *p, size_t sz) {
         if(sz > 0) {
@@ -48,10 +61,20 @@ public:
         nocopy_body.clear();
         total_size = 0;
     }
+    // Valid while the request uri equals parsed_uri
+    bool uri_parsed{false};
+    std::string parsed_uri;
+    py::object path;
+    py::object query_string;
+    py::object query;
+    // Dropped when headers are changed by python
+    py::object cookies;
+
 private:
     std::vector<py::bytes> pybytes;
     std::vector<std::pair<const char*, size_t>> nocopy_body;
     size_t total_size;
+    bool body_set{false};
 };
 
 /**
@@ -70,10 +93,12 @@ public:
     bool is_keep_alive() const { return this->get()->is_keep_alive(); }
 
     bool add_header_pair(const std::string &k, const std::string &v) {
+        drop_cookies();
         return this->get()->add_header_pair(k.c_str(), v.c_str());
     }
 
     bool set_header_pair(const std::string &k, const std::string &v) {
+        drop_cookies();
         return this->get()->set_header_pair(k.c_str(), v.c_str());
     }
 
@@ -93,7 +118,7 @@ public:
 
     py::bytes get_body() const {
         auto attach = static_cast<HttpAttachment*>(this->get()->get_attachment());
-        if(attach) {
+        if(attach && attach->has_body()) {
             return attach->get_body();
         }
         return protocol::HttpUtil::decode_chunked_body(this->get());
@@ -102,10 +127,13 @@ public:
     bool set_http_version(const std::string &s) { return this->get()->set_http_version(s); }
     bool append_bytes_body(py::bytes b) {
         auto attach = static_cast<HttpAttachment*>(this->get()->get_attachment());
-        if(attach == nullptr) { // Which means it is the first time to append body
+        if(attach == nullptr || !attach->has_body()) { // The first time to append body
             this->get()->clear_output_body();
-            attach = new HttpAttachment();
-            this->get()->set_attachment(attach);
+            if(attach == nullptr) {
+                attach = new HttpAttachment();
+                this->get()->set_attachment(attach);
+            }
+            attach->set_body();
         }
         char *buffer = nullptr;
         ssize_t length = 0;
@@ -139,11 +167,16 @@ public:
 protected:
     std::string _get_parsed_body() const {
         auto attach = static_cast<HttpAttachment*>(this->get()->get_attachment());
-        if(attach) {
+        if(attach && attach->has_body()) {
             return attach->get_body();
         }
         return protocol::HttpUtil::decode_chunked_body(this->get());
     }
+
+    void drop_cookies() {
+        auto attach = static_cast<HttpAttachment*>(this->get()->get_attachment());
+        if(attach) attach->cookies = py::object();
+    }
 };
 
 class PyHttpRequest : public PyHttpMessage {
@@ -168,7 +201,23 @@ public:
 
     bool set_method(const std::string &s)       { return this->get()->set_method(s); }
     bool set_request_uri(const std::string &s)  { return this->get()->set_request_uri(s); }
+
+    /**
+     * The following functions parse request uri and Cookie headers in C++,
+     * keys and values are percent-decoded and then decoded as utf-8. They
+     * are parsed once and cached on the request, the same objects are
+     * returned until the request uri or headers are changed.
+     */
+    py::str get_path() const;
+    py::str get_query_string() const;
+    py::dict get_query() const;
+    py::object get_query_param(const std::string &name) const;
+    py::dict get_cookies() const;
+    py::object get_cookie(const std::string &name) const;
+
 private:
+    HttpAttachment *get_cache() const;
+    HttpAttachment *parse_uri() const;
 };
 
 class PyHttpResponse : public PyHttpMessage {
@@ -0,0 +1,291 @@
+#include "log_writer.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+
+#ifdef IOV_MAX
+static const size_t LOG_BATCH_RECORDS = IOV_MAX;
+#else
+static const size_t LOG_BATCH_RECORDS = 1024;
+#endif
+
+// Records larger than this do not keep their memory in the ring
+static const size_t LOG_KEEP_CAPACITY = 64 * 1024;
+
+static int64_t log_now_ms() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+std::shared_ptr<AsyncLogWriter> AsyncLogWriter::create(const std::string &path,
+    const Params &params) {
+    struct stat st;
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if(fd < 0) return nullptr;
+    if(fstat(fd, &st) < 0) {
+        int error = errno;
+        ::close(fd);
+        errno = error;
+        return nullptr;
+    }
+
+    std::shared_ptr<AsyncLogWriter> writer(new AsyncLogWriter(path, params, fd, st.st_size));
+    if(params.flush_interval_ms > 0) writer->start_timer();
+    return writer;
+}
+
+AsyncLogWriter::AsyncLogWriter(const std::string &path, const Params &params, int fd,
+    size_t file_size)
+    : path(path), params(params), fd(fd), file_size(file_size), last_sync(log_now_ms()),
+      batch(LOG_BATCH_RECORDS) {
+    size_t size = 2;
+    while(size < params.ring_size) size <<= 1;
+    cells.reset(new Cell[size]);
+    for(size_t i = 0; i < size; i++) cells[i].seq.store(i, std::memory_order_relaxed);
+    mask = size - 1;
+}
+
+AsyncLogWriter::~AsyncLogWriter() {
+    if(!fd_closed) ::close(fd);
+}
+
+/**
+ * A bounded multi-producer queue, each cell is free when seq equals pos.
+ * A writer is counted in writers before it checks closed, so the final
+ * flush either is seen by the writer or sees it, then the writer starts
+ * the flush again after its record is published.
+ */
+bool AsyncLogWriter::write(const char *data, size_t size) {
+    writers++;
+    if(closed) {
+        writers--;
+        return false;
+    }
+
+    size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+    Cell *cell;
+    for(;;) {
+        cell = &cells[pos & mask];
+        size_t seq = cell->seq.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if(diff == 0) {
+            if(enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if(diff < 0) {
+            dropped++;
+            writers--;
+            return false;
+        }
+        else
+            pos = enqueue_pos.load(std::memory_order_relaxed);
+    }
+
+    cell->data.assign(data, size);
+    cell->seq.store(pos + 1, std::memory_order_release);
+    bool full = pending_bytes.fetch_add(size) + size >= params.flush_bytes;
+    writers--;
+    if(full || closed) try_flush();
+    return true;
+}
+
+// Called by the flush only, out gives its memory to the cell for reuse
+bool AsyncLogWriter::pop(std::string &out) {
+    Cell &cell = cells[dequeue_pos & mask];
+    if(cell.seq.load(std::memory_order_acquire) != dequeue_pos + 1) return false;
+
+    if(out.capacity() > LOG_KEEP_CAPACITY) std::string().swap(out);
+    out.swap(cell.data);
+    cell.seq.store(dequeue_pos + mask + 1, std::memory_order_release);
+    dequeue_pos++;
+    return true;
+}
+
+void AsyncLogWriter::flush() {
+    try_flush();
+}
+
+void AsyncLogWriter::close(bool wait) {
+    std::unique_lock<std::mutex> lock(close_mtx);
+    if(!closed.exchange(true)) {
+        lock.unlock();
+        try_flush();
+        lock.lock();
+    }
+    if(wait) close_cv.wait(lock, [this]() { return fd_closed; });
+}
+
+void AsyncLogWriter::start_timer() {
+    auto self = shared_from_this();
+    unsigned int microseconds = params.flush_interval_ms * 1000;
+    WFTimerTask *task = WFTaskFactory::create_timer_task(microseconds, [self](WFTimerTask *) {
+        if(self->closed) return;
+        self->try_flush();
+        self->start_timer();
+    });
+    task->start();
+}
+
+void AsyncLogWriter::try_flush() {
+    if(flushing.exchange(true, std::memory_order_acquire)) return;
+    next_batch();
+}
+
+void AsyncLogWriter::next_batch() {
+    while(batch_count < batch.size() && pop(batch[batch_count])) {
+        batch_bytes += batch[batch_count].size();
+        batch_count++;
+    }
+
+    if(batch_count == 0) {
+        finish_cycle();
+        return;
+    }
+
+    pending_bytes -= batch_bytes;
+    if(params.max_file_size > 0 && file_size > 0 && file_size + batch_bytes > params.max_file_size)
+        rotate();
+    else
+        write_batch();
+}
+
+void AsyncLogWriter::write_batch() {
+    size_t skip = batch_done;
+    iov.clear();
+    for(size_t i = 0; i < batch_count; i++) {
+        std::string &record = batch[i];
+        if(skip >= record.size()) {
+            skip -= record.size();
+            continue;
+        }
+        iov.push_back({&record[skip], record.size() - skip});
+        skip = 0;
+    }
+
+    auto self = shared_from_this();
+    WFFileVIOTask *task = FileEngine::create_pwritev_task(fd, iov.data(), (int)iov.size(),
+        file_size);
+    task->set_callback([self](WFFileVIOTask *t) { self->on_write(t); });
+    task->start();
+}
+
+void AsyncLogWriter::on_write(WFFileVIOTask *task) {
+    long ret = FileEngine::get_retval(task);
+    if(task->get_state() != WFT_STATE_SUCCESS || ret <= 0) {
+        bool ok = task->get_state() == WFT_STATE_SUCCESS;
+        last_error = ok ? EIO : task->get_error();
+        dropped += batch_count;
+        clear_batch();
+        next_batch();
+        return;
+    }
+
+    file_size += ret;
+    written += ret;
+    batch_done += ret;
+    dirty = true;
+    // Short write, continue with the rest
+    if(batch_done < batch_bytes) {
+        write_batch();
+        return;
+    }
+
+    clear_batch();
+    if(sync_due())
+        start_sync();
+    else
+        next_batch();
+}
+
+void AsyncLogWriter::clear_batch() {
+    for(size_t i = 0; i < batch_count; i++) batch[i].clear();
+    batch_count = 0;
+    batch_bytes = 0;
+    batch_done = 0;
+}
+
+bool AsyncLogWriter::sync_due() const {
+    if(!dirty || params.sync_interval_ms < 0) return false;
+    return closed || log_now_ms() - last_sync >= params.sync_interval_ms;
+}
+
+void AsyncLogWriter::start_sync() {
+    auto self = shared_from_this();
+    WFFileSyncTask *task = FileEngine::create_fdsync_task(fd);
+    task->set_callback([self](WFFileSyncTask *t) {
+        // Not retried, the error is cleared by the kernel once reported
+        if(t->get_state() != WFT_STATE_SUCCESS) self->last_error = t->get_error();
+        self->dirty = false;
+        self->last_sync = log_now_ms();
+        self->next_batch();
+    });
+    task->start();
+}
+
+// rename and open may block, never run them on the handler threads
+void AsyncLogWriter::rotate() {
+    auto self = shared_from_this();
+    WFGoTask *task = WFTaskFactory::create_go_task("pywf_log_writer", [self]() {
+        const std::string &path = self->path;
+        if(self->dirty && self->params.sync_interval_ms >= 0) fdatasync(self->fd);
+
+        if(self->params.max_files > 0) {
+            for(int i = self->params.max_files - 1; i > 0; i--) {
+                std::string from = path + "." + std::to_string(i);
+                rename(from.c_str(), (path + "." + std::to_string(i + 1)).c_str());
+            }
+            rename(path.c_str(), (path + ".1").c_str());
+        }
+        else
+            unlink(path.c_str());
+
+        // Keep writing to the old file if the new one can not be opened
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if(fd < 0)
+            self->last_error = errno;
+        else {
+            ::close(self->fd);
+            self->fd = fd;
+            self->file_size = 0;
+            self->dirty = false;
+        }
+        self->write_batch();
+    });
+    task->start();
+}
+
+void AsyncLogWriter::finish_cycle() {
+    if(sync_due()) {
+        start_sync();
+        return;
+    }
+
+    if(closed) {
+        // A writer still publishing starts the flush again when it is done
+        if(writers > 0) {
+            flushing.store(false);
+            if(writers == 0 && !flushing.exchange(true)) next_batch();
+            return;
+        }
+        // Records published after the last pop
+        if(cells[dequeue_pos & mask].seq.load(std::memory_order_acquire) == dequeue_pos + 1) {
+            next_batch();
+            return;
+        }
+
+        ::close(fd);
+        std::lock_guard<std::mutex> lock(close_mtx);
+        fd_closed = true;
+        close_cv.notify_all();
+        return;
+    }
+
+    flushing.store(false, std::memory_order_release);
+    // A writer or close may have found the flush running and given up
+    if((pending_bytes >= params.flush_bytes || closed) && !flushing.exchange(true))
+        next_batch();
+}
@@ -0,0 +1,103 @@
+#ifndef PYWF_LOG_WRITER_H
+#define PYWF_LOG_WRITER_H
+#include "file_engine.h"
+#include <sys/uio.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * AsyncLogWriter appends records to a file without blocking the writers.
+ * Records are put into a bounded lock-free ring by any thread, and written
+ * by one flush at a time in batches of pwritev on FileEngine, started when
+ * flush_bytes are pending or every flush_interval_ms. The file is fdsync'ed
+ * after a batch at most every sync_interval_ms (0 for every batch, negative
+ * to never), and rotated to path.1 ... path.max_files before it grows over
+ * max_file_size (0 to never rotate).
+ */
+class AsyncLogWriter : public std::enable_shared_from_this<AsyncLogWriter> {
+public:
+    struct Params {
+        size_t ring_size;
+        size_t flush_bytes;
+        int flush_interval_ms;
+        int sync_interval_ms;
+        size_t max_file_size;
+        int max_files;
+    };
+
+    // Return nullptr with errno set if the file can not be opened
+    static std::shared_ptr<AsyncLogWriter> create(const std::string &path,
+        const Params &params);
+    ~AsyncLogWriter();
+
+    // Return false if the ring is full or the writer is closed
+    bool write(const char *data, size_t size);
+    // Start to write all pending records, without waiting
+    void flush();
+    // Write all pending records, sync and close the file, wait until done if wait
+    void close(bool wait = true);
+
+    size_t get_written() const { return written; }
+    size_t get_dropped() const { return dropped; }
+    int get_error() const { return last_error; }
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        std::string data;
+    };
+
+    AsyncLogWriter(const std::string &path, const Params &params, int fd, size_t file_size);
+
+    bool pop(std::string &out);
+    void start_timer();
+    void try_flush();
+    void next_batch();
+    void write_batch();
+    void on_write(WFFileVIOTask *task);
+    void clear_batch();
+    bool sync_due() const;
+    void start_sync();
+    void rotate();
+    void finish_cycle();
+
+    std::string path;
+    Params params;
+
+    // The ring, written by any thread and read by the flush
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    std::atomic<size_t> enqueue_pos{0};
+    size_t dequeue_pos{0};
+    std::atomic<size_t> pending_bytes{0};
+    std::atomic<bool> flushing{false};
+    std::atomic<bool> closed{false};
+    // Writers between the check of closed and publishing their record
+    std::atomic<size_t> writers{0};
+
+    // Owned by the flush holding flushing
+    int fd;
+    size_t file_size;
+    bool dirty{false};
+    int64_t last_sync;
+    std::vector<std::string> batch;
+    std::vector<struct iovec> iov;
+    size_t batch_count{0};
+    size_t batch_bytes{0};
+    size_t batch_done{0};
+
+    std::atomic<size_t> written{0};
+    std::atomic<size_t> dropped{0};
+    std::atomic<int> last_error{0};
+
+    std::mutex close_mtx;
+    std::condition_variable close_cv;
+    bool fd_closed{false};
+};
+
+#endif // PYWF_LOG_WRITER_H
@@ -1,6 +1,1736 @@
 #include "mysql_types.h"
+#include "workflow/URIParser.h"
+#include <pybind11/numpy.h>
+#include <atomic>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
 using namespace std;
 
+// Same as UNSIGNED_FLAG of mysql
+static const int MYSQL_FIELD_UNSIGNED = 32;
+
+// Return false if p is not a number or overflows uint64
+static bool mysql_parse_uint(const char *p, size_t n, uint64_t &v) {
+    const uint64_t max = std::numeric_limits<uint64_t>::max();
+    if(n == 0) return false;
+    v = 0;
+    for(size_t i = 0; i < n; i++) {
+        unsigned d = (unsigned char)p[i] - '0';
+        if(d > 9 || v > (max - d) / 10) return false;
+        v = v * 10 + d;
+    }
+    return true;
+}
+
+static bool mysql_parse_int(const char *p, size_t n, int64_t &v) {
+    bool neg = n > 0 && p[0] == '-';
+    uint64_t u;
+    if(neg) {
+        p++;
+        n--;
+    }
+    if(!mysql_parse_uint(p, n, u)) return false;
+    const uint64_t max = (uint64_t)std::numeric_limits<int64_t>::max();
+    if(u > (neg ? max + 1 : max)) return false;
+    v = neg ? (int64_t)(0 - u) : (int64_t)u;
+    return true;
+}
+
+static bool mysql_parse_double(const char *p, size_t n, double &v) {
+    char buf[64];
+    std::string tmp;
+    const char *s;
+    if(n < sizeof buf) {
+        memcpy(buf, p, n);
+        buf[n] = '\0';
+        s = buf;
+    }
+    else {
+        tmp.assign(p, n);
+        s = tmp.c_str();
+    }
+
+    char *end;
+    v = strtod(s, &end);
+    return n > 0 && end == s + n;
+}
+
+// Parse exactly count digits
+static bool mysql_parse_digits(const char *&p, const char *end, int count, int &v) {
+    if(end - p < count) return false;
+    v = 0;
+    for(int i = 0; i < count; i++, p++) {
+        unsigned d = (unsigned char)*p - '0';
+        if(d > 9) return false;
+        v = v * 10 + (int)d;
+    }
+    return true;
+}
+
+// Microseconds of .ffffff, the dot is optional
+static bool mysql_parse_fraction(const char *&p, const char *end, int &usec) {
+    usec = 0;
+    if(p == end) return true;
+    if(*p != '.') return false;
+    p++;
+    int digits = 0;
+    while(p < end && digits < 6) {
+        unsigned d = (unsigned char)*p - '0';
+        if(d > 9) return false;
+        usec = usec * 10 + (int)d;
+        p++;
+        digits++;
+    }
+    if(p != end) return false;
+    for(; digits < 6; digits++) usec *= 10;
+    return true;
+}
+
+// Days since 1970-01-01 of a proleptic gregorian date
+static int64_t mysql_days_from_civil(int y, int m, int d) {
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+static bool mysql_parse_ymd(const char *&p, const char *end, int &year, int &month, int &day) {
+    if(!mysql_parse_digits(p, end, 4, year) || p == end || *p++ != '-') return false;
+    if(!mysql_parse_digits(p, end, 2, month) || p == end || *p++ != '-') return false;
+    if(!mysql_parse_digits(p, end, 2, day)) return false;
+    return month >= 1 && month <= 12 && day >= 1 && day <= 31;
+}
+
+static bool mysql_parse_hms(const char *&p, const char *end, int &hour, int &min, int &sec) {
+    if(!mysql_parse_digits(p, end, 2, hour) || p == end || *p++ != ':') return false;
+    if(!mysql_parse_digits(p, end, 2, min) || p == end || *p++ != ':') return false;
+    return mysql_parse_digits(p, end, 2, sec);
+}
+
+static bool mysql_parse_date(const char *p, size_t n, int &year, int &month, int &day) {
+    const char *end = p + n;
+    return mysql_parse_ymd(p, end, year, month, day) && p == end;
+}
+
+static bool mysql_parse_datetime(const char *p, size_t n, int &year, int &month, int &day,
+    int &hour, int &min, int &sec, int &usec) {
+    const char *end = p + n;
+    if(!mysql_parse_ymd(p, end, year, month, day)) return false;
+    hour = min = sec = usec = 0;
+    if(p == end) return true;
+    if(*p != ' ' && *p != 'T') return false;
+    p++;
+    return mysql_parse_hms(p, end, hour, min, sec) && mysql_parse_fraction(p, end, usec);
+}
+
+// Time of mysql is [-]h...h:mm:ss[.ffffff] in range -838:59:59 to 838:59:59
+static bool mysql_parse_time(const char *p, size_t n, bool &neg, int64_t &seconds, int &usec) {
+    const char *end = p + n;
+    neg = p < end && *p == '-';
+    if(neg) p++;
+
+    const char *colon = (const char *)memchr(p, ':', end - p);
+    uint64_t hour;
+    int min, sec;
+    if(colon == nullptr || !mysql_parse_uint(p, colon - p, hour) || hour > 838) return false;
+    p = colon + 1;
+    if(!mysql_parse_digits(p, end, 2, min) || p == end || *p++ != ':') return false;
+    if(!mysql_parse_digits(p, end, 2, sec) || !mysql_parse_fraction(p, end, usec)) return false;
+    seconds = (int64_t)hour * 3600 + min * 60 + sec;
+    return true;
+}
+
+namespace {
+
+enum MySQLColumnKind {
+    COLUMN_INT64,
+    COLUMN_UINT64,
+    COLUMN_FLOAT64,
+    COLUMN_DATE,
+    COLUMN_DATETIME,
+    COLUMN_TIME,
+    COLUMN_BYTES,
+};
+
+struct MySQLColumnBuffer {
+    MySQLColumnKind kind;
+    std::vector<int64_t> ints;   // int64, uint64 bits, days, or microseconds
+    std::vector<double> doubles;
+    std::vector<int64_t> offsets;
+    std::vector<char> data;
+    std::vector<uint8_t> nulls;
+    std::vector<uint8_t> validity; // bit i is set if row i is not null, lsb first
+};
+
+}
+
+static MySQLColumnKind mysql_column_kind(const protocol::MySQLField *field) {
+    switch(field->get_data_type()) {
+    case MYSQL_TYPE_TINY:
+    case MYSQL_TYPE_SHORT:
+    case MYSQL_TYPE_INT24:
+    case MYSQL_TYPE_LONG:
+    case MYSQL_TYPE_YEAR:
+        return COLUMN_INT64;
+    case MYSQL_TYPE_LONGLONG:
+        if(field->get_flags() & MYSQL_FIELD_UNSIGNED) return COLUMN_UINT64;
+        return COLUMN_INT64;
+    case MYSQL_TYPE_FLOAT:
+    case MYSQL_TYPE_DOUBLE:
+        return COLUMN_FLOAT64;
+    case MYSQL_TYPE_DATE:
+    case MYSQL_TYPE_NEWDATE:
+        return COLUMN_DATE;
+    case MYSQL_TYPE_DATETIME:
+    case MYSQL_TYPE_DATETIME2:
+    case MYSQL_TYPE_TIMESTAMP:
+    case MYSQL_TYPE_TIMESTAMP2:
+        return COLUMN_DATETIME;
+    case MYSQL_TYPE_TIME:
+    case MYSQL_TYPE_TIME2:
+        return COLUMN_TIME;
+    default:
+        return COLUMN_BYTES;
+    }
+}
+
+/**
+ * Return false if the cell can not be decoded as kind, such as an integer out
+ * of range or a zero date, nothing is appended then.
+ */
+static bool mysql_decode_cell(MySQLColumnBuffer &col, const char *p, size_t n) {
+    switch(col.kind) {
+    case COLUMN_INT64:
+    {
+        int64_t v;
+        if(!mysql_parse_int(p, n, v)) return false;
+        col.ints.push_back(v);
+        return true;
+    }
+    case COLUMN_UINT64:
+    {
+        uint64_t v;
+        if(!mysql_parse_uint(p, n, v)) return false;
+        col.ints.push_back((int64_t)v);
+        return true;
+    }
+    case COLUMN_FLOAT64:
+    {
+        double v;
+        if(!mysql_parse_double(p, n, v)) return false;
+        col.doubles.push_back(v);
+        return true;
+    }
+    case COLUMN_DATE:
+    {
+        int y, m, d;
+        if(!mysql_parse_date(p, n, y, m, d)) return false;
+        col.ints.push_back(mysql_days_from_civil(y, m, d));
+        return true;
+    }
+    case COLUMN_DATETIME:
+    {
+        int y, m, d, hh, mm, ss, us;
+        if(!mysql_parse_datetime(p, n, y, m, d, hh, mm, ss, us)) return false;
+        int64_t secs = mysql_days_from_civil(y, m, d) * 86400 + hh * 3600 + mm * 60 + ss;
+        col.ints.push_back(secs * 1000000 + us);
+        return true;
+    }
+    case COLUMN_TIME:
+    {
+        bool neg;
+        int64_t secs;
+        int us;
+        if(!mysql_parse_time(p, n, neg, secs, us)) return false;
+        int64_t v = secs * 1000000 + us;
+        col.ints.push_back(neg ? -v : v);
+        return true;
+    }
+    default:
+        col.data.insert(col.data.end(), p, p + n);
+        col.offsets.push_back((int64_t)col.data.size());
+        return true;
+    }
+}
+
+static void mysql_decode_null(MySQLColumnBuffer &col) {
+    switch(col.kind) {
+    case COLUMN_FLOAT64:
+        col.doubles.push_back(0.0);
+        break;
+    case COLUMN_DATE:
+    case COLUMN_DATETIME:
+    case COLUMN_TIME:
+        col.ints.push_back(std::numeric_limits<int64_t>::min());
+        break;
+    case COLUMN_BYTES:
+        col.offsets.push_back((int64_t)col.data.size());
+        break;
+    default:
+        col.ints.push_back(0);
+        break;
+    }
+}
+
+// The array owns the vector, no copy is made
+template<typename T>
+static py::array mysql_column_array(std::vector<T> &&vec, const py::dtype &dtype) {
+    auto *p = new std::vector<T>(std::move(vec));
+    py::capsule base(p, [](void *v) { delete static_cast<std::vector<T> *>(v); });
+    return py::array(dtype, {p->size()}, {sizeof (T)}, p->data(), base);
+}
+
+/**
+ * Decode column i of the row major cells. If any value can not be decoded as
+ * kind, the whole column is decoded again as bytes, so no value is lost.
+ */
+static void mysql_decode_column(MySQLColumnBuffer &col, MySQLColumnKind kind,
+    const std::vector<protocol::MySQLCell> &cells, int i, int field_count, size_t rows) {
+    col.kind = kind;
+    col.nulls.reserve(rows);
+    col.validity.reserve((rows + 7) / 8);
+    if(kind == COLUMN_FLOAT64)
+        col.doubles.reserve(rows);
+    else if(kind == COLUMN_BYTES) {
+        col.offsets.reserve(rows + 1);
+        col.offsets.push_back(0);
+    }
+    else
+        col.ints.reserve(rows);
+
+    for(size_t r = 0; r < rows; r++) {
+        const void *data = nullptr;
+        size_t len = 0;
+        int type = MYSQL_TYPE_NULL;
+        cells[r * field_count + i].get_cell_nocopy(&data, &len, &type);
+        bool null = type == MYSQL_TYPE_NULL;
+        if(null)
+            mysql_decode_null(col);
+        else if(!mysql_decode_cell(col, static_cast<const char *>(data), len)) {
+            col = MySQLColumnBuffer();
+            mysql_decode_column(col, COLUMN_BYTES, cells, i, field_count, rows);
+            return;
+        }
+        col.nulls.push_back(null ? 1 : 0);
+        if(r % 8 == 0) col.validity.push_back(0);
+        if(!null) col.validity.back() |= (uint8_t)(1 << (r % 8));
+    }
+}
+
+py::list PyMySQLResultCursor::fetch_columns() {
+    int field_count = csr.get_field_count();
+    const protocol::MySQLField * const *fields = csr.fetch_fields();
+    std::vector<MySQLColumnBuffer> cols(field_count);
+    size_t rows = 0;
+
+    {
+        py::gil_scoped_release release;
+        // Cells refer to the response, collect them first so a column can
+        // be decoded again
+        size_t hint = (size_t)std::max(csr.get_rows_count(), 0);
+        std::vector<protocol::MySQLCell> cells;
+        std::vector<protocol::MySQLCell> row;
+        cells.reserve(hint * field_count);
+        while(true) {
+            row.clear();
+            if(!csr.fetch_row(row)) break;
+            row.resize(field_count);
+            for(auto &cell : row) cells.emplace_back(std::move(cell));
+            rows++;
+        }
+
+        for(int i = 0; i < field_count; i++)
+            mysql_decode_column(cols[i], mysql_column_kind(fields[i]), cells, i, field_count, rows);
+    }
+
+    py::list result(field_count);
+    for(int i = 0; i < field_count; i++) {
+        MySQLColumnBuffer &col = cols[i];
+        PyMySQLColumn column;
+        const std::string &name = fields[i]->get_name();
+        column.name = py::reinterpret_steal<py::str>(
+            PyUnicode_DecodeUTF8(name.data(), name.size(), "replace"));
+        column.data_type = fields[i]->get_data_type();
+        column.rows = rows;
+        column.values = py::none();
+        column.offsets = py::none();
+        column.data = py::none();
+
+        switch(col.kind) {
+        case COLUMN_INT64:
+            column.values = mysql_column_array(std::move(col.ints), py::dtype::of<int64_t>());
+            break;
+        case COLUMN_UINT64:
+            column.values = mysql_column_array(std::move(col.ints), py::dtype::of<uint64_t>());
+            break;
+        case COLUMN_FLOAT64:
+            column.values = mysql_column_array(std::move(col.doubles), py::dtype::of<double>());
+            break;
+        case COLUMN_DATE:
+            column.values = mysql_column_array(std::move(col.ints),
+                py::dtype::from_args(py::str("datetime64[D]")));
+            break;
+        case COLUMN_DATETIME:
+            column.values = mysql_column_array(std::move(col.ints),
+                py::dtype::from_args(py::str("datetime64[us]")));
+            break;
+        case COLUMN_TIME:
+            column.values = mysql_column_array(std::move(col.ints),
+                py::dtype::from_args(py::str("timedelta64[us]")));
+            break;
+        default:
+            column.offsets = mysql_column_array(std::move(col.offsets), py::dtype::of<int64_t>());
+            column.data = mysql_column_array(std::move(col.data), py::dtype::of<uint8_t>());
+            break;
+        }
+        column.nulls = mysql_column_array(std::move(col.nulls), py::dtype::of<bool>());
+        column.validity = mysql_column_array(std::move(col.validity), py::dtype::of<uint8_t>());
+        result[i] = py::cast(std::move(column));
+    }
+    return result;
+}
+
+// Same as the binary collation number of mysql, blobs with it are not text
+static const int MYSQL_BINARY_CHARSETNR = 63;
+
+MySQLRowDecoder::MySQLRowDecoder(const protocol::MySQLField * const *fields, int field_count,
+    const char *encoding, const char *errors) {
+    columns.resize(field_count);
+    names.reserve(field_count);
+    for(int i = 0; i < field_count; i++) {
+        columns[i].data_type = fields[i]->get_data_type();
+        columns[i].is_unsigned = (fields[i]->get_flags() & MYSQL_FIELD_UNSIGNED) != 0;
+        columns[i].is_binary = fields[i]->get_charsetnr() == MYSQL_BINARY_CHARSETNR;
+
+        const std::string &name = fields[i]->get_name();
+        PyObject *obj = PyUnicode_DecodeUTF8(name.data(), name.size(), "replace");
+        if(obj == nullptr) throw py::error_already_set();
+        PyUnicode_InternInPlace(&obj);
+        names.push_back(py::reinterpret_steal<py::object>(obj));
+    }
+
+    if(encoding) {
+        this->encoding = encoding;
+        this->errors = errors ? errors : "strict";
+        decode_text = true;
+    }
+}
+
+PyObject *MySQLRowDecoder::decode_cell(int i, const protocol::MySQLCell &cell) {
+    const void *data;
+    size_t len;
+    int type;
+    cell.get_cell_nocopy(&data, &len, &type);
+    if(type == MYSQL_TYPE_NULL) Py_RETURN_NONE;
+
+    const char *p = static_cast<const char *>(data);
+    const Column &col = columns[i];
+    switch(col.data_type) {
+    case MYSQL_TYPE_TINY:
+    case MYSQL_TYPE_SHORT:
+    case MYSQL_TYPE_INT24:
+    case MYSQL_TYPE_LONG:
+    case MYSQL_TYPE_YEAR:
+    case MYSQL_TYPE_LONGLONG:
+        if(col.is_unsigned) {
+            uint64_t v;
+            if(mysql_parse_uint(p, len, v)) return PyLong_FromUnsignedLongLong(v);
+        }
+        else {
+            int64_t v;
+            if(mysql_parse_int(p, len, v)) return PyLong_FromLongLong(v);
+        }
+        break;
+    case MYSQL_TYPE_FLOAT:
+    case MYSQL_TYPE_DOUBLE:
+    {
+        double v;
+        if(mysql_parse_double(p, len, v)) return PyFloat_FromDouble(v);
+        break;
+    }
+    case MYSQL_TYPE_DATE:
+    case MYSQL_TYPE_NEWDATE:
+    {
+        int y, m, d;
+        // Zero dates can not be represented by python, they are bytes
+        if(!mysql_parse_date(p, len, y, m, d) || y < 1) break;
+        return PyDate_FromDate(y, m, d);
+    }
+    case MYSQL_TYPE_DATETIME:
+    case MYSQL_TYPE_DATETIME2:
+    case MYSQL_TYPE_TIMESTAMP:
+    case MYSQL_TYPE_TIMESTAMP2:
+    {
+        int y, m, d, hh, mm, ss, us;
+        if(!mysql_parse_datetime(p, len, y, m, d, hh, mm, ss, us) || y < 1) break;
+        return PyDateTime_FromDateAndTime(y, m, d, hh, mm, ss, us);
+    }
+    case MYSQL_TYPE_TIME:
+    case MYSQL_TYPE_TIME2:
+    {
+        bool neg;
+        int64_t secs;
+        int us;
+        if(!mysql_parse_time(p, len, neg, secs, us)) break;
+        if(neg) return PyDelta_FromDSU(0, (int)-secs, -us);
+        return PyDelta_FromDSU(0, (int)secs, us);
+    }
+    case MYSQL_TYPE_BIT:
+    case MYSQL_TYPE_GEOMETRY:
+        break;
+    default:
+        if(decode_text && !col.is_binary)
+            return PyUnicode_Decode(p, len, encoding.c_str(), errors.c_str());
+        break;
+    }
+    return PyBytes_FromStringAndSize(p, len);
+}
+
+PyObject *MySQLRowDecoder::decode(protocol::MySQLResultCursor &csr, bool as_dict) {
+    cells.clear();
+    if(!csr.fetch_row(cells)) return nullptr;
+
+    size_t n = columns.size();
+    PyObject *row = as_dict ? PyDict_New() : PyTuple_New(n);
+    if(row == nullptr) return nullptr;
+    for(size_t i = 0; i < n; i++) {
+        PyObject *v;
+        if(i < cells.size())
+            v = decode_cell((int)i, cells[i]);
+        else {
+            v = Py_None;
+            Py_INCREF(v);
+        }
+
+        if(v == nullptr) {
+            Py_DECREF(row);
+            return nullptr;
+        }
+
+        if(as_dict) {
+            int ret = PyDict_SetItem(row, names[i].ptr(), v);
+            Py_DECREF(v);
+            if(ret < 0) {
+                Py_DECREF(row);
+                return nullptr;
+            }
+        }
+        else
+            PyTuple_SET_ITEM(row, i, v);
+    }
+    return row;
+}
+
+MySQLRowDecoder PyMySQLResultCursor::create_decoder(py::object encoding,
+    const std::string &errors) {
+    std::string enc;
+    if(!encoding.is_none()) enc = encoding.cast<std::string>();
+    return MySQLRowDecoder(csr.fetch_fields(), csr.get_field_count(),
+        encoding.is_none() ? nullptr : enc.c_str(), errors.c_str());
+}
+
+py::list PyMySQLResultCursor::fetch_all_rows(bool as_dict, py::object encoding,
+    const std::string &errors) {
+    MySQLRowDecoder decoder = create_decoder(encoding, errors);
+    py::list all;
+    while(true) {
+        PyObject *row = decoder.decode(csr, as_dict);
+        if(row == nullptr) {
+            if(PyErr_Occurred()) throw py::error_already_set();
+            break;
+        }
+        int ret = PyList_Append(all.ptr(), row);
+        Py_DECREF(row);
+        if(ret < 0) throw py::error_already_set();
+    }
+    return all;
+}
+
+PyMySQLRowIterator::PyMySQLRowIterator(py::object cursor, size_t batch_size, bool as_dict,
+    py::object encoding, const std::string &errors)
+    : cursor(cursor), csr(cursor.cast<PyMySQLResultCursor *>()),
+      batch_size(batch_size ? batch_size : 1), as_dict(as_dict) {
+    decoder = csr->create_decoder(encoding, errors);
+}
+
+py::object PyMySQLRowIterator::__next__() {
+    if(pos >= batch.size()) {
+        if(finished) throw py::stop_iteration();
+
+        py::list next;
+        while(next.size() < batch_size) {
+            PyObject *row = decoder.decode(csr->get_cursor(), as_dict);
+            if(row == nullptr) {
+                if(PyErr_Occurred()) throw py::error_already_set();
+                finished = true;
+                break;
+            }
+            int ret = PyList_Append(next.ptr(), row);
+            Py_DECREF(row);
+            if(ret < 0) throw py::error_already_set();
+        }
+
+        batch = next;
+        pos = 0;
+        if(batch.size() == 0) throw py::stop_iteration();
+    }
+
+    py::object row = batch[pos];
+    pos++;
+    return row;
+}
+
+// Escaped byte by byte, only for charsets accepted by mysql_escape_safe
+static void mysql_append_quoted(std::string &out, const char *p, size_t n) {
+    out.reserve(out.size() + n + n / 8 + 2);
+    out.push_back('\'');
+    for(size_t i = 0; i < n; i++) {
+        char c = p[i];
+        switch(c) {
+        case '\0':   out.append("\\0", 2);  break;
+        case '\n':   out.append("\\n", 2);  break;
+        case '\r':   out.append("\\r", 2);  break;
+        case '\\':   out.append("\\\\", 2); break;
+        case '\'':   out.append("\\'", 2);  break;
+        case '"':    out.append("\\\"", 2); break;
+        case '\032': out.append("\\Z", 2);  break;
+        default:     out.push_back(c);      break;
+        }
+    }
+    out.push_back('\'');
+}
+
+static void mysql_append_time(std::string &out, int hour, int min, int sec, int usec) {
+    char buf[32];
+    int n = usec ? snprintf(buf, sizeof buf, "%02d:%02d:%02d.%06d", hour, min, sec, usec)
+                 : snprintf(buf, sizeof buf, "%02d:%02d:%02d", hour, min, sec);
+    out.append(buf, n);
+}
+
+// decimal.Decimal is imported at the first use, which is under gil
+static bool mysql_is_decimal(PyObject *obj) {
+    static PyObject *decimal_type = nullptr;
+    if(decimal_type == nullptr)
+        decimal_type = py::module_::import("decimal").attr("Decimal").release().ptr();
+
+    int ret = PyObject_IsInstance(obj, decimal_type);
+    if(ret < 0) throw py::error_already_set();
+    return ret != 0;
+}
+
+/**
+ * Append obj as a sql literal if quote is true, otherwise as a text protocol
+ * value, which is not quoted or escaped. Return false for null.
+ */
+static bool mysql_append_text(std::string &out, PyObject *obj, bool quote) {
+    if(obj == Py_None) {
+        return false;
+    }
+    else if(PyBool_Check(obj)) {
+        out.push_back(obj == Py_True ? '1' : '0');
+    }
+    else if(PyLong_Check(obj)) {
+        int overflow;
+        long long v = PyLong_AsLongLongAndOverflow(obj, &overflow);
+        if(overflow == 0) {
+            if(v == -1 && PyErr_Occurred()) throw py::error_already_set();
+            out.append(std::to_string(v));
+        }
+        else
+            out.append(py::str(obj).cast<std::string>());
+    }
+    else if(PyFloat_Check(obj)) {
+        double d = PyFloat_AS_DOUBLE(obj);
+        if(!std::isfinite(d)) {
+            if(quote) throw py::value_error("mysql does not support inf or nan");
+            return false;
+        }
+        char *str = PyOS_double_to_string(d, 'r', 0, 0, nullptr);
+        if(str == nullptr) throw py::error_already_set();
+        out.append(str);
+        PyMem_Free(str);
+    }
+    else if(PyUnicode_Check(obj)) {
+        Py_ssize_t n;
+        const char *p = PyUnicode_AsUTF8AndSize(obj, &n);
+        if(p == nullptr) throw py::error_already_set();
+        if(quote) mysql_append_quoted(out, p, n);
+        else out.append(p, n);
+    }
+    else if(PyBytes_Check(obj)) {
+        if(quote) mysql_append_quoted(out, PyBytes_AS_STRING(obj), PyBytes_GET_SIZE(obj));
+        else out.append(PyBytes_AS_STRING(obj), PyBytes_GET_SIZE(obj));
+    }
+    else if(PyDateTime_Check(obj)) {
+        // Check before date, datetime is a subclass of date
+        char buf[32];
+        int n = snprintf(buf, sizeof buf, "'%04d-%02d-%02d ", PyDateTime_GET_YEAR(obj),
+            PyDateTime_GET_MONTH(obj), PyDateTime_GET_DAY(obj));
+        out.append(buf + !quote, n - !quote);
+        mysql_append_time(out, PyDateTime_DATE_GET_HOUR(obj), PyDateTime_DATE_GET_MINUTE(obj),
+            PyDateTime_DATE_GET_SECOND(obj), PyDateTime_DATE_GET_MICROSECOND(obj));
+        if(quote) out.push_back('\'');
+    }
+    else if(PyDate_Check(obj)) {
+        char buf[32];
+        int n = snprintf(buf, sizeof buf, "'%04d-%02d-%02d'", PyDateTime_GET_YEAR(obj),
+            PyDateTime_GET_MONTH(obj), PyDateTime_GET_DAY(obj));
+        out.append(buf + !quote, n - 2 * !quote);
+    }
+    else if(PyTime_Check(obj)) {
+        if(quote) out.push_back('\'');
+        mysql_append_time(out, PyDateTime_TIME_GET_HOUR(obj), PyDateTime_TIME_GET_MINUTE(obj),
+            PyDateTime_TIME_GET_SECOND(obj), PyDateTime_TIME_GET_MICROSECOND(obj));
+        if(quote) out.push_back('\'');
+    }
+    else if(PyDelta_Check(obj)) {
+        int64_t us = ((int64_t)PyDateTime_DELTA_GET_DAYS(obj) * 86400 +
+            PyDateTime_DELTA_GET_SECONDS(obj)) * 1000000 + PyDateTime_DELTA_GET_MICROSECONDS(obj);
+        if(quote) out.push_back('\'');
+        if(us < 0) {
+            out.push_back('-');
+            us = -us;
+        }
+        int64_t secs = us / 1000000;
+        out.append(std::to_string(secs / 3600));
+        char buf[32];
+        int n = snprintf(buf, sizeof buf, ":%02d:%02d", (int)(secs / 60 % 60), (int)(secs % 60));
+        out.append(buf, n);
+        if(us % 1000000) {
+            n = snprintf(buf, sizeof buf, ".%06d", (int)(us % 1000000));
+            out.append(buf, n);
+        }
+        if(quote) out.push_back('\'');
+    }
+    else if(PyObject_HasAttrString(obj, "item")) {
+        // Scalars of numpy, they also have buffers but are not bytes
+        py::object item = py::reinterpret_borrow<py::object>(obj).attr("item")();
+        if(item.ptr() == obj) throw py::type_error("unsupported mysql value type");
+        return mysql_append_text(out, item.ptr(), quote);
+    }
+    else if(PyObject_CheckBuffer(obj)) {
+        Py_buffer view;
+        if(PyObject_GetBuffer(obj, &view, PyBUF_SIMPLE) < 0) throw py::error_already_set();
+        if(quote) mysql_append_quoted(out, static_cast<const char *>(view.buf), view.len);
+        else out.append(static_cast<const char *>(view.buf), view.len);
+        PyBuffer_Release(&view);
+    }
+    else if(mysql_is_decimal(obj)) {
+        std::string str = py::str(obj).cast<std::string>();
+        if(str.find_first_not_of("0123456789+-.eE") != std::string::npos)
+            throw py::value_error("mysql does not support " + str);
+        out.append(str);
+    }
+    else {
+        throw py::type_error(std::string("unsupported mysql value type ") +
+            Py_TYPE(obj)->tp_name);
+    }
+    return true;
+}
+
+void mysql_append_value(std::string &out, PyObject *obj) {
+    if(!mysql_append_text(out, obj, true))
+        out.append("NULL", 4);
+}
+
+// Multibyte charsets whose trailing bytes may be a quote or backslash
+static const char *const mysql_unsafe_charsets[] = {
+    "big5", "cp932", "gb18030", "gbk", "sjis",
+};
+
+bool mysql_escape_safe(const std::string &url) {
+    ParsedURI uri;
+    if(URIParser::parse(url, uri) < 0 || uri.query == nullptr) return true;
+
+    std::string query(uri.query);
+    size_t pos = 0;
+    while(pos <= query.size()) {
+        size_t end = query.find('&', pos);
+        if(end == std::string::npos) end = query.size();
+        std::string param = query.substr(pos, end - pos);
+        pos = end + 1;
+
+        size_t eq = param.find('=');
+        if(eq == std::string::npos) continue;
+        std::string key = param.substr(0, eq);
+        if(key != "character_set" && key != "character_set_results") continue;
+
+        std::string value = param.substr(eq + 1);
+        for(auto &c : value) c = (char)tolower((unsigned char)c);
+        for(const char *cs : mysql_unsafe_charsets) {
+            if(value == cs) return false;
+        }
+    }
+    return true;
+}
+
+void mysql_check_escape_safe(bool safe) {
+    if(!safe) {
+        throw py::value_error("params can not be escaped safely in the character set of url, "
+            "use utf8mb4 or another ascii compatible one");
+    }
+}
+
+MySQLStatement::MySQLStatement(const std::string &sql) : sql(sql) {
+    size_t n = sql.size();
+    size_t start = 0;
+    size_t i = 0;
+    while(i < n) {
+        char c = sql[i];
+        if(c == '\'' || c == '"' || c == '`') {
+            // Quotes are escaped by doubling, or by backslash except in identifiers
+            i++;
+            while(i < n) {
+                if(sql[i] == '\\' && c != '`')
+                    i += 2;
+                else if(sql[i] == c && i + 1 < n && sql[i + 1] == c)
+                    i += 2;
+                else if(sql[i] == c)
+                    break;
+                else
+                    i++;
+            }
+            i++;
+        }
+        else if(c == '#' || (c == '-' && i + 2 < n && sql[i + 1] == '-' && isspace((unsigned char)sql[i + 2]))) {
+            i = sql.find('\n', i);
+            if(i == std::string::npos) i = n;
+        }
+        else if(c == '/' && i + 1 < n && sql[i + 1] == '*') {
+            i = sql.find("*/", i + 2);
+            i = (i == std::string::npos) ? n : i + 2;
+        }
+        else if(c == '?') {
+            fragments.push_back(sql.substr(start, i - start));
+            start = ++i;
+        }
+        else
+            i++;
+    }
+    fragments.push_back(sql.substr(start));
+}
+
+std::string MySQLStatement::format(py::sequence params) const {
+    size_t count = get_param_count();
+    if((size_t)py::len(params) != count) {
+        throw py::value_error("statement needs " + std::to_string(count) +
+            " params, but " + std::to_string(py::len(params)) + " given");
+    }
+
+    std::string out;
+    out.reserve(sql.size() + count * 16);
+    for(size_t i = 0; i < count; i++) {
+        out.append(fragments[i]);
+        py::object param = params[i];
+        mysql_append_value(out, param.ptr());
+    }
+    out.append(fragments.back());
+    return out;
+}
+
+// Pooled connections use ids from here, so they never share with user ids
+static std::atomic<int> mysql_pool_conn_id(0x40000000);
+
+// Server status flag of mysql, set if a transaction is active
+static const int MYSQL_SERVER_STATUS_IN_TRANS = 1;
+
+/**
+ * A connection is reusable if no transaction is left after the last result
+ * set. An ERR packet has no server status, and the statements after it are
+ * not executed, so the transaction state is unknown after any error.
+ */
+static bool mysql_conn_reusable(protocol::MySQLResponse *resp) {
+    protocol::MySQLResultCursor cursor(resp);
+    int status;
+    do {
+        if(cursor.get_cursor_status() == MYSQL_STATUS_ERROR) return false;
+        status = cursor.get_server_status();
+    } while(cursor.next_result_set());
+    return (status & MYSQL_SERVER_STATUS_IN_TRANS) == 0;
+}
+
+void MySQLPoolWaiter::dispatch() {
+    pool->acquire(this);
+}
+
+void MySQLPoolLease::release(bool reusable) {
+    if(slot) {
+        MySQLPoolSlot *s = slot;
+        slot = nullptr;
+        pool->release(s, reusable);
+    }
+}
+
+void MySQLPoolLease::rollback_and_release() {
+    if(!slot) return;
+
+    MySQLPoolSlot *s = slot;
+    std::shared_ptr<MySQLPool> p = pool;
+    slot = nullptr;
+    WFMySQLTask *task = s->conn->create_query_task("ROLLBACK", [p, s](WFMySQLTask *t) {
+        bool reusable = t->get_state() == WFT_STATE_SUCCESS && mysql_conn_reusable(t->get_resp());
+        p->release(s, reusable);
+    });
+    task->start();
+}
+
+bool MySQLPoolLease::is_escape_safe() const {
+    return pool->is_escape_safe();
+}
+
+void MySQLPoolTask::on_acquired(MySQLPoolSlot *slot, int state, int error) {
+    if(state != WFT_STATE_SUCCESS) {
+        this->state = state;
+        this->error = error;
+        this->subtask_done();
+        return;
+    }
+
+    WFMySQLTask *task = slot->conn->create_query_task(query, [this, slot](WFMySQLTask *t) {
+        this->state = t->get_state();
+        this->error = t->get_error();
+        this->resp = std::move(*t->get_resp());
+
+        // A connection left in a transaction must not be used by others
+        bool reusable = this->state == WFT_STATE_SUCCESS && mysql_conn_reusable(&this->resp);
+        this->pool->release(slot, reusable);
+        this->subtask_done();
+    });
+    task->start();
+}
+
+void MySQLPoolCheckoutTask::on_acquired(MySQLPoolSlot *slot, int state, int error) {
+    if(state == WFT_STATE_SUCCESS)
+        lease = std::make_shared<MySQLPoolLease>(pool, slot);
+    this->state = state;
+    this->error = error;
+    this->subtask_done();
+}
+
+MySQLPool::MySQLPool(const std::string &url, size_t min_size, size_t max_size,
+    int idle_timeout, int ping_interval)
+    : url(url), escape_safe(mysql_escape_safe(url)), min_size(min_size),
+      max_size(max_size ? max_size : 1),
+      idle_timeout_us((int64_t)idle_timeout * 1000), ping_interval_us((int64_t)ping_interval * 1000) {
+    ParsedURI uri;
+    if(URIParser::parse(url, uri) < 0 || uri.state != URI_STATE_SUCCESS)
+        throw std::invalid_argument("invalid mysql url");
+}
+
+MySQLPool::~MySQLPool() {
+    // Busy slots keep the pool alive, so only idle ones are left
+    for(MySQLPoolSlot *slot : idle) {
+        disconnect(slot);
+        delete slot;
+    }
+}
+
+int64_t MySQLPool::now_us() {
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+WFMySQLConnection *MySQLPool::new_connection() {
+    auto *conn = new WFMySQLConnection(mysql_pool_conn_id++);
+    conn->init(url);
+    return conn;
+}
+
+void MySQLPool::disconnect(MySQLPoolSlot *slot) {
+    WFMySQLTask *task = slot->conn->create_disconnect_task(nullptr);
+    task->start();
+    slot->conn->deinit();
+    slot->conn.reset();
+}
+
+void MySQLPool::reconnect(MySQLPoolSlot *slot) {
+    disconnect(slot);
+    slot->conn.reset(new_connection());
+    slot->last_used = 0;
+}
+
+void MySQLPool::reap_locked(int64_t now, std::vector<MySQLPoolSlot *> &closing) {
+    if(idle_timeout_us <= 0) return;
+    size_t n = 0;
+    while(n < idle.size() && total - n > min_size && now - idle[n]->last_used > idle_timeout_us)
+        n++;
+
+    if(n > 0) {
+        closing.assign(idle.begin(), idle.begin() + n);
+        idle.erase(idle.begin(), idle.begin() + n);
+        total -= n;
+        stats.reaped += n;
+    }
+}
+
+void MySQLPool::acquire(MySQLPoolWaiter *waiter) {
+    std::vector<MySQLPoolSlot *> closing;
+    MySQLPoolSlot *slot = nullptr;
+    bool create = false;
+    int64_t now = now_us();
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        stats.checkouts++;
+        reap_locked(now, closing);
+        if(!idle.empty()) {
+            slot = idle.back();
+            idle.pop_back();
+        }
+        else if(total < max_size) {
+            total++;
+            create = true;
+        }
+        else {
+            waiters.emplace_back(waiter, now);
+            stats.waits++;
+            stats.max_waiting = std::max(stats.max_waiting, waiters.size());
+        }
+    }
+
+    for(MySQLPoolSlot *s : closing) {
+        disconnect(s);
+        delete s;
+    }
+
+    if(create) {
+        slot = new MySQLPoolSlot;
+        slot->conn.reset(new_connection());
+    }
+
+    if(slot) hand_out(waiter, slot);
+}
+
+void MySQLPool::hand_out(MySQLPoolWaiter *waiter, MySQLPoolSlot *slot) {
+    int64_t now = now_us();
+    if(ping_interval_us <= 0 || slot->last_used == 0 || now - slot->last_used <= ping_interval_us) {
+        waiter->on_acquired(slot, WFT_STATE_SUCCESS, 0);
+        return;
+    }
+
+    // Idle for a long time, the server may have closed it
+    std::shared_ptr<MySQLPool> self = shared_from_this();
+    WFMySQLTask *ping = slot->conn->create_query_task("SELECT 1",
+        [self, waiter, slot](WFMySQLTask *t) {
+        bool ok = t->get_state() == WFT_STATE_SUCCESS && !t->get_resp()->is_error_packet();
+        {
+            std::lock_guard<std::mutex> lk(self->mtx);
+            self->stats.pings++;
+            if(!ok) self->stats.ping_failures++;
+        }
+        if(ok)
+            slot->last_used = now_us();
+        else
+            self->reconnect(slot);
+        waiter->on_acquired(slot, WFT_STATE_SUCCESS, 0);
+    });
+    ping->start();
+}
+
+void MySQLPool::release(MySQLPoolSlot *slot, bool reusable) {
+    std::vector<MySQLPoolSlot *> closing;
+    MySQLPoolWaiter *waiter = nullptr;
+    if(!reusable) {
+        reconnect(slot);
+        std::lock_guard<std::mutex> lk(mtx);
+        stats.discarded++;
+    }
+
+    int64_t now = now_us();
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        if(reusable) slot->last_used = now;
+        if(!waiters.empty()) {
+            waiter = waiters.front().first;
+            int64_t wait_us = now - waiters.front().second;
+            waiters.pop_front();
+            stats.wait_us_total += wait_us;
+            stats.wait_us_max = std::max(stats.wait_us_max, wait_us);
+        }
+        else {
+            idle.push_back(slot);
+            reap_locked(now, closing);
+        }
+    }
+
+    for(MySQLPoolSlot *s : closing) {
+        disconnect(s);
+        delete s;
+    }
+
+    if(waiter) hand_out(waiter, slot);
+}
+
+void MySQLPool::close_idle() {
+    std::vector<MySQLPoolSlot *> closing;
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        closing.swap(idle);
+        total -= closing.size();
+    }
+
+    for(MySQLPoolSlot *s : closing) {
+        disconnect(s);
+        delete s;
+    }
+}
+
+MySQLPoolStats MySQLPool::get_stats() {
+    std::lock_guard<std::mutex> lk(mtx);
+    MySQLPoolStats st = stats;
+    st.size = total;
+    st.idle = idle.size();
+    st.waiting = waiters.size();
+    return st;
+}
+
+py::dict PyMySQLPool::get_stats() {
+    MySQLPoolStats st = pool->get_stats();
+    py::dict d;
+    d["size"] = st.size;
+    d["idle"] = st.idle;
+    d["busy"] = st.size - st.idle;
+    d["waiting"] = st.waiting;
+    d["max_waiting"] = st.max_waiting;
+    d["checkouts"] = st.checkouts;
+    d["waits"] = st.waits;
+    d["wait_ms_total"] = st.wait_us_total / 1000.0;
+    d["wait_ms_max"] = st.wait_us_max / 1000.0;
+    d["pings"] = st.pings;
+    d["ping_failures"] = st.ping_failures;
+    d["reaped"] = st.reaped;
+    d["discarded"] = st.discarded;
+    return d;
+}
+
+static void mysql_append_identifier(std::string &out, const std::string &name) {
+    out.push_back('`');
+    for(char c : name) {
+        if(c == '`') out.push_back('`');
+        out.push_back(c);
+    }
+    out.push_back('`');
+}
+
+namespace {
+
+// One column of add_columns, numeric buffers are read directly
+class MySQLValueColumn {
+public:
+    MySQLValueColumn(py::object obj, bool quote) : obj(obj), quote(quote) {
+        PyObject *p = obj.ptr();
+        if(PyBytes_Check(p) || PyByteArray_Check(p) || PyUnicode_Check(p) ||
+            !PyObject_CheckBuffer(p))
+            return;
+
+        if(PyObject_GetBuffer(p, &view, PyBUF_RECORDS_RO) < 0) {
+            PyErr_Clear();
+            return;
+        }
+
+        // Standard sizes are used with '=' and '<', which is in native byte
+        // order only on little endian hosts
+        const char *f = view.format ? view.format : "B";
+        bool native = true;
+        if(*f == '@')
+            f++;
+        else if(*f == '=' || (*f == '<' && little_endian())) {
+            native = false;
+            f++;
+        }
+        if(view.ndim == 1 && f[0] && !f[1] && strchr("bBhHiIlLqQfd?", f[0]) &&
+            view.itemsize == item_size(f[0], native)) {
+            format = f[0];
+            // Load long as int or long long of the same size
+            if(format == 'l') format = view.itemsize == sizeof (int) ? 'i' : 'q';
+            if(format == 'L') format = view.itemsize == sizeof (int) ? 'I' : 'Q';
+            is_buffer = true;
+        }
+        else
+            PyBuffer_Release(&view);
+    }
+    MySQLValueColumn(const MySQLValueColumn&) = delete;
+    MySQLValueColumn& operator=(const MySQLValueColumn&) = delete;
+    ~MySQLValueColumn() {
+        if(is_buffer) PyBuffer_Release(&view);
+    }
+
+    size_t size() const { return is_buffer ? (size_t)view.shape[0] : py::len(obj); }
+
+    // Same as mysql_append_text
+    bool append(std::string &out, size_t i) const {
+        if(!is_buffer) {
+            PyObject *item = PySequence_GetItem(obj.ptr(), i);
+            if(item == nullptr) throw py::error_already_set();
+            py::object holder = py::reinterpret_steal<py::object>(item);
+            return mysql_append_text(out, item, quote);
+        }
+
+        const char *p = static_cast<const char *>(view.buf) + i * view.strides[0];
+        switch(format) {
+        case 'b': out.append(std::to_string(load<int8_t>(p)));   break;
+        case 'B': out.append(std::to_string(load<uint8_t>(p)));  break;
+        case 'h': out.append(std::to_string(load<int16_t>(p)));  break;
+        case 'H': out.append(std::to_string(load<uint16_t>(p))); break;
+        case 'i': out.append(std::to_string(load<int>(p)));      break;
+        case 'I': out.append(std::to_string(load<unsigned>(p))); break;
+        case 'q': out.append(std::to_string(load<long long>(p)));          break;
+        case 'Q': out.append(std::to_string(load<unsigned long long>(p))); break;
+        case '?': out.push_back(load<bool>(p) ? '1' : '0');      break;
+        default:
+        {
+            double d = format == 'f' ? load<float>(p) : load<double>(p);
+            if(!std::isfinite(d)) {
+                if(quote) throw py::value_error("mysql does not support inf or nan");
+                return false;
+            }
+            char *str = PyOS_double_to_string(d, 'r', 0, 0, nullptr);
+            if(str == nullptr) throw py::error_already_set();
+            out.append(str);
+            PyMem_Free(str);
+        }
+        }
+        return true;
+    }
+
+private:
+    static bool little_endian() {
+        const uint16_t one = 1;
+        return *reinterpret_cast<const uint8_t *>(&one) == 1;
+    }
+
+    // Item size of a struct format character, other sizes are rejected
+    static Py_ssize_t item_size(char c, bool native) {
+        switch(c) {
+        case 'b': case 'B': return 1;
+        case 'h': case 'H': return native ? sizeof (short) : 2;
+        case 'i': case 'I': return native ? sizeof (int) : 4;
+        case 'l': case 'L': return native ? sizeof (long) : 4;
+        case 'q': case 'Q': return native ? sizeof (long long) : 8;
+        case 'f': return native ? sizeof (float) : 4;
+        case 'd': return native ? sizeof (double) : 8;
+        default:  return native ? sizeof (bool) : 1;
+        }
+    }
+
+    template<typename T>
+    static T load(const char *p) {
+        T v;
+        memcpy(&v, p, sizeof (T));
+        return v;
+    }
+
+    py::object obj;
+    bool quote;
+    Py_buffer view;
+    bool is_buffer{false};
+    char format{0};
+};
+
+}
+
+MySQLBatch::MySQLBatch(const std::string &table, const std::vector<std::string> &columns,
+    size_t max_packet, const std::string &command, const std::string &suffix)
+    : suffix(suffix), column_count(columns.size()), max_packet(max_packet) {
+    if(columns.empty()) throw py::value_error("columns is empty");
+
+    header = command;
+    header.push_back(' ');
+    // db.table is quoted as `db`.`table`
+    size_t start = 0;
+    while(true) {
+        size_t dot = table.find('.', start);
+        mysql_append_identifier(header, table.substr(start, dot - start));
+        if(dot == std::string::npos) break;
+        header.push_back('.');
+        start = dot + 1;
+    }
+
+    header.append(" (");
+    for(size_t i = 0; i < columns.size(); i++) {
+        if(i) header.push_back(',');
+        mysql_append_identifier(header, columns[i]);
+    }
+    header.append(") VALUES ");
+}
+
+void MySQLBatch::append_tuple(const std::string &tuple) {
+    // The packet of COM_QUERY has one command byte before the statement
+    size_t limit = max_packet > 0 ? max_packet - 1 : 0;
+    if(header.size() + tuple.size() + suffix.size() > limit)
+        throw py::value_error("row is larger than max_packet");
+
+    if(!current.empty() && current.size() + 1 + tuple.size() + suffix.size() > limit) {
+        current.append(suffix);
+        statements.push_back(std::move(current));
+        current.clear();
+    }
+
+    if(current.empty()) {
+        current.reserve(std::min(max_packet, (size_t)64 * 1024));
+        current.append(header);
+    }
+    else
+        current.push_back(',');
+    current.append(tuple);
+    rows++;
+}
+
+void MySQLBatch::add_row(py::sequence row) {
+    if((size_t)py::len(row) != column_count) {
+        throw py::value_error("row needs " + std::to_string(column_count) +
+            " values, but " + std::to_string(py::len(row)) + " given");
+    }
+
+    std::string tuple;
+    tuple.push_back('(');
+    for(size_t i = 0; i < column_count; i++) {
+        if(i) tuple.push_back(',');
+        py::object v = row[i];
+        mysql_append_value(tuple, v.ptr());
+    }
+    tuple.push_back(')');
+    append_tuple(tuple);
+}
+
+void MySQLBatch::add_rows(py::iterable rows) {
+    for(py::handle row : rows)
+        add_row(py::reinterpret_borrow<py::sequence>(row));
+}
+
+void MySQLBatch::add_columns(py::sequence columns) {
+    if((size_t)py::len(columns) != column_count) {
+        throw py::value_error("need " + std::to_string(column_count) +
+            " columns, but " + std::to_string(py::len(columns)) + " given");
+    }
+
+    std::vector<std::unique_ptr<MySQLValueColumn>> cols;
+    for(size_t i = 0; i < column_count; i++) {
+        py::object col = columns[i];
+        cols.emplace_back(new MySQLValueColumn(col, true));
+        if(cols[i]->size() != cols[0]->size())
+            throw py::value_error("columns have different lengths");
+    }
+
+    size_t n = cols[0]->size();
+    std::string tuple;
+    for(size_t r = 0; r < n; r++) {
+        tuple.clear();
+        tuple.push_back('(');
+        for(size_t i = 0; i < column_count; i++) {
+            if(i) tuple.push_back(',');
+            if(!cols[i]->append(tuple, r)) tuple.append("NULL", 4);
+        }
+        tuple.push_back(')');
+        append_tuple(tuple);
+    }
+}
+
+void MySQLBatch::clear() {
+    statements.clear();
+    current.clear();
+    rows = 0;
+}
+
+std::vector<std::string> MySQLBatch::get_statements() const {
+    std::vector<std::string> all(statements);
+    if(!current.empty()) all.push_back(current + suffix);
+    return all;
+}
+
+py::list MySQLBatch::py_get_statements() const {
+    py::list lst;
+    for(const auto &stmt : get_statements())
+        lst.append(py::bytes(stmt));
+    return lst;
+}
+
+MySQLBatchTask::MySQLBatchTask(const std::string &url, std::vector<std::string> &&statements,
+    bool atomic, callback_t &&cb)
+    : url(url), atomic(atomic), callback(std::move(cb)) {
+    if(atomic) queries.emplace_back("BEGIN");
+    for(auto &stmt : statements) queries.push_back(std::move(stmt));
+    if(atomic) queries.emplace_back("COMMIT");
+}
+
+unsigned long long MySQLBatchTask::get_affected_rows() const {
+    unsigned long long n = 0;
+    for(const auto &r : results) n += r.affected_rows;
+    return n;
+}
+
+void MySQLBatchTask::dispatch() {
+    conn.reset(new WFMySQLConnection(mysql_pool_conn_id++));
+    if(queries.empty() || conn->init(url) < 0) {
+        this->state = queries.empty() ? WFT_STATE_SUCCESS : WFT_STATE_SYS_ERROR;
+        this->error = queries.empty() ? 0 : errno;
+        conn.reset();
+        this->subtask_done();
+        return;
+    }
+
+    create_step()->start();
+}
+
+WFMySQLTask *MySQLBatchTask::create_step() {
+    return conn->create_query_task(queries[step], [this](WFMySQLTask *t) {
+        this->on_step(t);
+    });
+}
+
+void MySQLBatchTask::on_step(WFMySQLTask *task) {
+    protocol::MySQLResponse *resp = task->get_resp();
+    int state = task->get_state();
+    bool ok = state == WFT_STATE_SUCCESS && !resp->is_error_packet();
+    bool is_data = !atomic || (step > 0 && step + 1 < queries.size());
+
+    if(is_data) {
+        MySQLBatchResult r;
+        if(state == WFT_STATE_SUCCESS) {
+            r.affected_rows = resp->get_affected_rows();
+            r.insert_id = resp->get_last_insert_id();
+            r.error_code = resp->get_error_code();
+            if(resp->is_error_packet()) r.error_msg = resp->get_error_msg();
+        }
+        results.push_back(std::move(r));
+    }
+
+    if(!ok) {
+        failed = true;
+        fail_state = state == WFT_STATE_SUCCESS ? WFT_STATE_TASK_ERROR : state;
+        fail_error = state == WFT_STATE_SUCCESS ? resp->get_error_code() : task->get_error();
+    }
+
+    SeriesWork *series = series_of(task);
+    step++;
+    if(!failed && step < queries.size()) {
+        series->push_back(create_step());
+        return;
+    }
+
+    // BEGIN is done but COMMIT is not
+    if(failed && atomic && step > 1 && step < queries.size() && state == WFT_STATE_SUCCESS)
+        series->push_back(conn->create_query_task("ROLLBACK", nullptr));
+    finish(series);
+}
+
+void MySQLBatchTask::finish(SeriesWork *series) {
+    WFMySQLTask *task = conn->create_disconnect_task([this](WFMySQLTask *) {
+        conn->deinit();
+        conn.reset();
+        this->state = failed ? fail_state : WFT_STATE_SUCCESS;
+        this->error = failed ? fail_error : 0;
+        this->subtask_done();
+    });
+    series->push_back(task);
+}
+
+PyWFMySQLBatchTask mysql_batch_create_task(const MySQLBatch &batch, const std::string &url,
+    PyWFMySQLBatchTask::_py_callback_t cb, bool atomic) {
+    mysql_check_escape_safe(mysql_escape_safe(url));
+    PyWFMySQLBatchTask t(new MySQLBatchTask(url, batch.get_statements(), atomic, nullptr));
+    t.set_callback(std::move(cb));
+    return t;
+}
+
+static const size_t MYSQL_PAYLOAD_LIMIT = 0xffffff;
+static const int MYSQL_FIELD_BINARY = 128;
+static const int MYSQL_UTF8MB4_CHARSETNR = 45;
+static const int MYSQL_SERVER_STATUS_AUTOCOMMIT = 2;
+
+static void mysql_append_int(std::string &out, uint64_t v, int bytes) {
+    for(int i = 0; i < bytes; i++)
+        out.push_back((char)(v >> (8 * i)));
+}
+
+static void mysql_append_lenenc(std::string &out, uint64_t v) {
+    if(v < 251) {
+        out.push_back((char)v);
+    }
+    else if(v < 0x10000) {
+        out.push_back('\xfc');
+        mysql_append_int(out, v, 2);
+    }
+    else if(v < 0x1000000) {
+        out.push_back('\xfd');
+        mysql_append_int(out, v, 3);
+    }
+    else {
+        out.push_back('\xfe');
+        mysql_append_int(out, v, 8);
+    }
+}
+
+static void mysql_append_lenenc_str(std::string &out, const std::string &str) {
+    mysql_append_lenenc(out, str.size());
+    out.append(str);
+}
+
+// Reserve the header of a packet, the sequence id is filled when it is sent
+static size_t mysql_begin_packet(std::string &out) {
+    out.append(4, '\0');
+    return out.size() - 4;
+}
+
+static void mysql_end_packet(std::string &out, size_t pos) {
+    size_t len = out.size() - pos - 4;
+    if(len < MYSQL_PAYLOAD_LIMIT) {
+        out[pos]     = (char)len;
+        out[pos + 1] = (char)(len >> 8);
+        out[pos + 2] = (char)(len >> 16);
+        return;
+    }
+
+    // A large payload is split, and ends with a packet shorter than the limit
+    std::string payload = out.substr(pos + 4);
+    out.resize(pos);
+    size_t off = 0;
+    while(true) {
+        size_t n = std::min(payload.size() - off, MYSQL_PAYLOAD_LIMIT);
+        mysql_append_int(out, n, 3);
+        out.push_back('\0');
+        out.append(payload, off, n);
+        off += n;
+        if(n < MYSQL_PAYLOAD_LIMIT) break;
+    }
+}
+
+static void mysql_append_eof(std::string &out) {
+    size_t pos = mysql_begin_packet(out);
+    out.push_back('\xfe');
+    mysql_append_int(out, 0, 2);
+    mysql_append_int(out, MYSQL_SERVER_STATUS_AUTOCOMMIT, 2);
+    mysql_end_packet(out, pos);
+}
+
+// The value of a cell is appended after a placeholder byte at pos
+static void mysql_end_cell(std::string &out, size_t pos, bool not_null) {
+    if(!not_null) {
+        out[pos] = '\xfb';
+        return;
+    }
+
+    size_t len = out.size() - pos - 1;
+    if(len < 251) {
+        out[pos] = (char)len;
+        return;
+    }
+
+    std::string prefix;
+    mysql_append_lenenc(prefix, len);
+    out[pos] = prefix[0];
+    out.insert(pos + 1, prefix, 1, std::string::npos);
+}
+
+static void mysql_append_field(std::string &out, const std::string &table,
+    const std::string &name, int data_type, int flags) {
+    int charsetnr = MYSQL_BINARY_CHARSETNR;
+    uint32_t length;
+    int decimals = 0;
+
+    switch(data_type) {
+    case MYSQL_TYPE_TINY:       length = 4;   break;
+    case MYSQL_TYPE_SHORT:      length = 6;   break;
+    case MYSQL_TYPE_INT24:      length = 9;   break;
+    case MYSQL_TYPE_LONG:       length = 11;  break;
+    case MYSQL_TYPE_LONGLONG:   length = 20;  break;
+    case MYSQL_TYPE_YEAR:       length = 4;   break;
+    case MYSQL_TYPE_DECIMAL:
+    case MYSQL_TYPE_NEWDECIMAL: length = 66;  break;
+    case MYSQL_TYPE_FLOAT:      length = 12;  decimals = 31; break;
+    case MYSQL_TYPE_DOUBLE:     length = 22;  decimals = 31; break;
+    case MYSQL_TYPE_DATE:
+    case MYSQL_TYPE_NEWDATE:    length = 10;  break;
+    case MYSQL_TYPE_TIME:       length = 17;  decimals = 6;  break;
+    case MYSQL_TYPE_DATETIME:
+    case MYSQL_TYPE_TIMESTAMP:  length = 26;  decimals = 6;  break;
+    default:
+        length = 0xffffff;
+        if(!(flags & MYSQL_FIELD_BINARY)) charsetnr = MYSQL_UTF8MB4_CHARSETNR;
+        break;
+    }
+    if(charsetnr == MYSQL_BINARY_CHARSETNR) flags |= MYSQL_FIELD_BINARY;
+
+    size_t pos = mysql_begin_packet(out);
+    mysql_append_lenenc_str(out, "def");    // catalog
+    mysql_append_lenenc(out, 0);            // schema
+    mysql_append_lenenc_str(out, table);    // table
+    mysql_append_lenenc_str(out, table);    // org_table
+    mysql_append_lenenc_str(out, name);     // name
+    mysql_append_lenenc_str(out, name);     // org_name
+    out.push_back('\x0c');
+    mysql_append_int(out, charsetnr, 2);
+    mysql_append_int(out, length, 4);
+    out.push_back((char)data_type);
+    mysql_append_int(out, flags, 2);
+    out.push_back((char)decimals);
+    out.append(2, '\0');
+    mysql_end_packet(out, pos);
+}
+
+MySQLResultSet::MySQLResultSet(py::sequence fields, const std::string &table)
+    : field_count(py::len(fields)) {
+    if(field_count == 0) throw py::value_error("fields is empty");
+
+    size_t pos = mysql_begin_packet(packets);
+    mysql_append_lenenc(packets, field_count);
+    mysql_end_packet(packets, pos);
+
+    for(size_t i = 0; i < field_count; i++) {
+        py::object field = fields[i];
+        std::string name;
+        int data_type = MYSQL_TYPE_VAR_STRING;
+        int flags = 0;
+
+        if(py::isinstance<py::str>(field) || py::isinstance<py::bytes>(field)) {
+            name = field.cast<std::string>();
+        }
+        else {
+            py::sequence seq = field.cast<py::sequence>();
+            size_t n = py::len(seq);
+            if(n < 2 || n > 3)
+                throw py::value_error("field should be name or (name, data_type[, flags])");
+            name = py::object(seq[0]).cast<std::string>();
+            data_type = py::object(seq[1]).cast<int>();
+            if(n == 3) flags = py::object(seq[2]).cast<int>();
+        }
+        mysql_append_field(packets, table, name, data_type, flags);
+    }
+
+    mysql_append_eof(packets);
+    header_size = packets.size();
+}
+
+void MySQLResultSet::add_row(py::sequence row) {
+    if((size_t)py::len(row) != field_count) {
+        throw py::value_error("row needs " + std::to_string(field_count) +
+            " values, but " + std::to_string(py::len(row)) + " given");
+    }
+
+    size_t pos = mysql_begin_packet(packets);
+    try {
+        for(size_t i = 0; i < field_count; i++) {
+            py::object v = row[i];
+            size_t cell = packets.size();
+            packets.push_back('\0');
+            mysql_end_cell(packets, cell, mysql_append_text(packets, v.ptr(), false));
+        }
+    }
+    catch(...) {
+        packets.resize(pos);
+        throw;
+    }
+    mysql_end_packet(packets, pos);
+    rows++;
+}
+
+void MySQLResultSet::add_rows(py::iterable rows) {
+    for(py::handle row : rows)
+        add_row(py::reinterpret_borrow<py::sequence>(row));
+}
+
+void MySQLResultSet::add_columns(py::sequence columns) {
+    if((size_t)py::len(columns) != field_count) {
+        throw py::value_error("need " + std::to_string(field_count) +
+            " columns, but " + std::to_string(py::len(columns)) + " given");
+    }
+
+    std::vector<std::unique_ptr<MySQLValueColumn>> cols;
+    for(size_t i = 0; i < field_count; i++) {
+        py::object col = columns[i];
+        cols.emplace_back(new MySQLValueColumn(col, false));
+        if(cols[i]->size() != cols[0]->size())
+            throw py::value_error("columns have different lengths");
+    }
+
+    size_t n = cols[0]->size();
+    for(size_t r = 0; r < n; r++) {
+        size_t pos = mysql_begin_packet(packets);
+        try {
+            for(size_t i = 0; i < field_count; i++) {
+                size_t cell = packets.size();
+                packets.push_back('\0');
+                mysql_end_cell(packets, cell, cols[i]->append(packets, r));
+            }
+        }
+        catch(...) {
+            packets.resize(pos);
+            throw;
+        }
+        mysql_end_packet(packets, pos);
+        rows++;
+    }
+}
+
+void MySQLResultSet::clear() {
+    packets.resize(header_size);
+    rows = 0;
+}
+
+std::string MySQLResultSet::get_packets() const {
+    std::string all;
+    all.reserve(packets.size() + 9);
+    all.append(packets);
+    mysql_append_eof(all);
+    return all;
+}
+
+/**
+ * A command starts a new sequence from 0, and takes one more packet for each
+ * full payload, so the reply continues from the number of request packets.
+ */
+CommMessageOut *MySQLServerTask::message_out() {
+    size_t payload = 1 + this->req.get_query().size();
+    uint8_t seqid = (uint8_t)(payload / MYSQL_PAYLOAD_LIMIT + 1);
+    if(!has_result) {
+        this->resp.set_seqid(seqid);
+        return this->WFServerTask::message_out();
+    }
+
+    std::string &packets = result.packets;
+    size_t pos = 0;
+    while(pos + 4 <= packets.size()) {
+        size_t len = (uint8_t)packets[pos] | (size_t)(uint8_t)packets[pos + 1] << 8 |
+            (size_t)(uint8_t)packets[pos + 2] << 16;
+        packets[pos + 3] = (char)seqid++;
+        pos += 4 + len;
+    }
+    return &result;
+}
+
+int MySQLServerTask::ResultSetOut::encode(struct iovec vectors[], int max) {
+    vectors[0].iov_base = const_cast<char *>(packets.data());
+    vectors[0].iov_len = packets.size();
+    return 1;
+}
+
+CommSession *MySQLServerImpl::new_session(long long seq, CommConnection *conn) {
+    using factory = WFNetworkTaskFactory<protocol::MySQLRequest, protocol::MySQLResponse>;
+    WFMySQLTask *task;
+    // The first session is the handshake response, the task of workflow answers it
+    if(seq == 0)
+        task = factory::create_server_task(this, this->process);
+    else
+        task = new MySQLServerTask(this, this->process);
+    task->set_keep_alive(this->params.keep_alive_timeout);
+    task->set_receive_timeout(this->params.receive_timeout);
+    task->get_req()->set_size_limit(this->params.request_size_limit);
+    return task;
+}
+
+static void mysql_task_set_result_set(PyWFMySQLTask &task, const MySQLResultSet &result) {
+    MySQLServerTask *p = dynamic_cast<MySQLServerTask *>(task.get());
+    if(p == nullptr) throw py::type_error("set_result_set is only for command tasks of MySQLServer");
+    p->set_result_set(result.get_packets());
+}
+
 PyWFMySQLTask create_mysql_task(const std::string &url, int retry_max, py_mysql_callback_t cb) {
     WFMySQLTask *ptr = WFTaskFactory::create_mysql_task(url, retry_max, nullptr);
     PyWFMySQLTask t(ptr);
@@ -143,6 +1873,22 @@ void init_mysql_types(py::module_ &wf) {
         .def("get_data_type", &PyMySQLField::get_data_type)
     ;
 
+    py::class_<PyMySQLColumn>(wf, "MySQLColumn")
+        .def_readonly("name",      &PyMySQLColumn::name)
+        .def_readonly("data_type", &PyMySQLColumn::data_type)
+        .def_readonly("values",    &PyMySQLColumn::values)
+        .def_readonly("offsets",   &PyMySQLColumn::offsets)
+        .def_readonly("data",      &PyMySQLColumn::data)
+        .def_readonly("nulls",     &PyMySQLColumn::nulls)
+        .def_readonly("validity",  &PyMySQLColumn::validity)
+        .def("__len__",            &PyMySQLColumn::__len__)
+    ;
+
+    py::class_<PyMySQLRowIterator>(wf, "MySQLRowBatchIterator")
+        .def("__iter__", [](py::object self) { return self; })
+        .def("__next__", &PyMySQLRowIterator::__next__)
+    ;
+
     py::class_<PyMySQLResultCursor>(wf, "MySQLResultCursor")
         .def(py::init<PyMySQLResponse&>())
         .def("next_result_set",   &PyMySQLResultCursor::next_result_set)
@@ -150,6 +1896,17 @@ void init_mysql_types(py::module_ &wf) {
         .def("fetch_fields",      &PyMySQLResultCursor::fetch_fields)
         .def("fetch_row",         &PyMySQLResultCursor::fetch_row)
         .def("fetch_all",         &PyMySQLResultCursor::fetch_all)
+        .def("fetch_columns",     &PyMySQLResultCursor::fetch_columns)
+        .def("fetch_all_tuples",  &PyMySQLResultCursor::fetch_all_tuples,
+                                   py::arg("encoding") = py::none(), py::arg("errors") = "strict")
+        .def("fetch_all_dicts",   &PyMySQLResultCursor::fetch_all_dicts,
+                                   py::arg("encoding") = py::none(), py::arg("errors") = "strict")
+        .def("iter_rows",         [](py::object self, size_t batch_size, bool as_dict,
+                                      py::object encoding, const std::string &errors) {
+                                       return PyMySQLRowIterator(self, batch_size, as_dict,
+                                           encoding, errors);
+                                   }, py::arg("batch_size") = 1024, py::arg("as_dict") = false,
+                                   py::arg("encoding") = py::none(), py::arg("errors") = "strict")
         .def("get_cursor_status", &PyMySQLResultCursor::get_cursor_status)
         .def("get_server_status", &PyMySQLResultCursor::get_server_status)
         .def("get_field_count",   &PyMySQLResultCursor::get_field_count)
@@ -179,16 +1936,116 @@ void init_mysql_types(py::module_ &wf) {
         .def("set_callback",        &PyWFMySQLTask::set_callback)
         .def("set_user_data",       &PyWFMySQLTask::set_user_data)
         .def("get_user_data",       &PyWFMySQLTask::get_user_data)
+        .def("set_result_set",      &mysql_task_set_result_set, py::arg("result_set"))
+    ;
+
+    py::class_<MySQLStatement, std::shared_ptr<MySQLStatement>>(wf, "MySQLStatement")
+        .def(py::init<const std::string &>(), py::arg("sql"))
+        .def("get_sql",         &MySQLStatement::get_sql)
+        .def("get_param_count", &MySQLStatement::get_param_count)
+        .def("format",          &MySQLStatement::py_format, py::arg("params"))
     ;
 
     py::class_<PyWFMySQLConnection>(wf, "MySQLConnection")
         .def(py::init<int>())
         .def("init",                   &PyWFMySQLConnection::init)
         .def("deinit",                 &PyWFMySQLConnection::deinit)
+        .def("prepare",                &PyWFMySQLConnection::prepare, py::arg("sql"))
         .def("create_query_task",      &PyWFMySQLConnection::create_query_task)
+        .def("create_execute_task",    &PyWFMySQLConnection::create_execute_task,
+                                        py::arg("statement"), py::arg("params"), py::arg("callback"))
         .def("create_disconnect_task", &PyWFMySQLConnection::create_disconnect_task)
     ;
 
+    py::class_<PyMySQLPooledConnection>(wf, "MySQLPooledConnection")
+        .def("create_query_task",   &PyMySQLPooledConnection::create_query_task,
+                                     py::arg("query"), py::arg("callback"))
+        .def("create_execute_task", &PyMySQLPooledConnection::create_execute_task,
+                                     py::arg("statement"), py::arg("params"), py::arg("callback"))
+        .def("is_released",         &PyMySQLPooledConnection::is_released)
+        .def("release",             &PyMySQLPooledConnection::release)
+        .def("close",               &PyMySQLPooledConnection::close)
+    ;
+
+    py::class_<PyWFMySQLPoolTask, PySubTask>(wf, "MySQLPoolTask")
+        .def("is_null",       &PyWFMySQLPoolTask::is_null)
+        .def("start",         &PyWFMySQLPoolTask::start)
+        .def("dismiss",       &PyWFMySQLPoolTask::dismiss)
+        .def("get_query",     &PyWFMySQLPoolTask::get_query)
+        .def("get_resp",      &PyWFMySQLPoolTask::get_resp)
+        .def("get_state",     &PyWFMySQLPoolTask::get_state)
+        .def("get_error",     &PyWFMySQLPoolTask::get_error)
+        .def("set_callback",  &PyWFMySQLPoolTask::set_callback)
+        .def("set_user_data", &PyWFMySQLPoolTask::set_user_data)
+        .def("get_user_data", &PyWFMySQLPoolTask::get_user_data)
+    ;
+
+    py::class_<PyWFMySQLCheckoutTask, PySubTask>(wf, "MySQLCheckoutTask")
+        .def("is_null",        &PyWFMySQLCheckoutTask::is_null)
+        .def("start",          &PyWFMySQLCheckoutTask::start)
+        .def("dismiss",        &PyWFMySQLCheckoutTask::dismiss)
+        .def("get_state",      &PyWFMySQLCheckoutTask::get_state)
+        .def("get_error",      &PyWFMySQLCheckoutTask::get_error)
+        .def("get_connection", &PyWFMySQLCheckoutTask::get_connection)
+        .def("set_callback",   &PyWFMySQLCheckoutTask::set_callback)
+        .def("set_user_data",  &PyWFMySQLCheckoutTask::set_user_data)
+        .def("get_user_data",  &PyWFMySQLCheckoutTask::get_user_data)
+    ;
+
+    py::class_<PyMySQLPool>(wf, "MySQLPool")
+        .def(py::init<const std::string &, size_t, size_t, int, int>(), py::arg("url"),
+             py::arg("min_size") = 0, py::arg("max_size") = 16, py::arg("idle_timeout") = 60 * 1000,
+             py::arg("ping_interval") = 30 * 1000)
+        .def("create_query_task",    &PyMySQLPool::create_query_task, py::arg("query"),
+                                      py::arg("callback"))
+        .def("create_execute_task",  &PyMySQLPool::create_execute_task, py::arg("statement"),
+                                      py::arg("params"), py::arg("callback"))
+        .def("create_checkout_task", &PyMySQLPool::create_checkout_task, py::arg("callback"))
+        .def("close_idle",           &PyMySQLPool::close_idle)
+        .def("get_stats",            &PyMySQLPool::get_stats)
+    ;
+
+    py::class_<MySQLBatch>(wf, "MySQLBatch")
+        .def(py::init<const std::string &, const std::vector<std::string> &, size_t,
+                      const std::string &, const std::string &>(),
+             py::arg("table"), py::arg("columns"), py::arg("max_packet") = 4 * 1024 * 1024,
+             py::arg("command") = "INSERT INTO", py::arg("suffix") = "")
+        .def("add_row",        &MySQLBatch::add_row, py::arg("row"))
+        .def("add_rows",       &MySQLBatch::add_rows, py::arg("rows"))
+        .def("add_columns",    &MySQLBatch::add_columns, py::arg("columns"))
+        .def("clear",          &MySQLBatch::clear)
+        .def("get_row_count",  &MySQLBatch::get_row_count)
+        .def("get_statements", &MySQLBatch::py_get_statements)
+        .def("create_task",    &mysql_batch_create_task, py::arg("url"), py::arg("callback"),
+                                py::arg("atomic") = false)
+    ;
+
+    py::class_<PyWFMySQLBatchTask, PySubTask>(wf, "MySQLBatchTask")
+        .def("is_null",           &PyWFMySQLBatchTask::is_null)
+        .def("start",             &PyWFMySQLBatchTask::start)
+        .def("dismiss",           &PyWFMySQLBatchTask::dismiss)
+        .def("get_state",         &PyWFMySQLBatchTask::get_state)
+        .def("get_error",         &PyWFMySQLBatchTask::get_error)
+        .def("get_affected_rows", &PyWFMySQLBatchTask::get_affected_rows)
+        .def("get_results",       &PyWFMySQLBatchTask::get_results)
+        .def("set_callback",      &PyWFMySQLBatchTask::set_callback)
+        .def("set_user_data",     &PyWFMySQLBatchTask::set_user_data)
+        .def("get_user_data",     &PyWFMySQLBatchTask::get_user_data)
+    ;
+
+    py::class_<MySQLResultSet>(wf, "MySQLResultSet")
+        .def(py::init<py::sequence, const std::string &>(), py::arg("fields"),
+             py::arg("table") = std::string())
+        .def("add_row",         &MySQLResultSet::add_row, py::arg("row"))
+        .def("add_rows",        &MySQLResultSet::add_rows, py::arg("rows"))
+        .def("add_columns",     &MySQLResultSet::add_columns, py::arg("columns"))
+        .def("clear",           &MySQLResultSet::clear)
+        .def("get_field_count", &MySQLResultSet::get_field_count)
+        .def("get_row_count",   &MySQLResultSet::get_row_count)
+        .def("get_size",        &MySQLResultSet::get_size)
+        .def("__len__",         &MySQLResultSet::get_row_count)
+    ;
+
     py::class_<PyWFMySQLServer>(wf, "MySQLServer")
         .def(py::init<py_mysql_process_t>())
         .def(py::init<WFServerParams, py_mysql_process_t>())
@@ -196,6 +2053,8 @@ void init_mysql_types(py::module_ &wf) {
                              py::arg("key_file") = std::string())
         .def("start",       &PyWFMySQLServer::start_2, py::arg("family"), py::arg("host"), py::arg("port"),
                              py::arg("cert_file") = std::string(), py::arg("key_file") = std::string())
+        .def("start_unix",  &PyWFMySQLServer::start_unix, py::arg("path"),
+                             py::arg("cert_file") = std::string(), py::arg("key_file") = std::string())
         .def("shutdown",    &PyWFMySQLServer::shutdown, py::call_guard<py::gil_scoped_release>())
         .def("wait_finish", &PyWFMySQLServer::wait_finish, py::call_guard<py::gil_scoped_release>())
         .def("stop",        &PyWFMySQLServer::stop, py::call_guard<py::gil_scoped_release>())
@@ -5,7 +5,14 @@
 #include "workflow/MySQLMessage.h"
 #include "workflow/MySQLResult.h"
 #include "workflow/WFMySQLConnection.h"
+#include "workflow/WFGlobal.h"
+#include "workflow/WFServer.h"
 #include <datetime.h>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <unordered_map>
 
 class PyMySQLCell {
 public:
@@ -251,6 +258,56 @@ public:
     size_t get_size_limit() const     { return this->get()->get_size_limit(); }
 };
 
+/**
+ * Decoded values of one column, see PyMySQLResultCursor::fetch_columns.
+ * Numbers and temporal types are in values, other types are in offsets and
+ * data. nulls is a bool mask of null cells, and validity is the same in an
+ * lsb ordered bitmap of valid cells, as the validity buffer of Arrow.
+ */
+class PyMySQLColumn {
+public:
+    py::str name;
+    int data_type{MYSQL_TYPE_NULL};
+    py::object values;
+    py::object offsets;
+    py::object data;
+    py::object nulls;
+    py::object validity;
+    size_t rows{0};
+
+    size_t __len__() const { return rows; }
+};
+
+/**
+ * Convert cells of a result set to python objects by field types, field
+ * names are interned once for dict rows.
+ */
+class MySQLRowDecoder {
+public:
+    MySQLRowDecoder() {}
+    MySQLRowDecoder(const protocol::MySQLField * const *fields, int field_count,
+        const char *encoding, const char *errors);
+
+    // Return a new reference, or nullptr with python error set
+    PyObject *decode(protocol::MySQLResultCursor &csr, bool as_dict);
+
+private:
+    PyObject *decode_cell(int i, const protocol::MySQLCell &cell);
+
+    struct Column {
+        int data_type;
+        bool is_unsigned;
+        bool is_binary;
+    };
+
+    std::vector<Column> columns;
+    std::vector<py::object> names;
+    std::vector<protocol::MySQLCell> cells;
+    std::string encoding;
+    std::string errors;
+    bool decode_text{false};
+};
+
 class PyMySQLResultCursor {
 public:
     using OriginType = protocol::MySQLResultCursor;
@@ -293,6 +350,19 @@ public:
         return all;
     }
 
+    // Decode the rest rows of current result set to one contiguous array per column
+    py::list fetch_columns();
+
+    py::list fetch_all_tuples(py::object encoding, const std::string &errors) {
+        return fetch_all_rows(false, encoding, errors);
+    }
+    py::list fetch_all_dicts(py::object encoding, const std::string &errors) {
+        return fetch_all_rows(true, encoding, errors);
+    }
+    py::list fetch_all_rows(bool as_dict, py::object encoding, const std::string &errors);
+    MySQLRowDecoder create_decoder(py::object encoding, const std::string &errors);
+    OriginType &get_cursor() { return csr; }
+
     int get_cursor_status() const { return csr.get_cursor_status(); }
     int get_server_status() const { return csr.get_server_status(); }
 
@@ -310,8 +380,135 @@ private:
     OriginType csr;
 };
 
+/**
+ * Iterate rows of a cursor, rows are decoded batch_size at a time so python
+ * objects of the whole result set never exist at once.
+ */
+class PyMySQLRowIterator {
+public:
+    PyMySQLRowIterator(py::object cursor, size_t batch_size, bool as_dict,
+        py::object encoding, const std::string &errors);
+
+    py::object __next__();
+
+private:
+    py::object cursor;
+    PyMySQLResultCursor *csr;
+    MySQLRowDecoder decoder;
+    size_t batch_size;
+    bool as_dict;
+    py::list batch;
+    size_t pos{0};
+    bool finished{false};
+};
+
+/**
+ * Append obj to out as a sql literal, strings are quoted and escaped byte by
+ * byte, which is the same as mysql_real_escape_string only for charsets such
+ * as utf8mb4 and latin1. Throw if the type is not supported.
+ */
+void mysql_append_value(std::string &out, PyObject *obj);
+
+/**
+ * Return false if the character_set of url is big5, gbk, gb18030, sjis or
+ * cp932, a trailing byte of their characters may be \ or ', so the escaped
+ * params may end a string early.
+ */
+bool mysql_escape_safe(const std::string &url);
+// Throw ValueError if not safe
+void mysql_check_escape_safe(bool safe);
+
+/**
+ * MySQLStatement splits sql at ? placeholders once, then each execution only
+ * escapes the params and joins the pieces. Placeholders in quoted strings,
+ * quoted identifiers and comments are ignored.
+ */
+class MySQLStatement {
+public:
+    explicit MySQLStatement(const std::string &sql);
+
+    const std::string &get_sql() const { return sql; }
+    size_t get_param_count() const     { return fragments.size() - 1; }
+    std::string format(py::sequence params) const;
+    py::bytes py_format(py::sequence params) const { return format(params); }
+
+private:
+    std::string sql;
+    std::vector<std::string> fragments;
+};
+
+/**
+ * MySQLResultSet encodes a text protocol result set in C++, the column
+ * definitions when created and each row when added, so that a MySQLServer
+ * process replies rows without building any packet in python.
+ */
+class MySQLResultSet {
+public:
+    // Each field is a name, or a tuple of (name, data_type[, flags])
+    MySQLResultSet(py::sequence fields, const std::string &table);
+
+    void add_row(py::sequence row);
+    void add_rows(py::iterable rows);
+    // Each column is a sequence, or a 1-d numeric buffer such as numpy array
+    void add_columns(py::sequence columns);
+    void clear();
+
+    size_t get_field_count() const { return field_count; }
+    size_t get_row_count() const   { return rows; }
+    size_t get_size() const        { return packets.size(); }
+
+    // All packets with the final EOF, sequence ids are filled when sent
+    std::string get_packets() const;
+
+private:
+    size_t field_count;
+    size_t header_size;
+    size_t rows{0};
+    std::string packets;
+};
+
+/**
+ * Server task of MySQLServer for commands after the handshake, it sends the
+ * packets of a result set instead of the response if set_result_set is
+ * called. The mysql server task of workflow is not public to derive from, so
+ * the handshake session still uses it, and this task numbers its replies.
+ */
+class MySQLServerTask : public WFServerTask<protocol::MySQLRequest, protocol::MySQLResponse> {
+public:
+    using ProcType = std::function<void(WFMySQLTask *)>;
+    MySQLServerTask(CommService *service, ProcType &proc)
+        : WFServerTask(service, WFGlobal::get_scheduler(), proc) {}
+
+    void set_result_set(std::string &&packets) {
+        result.packets = std::move(packets);
+        has_result = true;
+    }
+
+protected:
+    virtual CommMessageOut *message_out();
+
+private:
+    class ResultSetOut : public CommMessageOut {
+    public:
+        std::string packets;
+    private:
+        virtual int encode(struct iovec vectors[], int max);
+    };
+
+    ResultSetOut result;
+    bool has_result{false};
+};
+
+class MySQLServerImpl : public WFServer<protocol::MySQLRequest, protocol::MySQLResponse> {
+public:
+    using WFServer<protocol::MySQLRequest, protocol::MySQLResponse>::WFServer;
+
+protected:
+    virtual CommSession *new_session(long long seq, CommConnection *conn);
+};
+
 using PyWFMySQLTask       = PyWFNetworkTask<PyMySQLRequest, PyMySQLResponse>;
-using PyWFMySQLServer     = PyWFServer<PyMySQLRequest, PyMySQLResponse>;
+using PyWFMySQLServer     = PyWFServer<PyMySQLRequest, PyMySQLResponse, MySQLServerImpl>;
 using py_mysql_callback_t = std::function<void(PyWFMySQLTask)>;
 using py_mysql_process_t  = std::function<void(PyWFMySQLTask)>;
 
@@ -320,7 +517,10 @@ public:
     using OriginType = WFMySQLConnection;
     PyWFMySQLConnection(int id) : conn(id) {}
 
-    int init(const std::string &url) { return conn.init(url); }
+    int init(const std::string &url) {
+        escape_safe = mysql_escape_safe(url);
+        return conn.init(url);
+    }
     void deinit() { conn.deinit(); }
 
     PyWFMySQLTask create_query_task(const std::string &query, py_mysql_callback_t cb) {
@@ -329,6 +529,28 @@ public:
         t.set_callback(std::move(cb));
         return t;
     }
+    // Statements are cached by sql, the least recently used is dropped when full
+    std::shared_ptr<MySQLStatement> prepare(const std::string &sql) {
+        auto it = statements.find(sql);
+        if(it != statements.end()) {
+            lru.splice(lru.begin(), lru, it->second);
+            return it->second->second;
+        }
+
+        if(statements.size() >= MAX_STATEMENTS) {
+            statements.erase(lru.back().first);
+            lru.pop_back();
+        }
+        auto stmt = std::make_shared<MySQLStatement>(sql);
+        lru.emplace_front(sql, stmt);
+        statements.emplace(sql, lru.begin());
+        return stmt;
+    }
+    PyWFMySQLTask create_execute_task(const MySQLStatement &stmt, py::sequence params,
+        py_mysql_callback_t cb) {
+        mysql_check_escape_safe(escape_safe);
+        return create_query_task(stmt.format(params), std::move(cb));
+    }
     PyWFMySQLTask create_disconnect_task(py_mysql_callback_t cb) {
         WFMySQLTask *ptr = conn.create_disconnect_task(nullptr);
         PyWFMySQLTask t(ptr);
@@ -336,7 +558,457 @@ public:
         return t;
     }
 private:
+    static const size_t MAX_STATEMENTS = 1024;
+
+    using StatementList = std::list<std::pair<std::string, std::shared_ptr<MySQLStatement>>>;
+
     OriginType conn;
+    bool escape_safe{true};
+    StatementList lru;
+    std::unordered_map<std::string, StatementList::iterator> statements;
+};
+
+class MySQLPool;
+
+struct MySQLPoolSlot {
+    std::unique_ptr<WFMySQLConnection> conn;
+    int64_t last_used{0}; // microseconds of steady clock, 0 means never used
+};
+
+/**
+ * Base of tasks waiting for a connection of MySQLPool, on_acquired is called
+ * with the slot when one is assigned, or with an error state.
+ */
+class MySQLPoolWaiter : public WFGenericTask {
+public:
+    MySQLPoolWaiter(std::shared_ptr<MySQLPool> pool) : pool(std::move(pool)) {}
+
+protected:
+    virtual void dispatch();
+    virtual void on_acquired(MySQLPoolSlot *slot, int state, int error) = 0;
+
+    std::shared_ptr<MySQLPool> pool;
+    friend class MySQLPool;
+};
+
+/**
+ * A connection checked out of the pool, it goes back to the pool when
+ * released. A lease destroyed without release may be in a transaction, its
+ * connection is closed and replaced.
+ */
+class MySQLPoolLease {
+public:
+    MySQLPoolLease(std::shared_ptr<MySQLPool> pool, MySQLPoolSlot *slot)
+        : pool(std::move(pool)), slot(slot) {}
+    MySQLPoolLease(const MySQLPoolLease&) = delete;
+    MySQLPoolLease& operator=(const MySQLPoolLease&) = delete;
+    ~MySQLPoolLease() { release(false); }
+
+    // Return nullptr after released
+    WFMySQLConnection *get_connection() const { return slot ? slot->conn.get() : nullptr; }
+    bool is_escape_safe() const;
+    // Not reusable connections are closed and replaced by new ones
+    void release(bool reusable);
+    // Send ROLLBACK first, reusable if it succeeds and no transaction is left
+    void rollback_and_release();
+
+private:
+    std::shared_ptr<MySQLPool> pool;
+    MySQLPoolSlot *slot;
+};
+
+class MySQLPoolTask : public MySQLPoolWaiter {
+public:
+    using callback_t = std::function<void (MySQLPoolTask *)>;
+
+    MySQLPoolTask(std::shared_ptr<MySQLPool> pool, const std::string &query, callback_t &&cb)
+        : MySQLPoolWaiter(std::move(pool)), query(query), callback(std::move(cb)) {}
+
+    const std::string &get_query() const  { return query; }
+    protocol::MySQLResponse *get_resp()   { return &resp; }
+    void set_callback(callback_t cb)      { callback = std::move(cb); }
+
+protected:
+    virtual void on_acquired(MySQLPoolSlot *slot, int state, int error);
+    virtual SubTask *done() {
+        SeriesWork *series = series_of(this);
+        if(callback) callback(this);
+        delete this;
+        return series->pop();
+    }
+
+private:
+    std::string query;
+    protocol::MySQLResponse resp;
+    callback_t callback;
+};
+
+class MySQLPoolCheckoutTask : public MySQLPoolWaiter {
+public:
+    using callback_t = std::function<void (MySQLPoolCheckoutTask *)>;
+
+    MySQLPoolCheckoutTask(std::shared_ptr<MySQLPool> pool, callback_t &&cb)
+        : MySQLPoolWaiter(std::move(pool)), callback(std::move(cb)) {}
+    // Nobody took the connection, it is still clean
+    virtual ~MySQLPoolCheckoutTask() {
+        if(lease && lease.use_count() == 1) lease->release(true);
+    }
+
+    std::shared_ptr<MySQLPoolLease> get_lease() const { return lease; }
+    void set_callback(callback_t cb)                   { callback = std::move(cb); }
+
+protected:
+    virtual void on_acquired(MySQLPoolSlot *slot, int state, int error);
+    virtual SubTask *done() {
+        SeriesWork *series = series_of(this);
+        if(callback) callback(this);
+        delete this;
+        return series->pop();
+    }
+
+private:
+    std::shared_ptr<MySQLPoolLease> lease;
+    callback_t callback;
+};
+
+struct MySQLPoolStats {
+    size_t size{0};
+    size_t idle{0};
+    size_t waiting{0};
+    size_t max_waiting{0};
+    size_t checkouts{0};
+    size_t waits{0};
+    int64_t wait_us_total{0};
+    int64_t wait_us_max{0};
+    size_t pings{0};
+    size_t ping_failures{0};
+    size_t reaped{0};
+    size_t discarded{0};
+};
+
+/**
+ * MySQLPool keeps at most max_size connections of url, each one is a
+ * WFMySQLConnection with its own id. Idle connections are reused newest
+ * first, those idle longer than idle_timeout are closed down to min_size,
+ * and those idle longer than ping_interval are checked by a SELECT 1 before
+ * handed out. Tasks wait in fifo order when all connections are busy.
+ */
+class MySQLPool : public std::enable_shared_from_this<MySQLPool> {
+public:
+    MySQLPool(const std::string &url, size_t min_size, size_t max_size,
+        int idle_timeout, int ping_interval);
+    MySQLPool(const MySQLPool&) = delete;
+    MySQLPool& operator=(const MySQLPool&) = delete;
+    ~MySQLPool();
+
+    void acquire(MySQLPoolWaiter *waiter);
+    void release(MySQLPoolSlot *slot, bool reusable);
+    // Close all idle connections
+    void close_idle();
+    MySQLPoolStats get_stats();
+    bool is_escape_safe() const { return escape_safe; }
+
+private:
+    WFMySQLConnection *new_connection();
+    void hand_out(MySQLPoolWaiter *waiter, MySQLPoolSlot *slot);
+    void reconnect(MySQLPoolSlot *slot);
+    void reap_locked(int64_t now, std::vector<MySQLPoolSlot *> &closing);
+    static void disconnect(MySQLPoolSlot *slot);
+    static int64_t now_us();
+
+    std::string url;
+    bool escape_safe;
+    size_t min_size;
+    size_t max_size;
+    int64_t idle_timeout_us;
+    int64_t ping_interval_us;
+
+    std::mutex mtx;
+    size_t total{0};
+    std::vector<MySQLPoolSlot *> idle; // the newest at back
+    std::deque<std::pair<MySQLPoolWaiter *, int64_t>> waiters;
+    MySQLPoolStats stats;
+};
+
+class PyMySQLPooledConnection {
+public:
+    PyMySQLPooledConnection(std::shared_ptr<MySQLPoolLease> lease) : lease(std::move(lease)) {}
+
+    PyWFMySQLTask create_query_task(const std::string &query, py_mysql_callback_t cb) {
+        WFMySQLTask *ptr = connection()->create_query_task(query, nullptr);
+        PyWFMySQLTask t(ptr);
+        t.set_callback(std::move(cb));
+        return t;
+    }
+    PyWFMySQLTask create_execute_task(const MySQLStatement &stmt, py::sequence params,
+        py_mysql_callback_t cb) {
+        mysql_check_escape_safe(lease->is_escape_safe());
+        return create_query_task(stmt.format(params), std::move(cb));
+    }
+    bool is_released() const { return lease->get_connection() == nullptr; }
+    void release()            { lease->rollback_and_release(); }
+    void close()              { lease->release(false); }
+
+private:
+    WFMySQLConnection *connection() {
+        WFMySQLConnection *conn = lease->get_connection();
+        if(conn == nullptr) throw std::runtime_error("connection is released");
+        return conn;
+    }
+
+    std::shared_ptr<MySQLPoolLease> lease;
+};
+
+class PyWFMySQLPoolTask : public PySubTask {
+public:
+    using OriginType = MySQLPoolTask;
+    using _py_callback_t = std::function<void(PyWFMySQLPoolTask)>;
+    PyWFMySQLPoolTask()                           : PySubTask()  {}
+    PyWFMySQLPoolTask(OriginType *p)              : PySubTask(p) {}
+    PyWFMySQLPoolTask(const PyWFMySQLPoolTask &o) : PySubTask(o) {}
+    OriginType* get() const { return static_cast<OriginType*>(ptr); }
+    void start() {
+        assert(!series_of(this->get()));
+        CountableSeriesWork::start_series_work(this->get(), nullptr);
+    }
+    void dismiss()             { this->get()->dismiss(); }
+    py::bytes get_query() const { return this->get()->get_query(); }
+    PyMySQLResponse get_resp() { return PyMySQLResponse(this->get()->get_resp()); }
+    int get_state() const      { return this->get()->get_state(); }
+    int get_error() const      { return this->get()->get_error(); }
+    void set_user_data(py::object obj) {
+        void *old = this->get()->user_data;
+        if(old != nullptr) {
+            delete static_cast<py::object*>(old);
+        }
+        py::object *p = nullptr;
+        if(obj.is_none() == false) p = new py::object(obj);
+        this->get()->user_data = static_cast<void*>(p);
+    }
+    py::object get_user_data() const {
+        void *context = this->get()->user_data;
+        if(context == nullptr) return py::none();
+        return *static_cast<py::object*>(context);
+    }
+    void set_callback(_py_callback_t cb) {
+        auto *task = this->get();
+        void *user_data = task->user_data;
+        task->user_data = nullptr;
+        auto deleter = std::make_shared<TaskDeleterWrapper<_py_callback_t, OriginType>>(
+            std::move(cb), this->get());
+        this->get()->set_callback([deleter](OriginType *p) {
+            py_callback_wrapper(deleter->get_func(), PyWFMySQLPoolTask(p));
+        });
+        task->user_data = user_data;
+    }
+};
+
+class PyWFMySQLCheckoutTask : public PySubTask {
+public:
+    using OriginType = MySQLPoolCheckoutTask;
+    using _py_callback_t = std::function<void(PyWFMySQLCheckoutTask)>;
+    PyWFMySQLCheckoutTask()                               : PySubTask()  {}
+    PyWFMySQLCheckoutTask(OriginType *p)                  : PySubTask(p) {}
+    PyWFMySQLCheckoutTask(const PyWFMySQLCheckoutTask &o) : PySubTask(o) {}
+    OriginType* get() const { return static_cast<OriginType*>(ptr); }
+    void start() {
+        assert(!series_of(this->get()));
+        CountableSeriesWork::start_series_work(this->get(), nullptr);
+    }
+    void dismiss()        { this->get()->dismiss(); }
+    int get_state() const { return this->get()->get_state(); }
+    int get_error() const { return this->get()->get_error(); }
+    py::object get_connection() const {
+        auto lease = this->get()->get_lease();
+        if(!lease) return py::none();
+        return py::cast(PyMySQLPooledConnection(lease));
+    }
+    void set_user_data(py::object obj) {
+        void *old = this->get()->user_data;
+        if(old != nullptr) {
+            delete static_cast<py::object*>(old);
+        }
+        py::object *p = nullptr;
+        if(obj.is_none() == false) p = new py::object(obj);
+        this->get()->user_data = static_cast<void*>(p);
+    }
+    py::object get_user_data() const {
+        void *context = this->get()->user_data;
+        if(context == nullptr) return py::none();
+        return *static_cast<py::object*>(context);
+    }
+    void set_callback(_py_callback_t cb) {
+        auto *task = this->get();
+        void *user_data = task->user_data;
+        task->user_data = nullptr;
+        auto deleter = std::make_shared<TaskDeleterWrapper<_py_callback_t, OriginType>>(
+            std::move(cb), this->get());
+        this->get()->set_callback([deleter](OriginType *p) {
+            py_callback_wrapper(deleter->get_func(), PyWFMySQLCheckoutTask(p));
+        });
+        task->user_data = user_data;
+    }
+};
+
+class PyMySQLPool {
+public:
+    PyMySQLPool(const std::string &url, size_t min_size, size_t max_size,
+        int idle_timeout, int ping_interval)
+        : pool(std::make_shared<MySQLPool>(url, min_size, max_size, idle_timeout, ping_interval)) {}
+
+    PyWFMySQLPoolTask create_query_task(const std::string &query,
+        PyWFMySQLPoolTask::_py_callback_t cb) {
+        PyWFMySQLPoolTask t(new MySQLPoolTask(pool, query, nullptr));
+        t.set_callback(std::move(cb));
+        return t;
+    }
+    PyWFMySQLPoolTask create_execute_task(const MySQLStatement &stmt, py::sequence params,
+        PyWFMySQLPoolTask::_py_callback_t cb) {
+        mysql_check_escape_safe(pool->is_escape_safe());
+        return create_query_task(stmt.format(params), std::move(cb));
+    }
+    PyWFMySQLCheckoutTask create_checkout_task(PyWFMySQLCheckoutTask::_py_callback_t cb) {
+        PyWFMySQLCheckoutTask t(new MySQLPoolCheckoutTask(pool, nullptr));
+        t.set_callback(std::move(cb));
+        return t;
+    }
+    void close_idle() { pool->close_idle(); }
+    py::dict get_stats();
+
+private:
+    std::shared_ptr<MySQLPool> pool;
+};
+
+/**
+ * MySQLBatch builds multi-row INSERT statements, each one is not longer than
+ * max_packet, rows are escaped in C++ when added.
+ */
+class MySQLBatch {
+public:
+    MySQLBatch(const std::string &table, const std::vector<std::string> &columns,
+        size_t max_packet, const std::string &command, const std::string &suffix);
+
+    void add_row(py::sequence row);
+    void add_rows(py::iterable rows);
+    // Each column is a sequence, or a 1-d numeric buffer such as numpy array
+    void add_columns(py::sequence columns);
+    void clear();
+
+    size_t get_row_count() const { return rows; }
+    std::vector<std::string> get_statements() const;
+    py::list py_get_statements() const;
+
+private:
+    void append_tuple(const std::string &tuple);
+
+    std::string header;
+    std::string suffix;
+    size_t column_count;
+    size_t max_packet;
+    size_t rows{0};
+    std::vector<std::string> statements;
+    std::string current;
+};
+
+struct MySQLBatchResult {
+    unsigned long long affected_rows{0};
+    unsigned long long insert_id{0};
+    int error_code{0};
+    std::string error_msg;
+};
+
+/**
+ * MySQLBatchTask sends statements one after another on a new connection,
+ * stops at the first failure, and closes the connection at the end. If
+ * atomic, statements are wrapped by BEGIN and COMMIT, and rolled back on
+ * failure.
+ */
+class MySQLBatchTask : public WFGenericTask {
+public:
+    using callback_t = std::function<void (MySQLBatchTask *)>;
+
+    MySQLBatchTask(const std::string &url, std::vector<std::string> &&statements,
+        bool atomic, callback_t &&cb);
+
+    const std::vector<MySQLBatchResult> &get_results() const { return results; }
+    unsigned long long get_affected_rows() const;
+    void set_callback(callback_t cb) { callback = std::move(cb); }
+
+protected:
+    virtual void dispatch();
+    virtual SubTask *done() {
+        SeriesWork *series = series_of(this);
+        if(callback) callback(this);
+        delete this;
+        return series->pop();
+    }
+
+private:
+    WFMySQLTask *create_step();
+    void on_step(WFMySQLTask *task);
+    void finish(SeriesWork *series);
+
+    std::string url;
+    std::vector<std::string> queries;
+    bool atomic;
+    size_t step{0};
+    bool failed{false};
+    int fail_state{WFT_STATE_SUCCESS};
+    int fail_error{0};
+    std::unique_ptr<WFMySQLConnection> conn;
+    std::vector<MySQLBatchResult> results;
+    callback_t callback;
+};
+
+class PyWFMySQLBatchTask : public PySubTask {
+public:
+    using OriginType = MySQLBatchTask;
+    using _py_callback_t = std::function<void(PyWFMySQLBatchTask)>;
+    PyWFMySQLBatchTask()                            : PySubTask()  {}
+    PyWFMySQLBatchTask(OriginType *p)               : PySubTask(p) {}
+    PyWFMySQLBatchTask(const PyWFMySQLBatchTask &o) : PySubTask(o) {}
+    OriginType* get() const { return static_cast<OriginType*>(ptr); }
+    void start() {
+        assert(!series_of(this->get()));
+        CountableSeriesWork::start_series_work(this->get(), nullptr);
+    }
+    void dismiss()        { this->get()->dismiss(); }
+    int get_state() const { return this->get()->get_state(); }
+    int get_error() const { return this->get()->get_error(); }
+    unsigned long long get_affected_rows() const { return this->get()->get_affected_rows(); }
+    py::list get_results() const {
+        py::list lst;
+        for(const auto &r : this->get()->get_results()) {
+            lst.append(py::make_tuple(r.affected_rows, r.insert_id, r.error_code,
+                py::bytes(r.error_msg)));
+        }
+        return lst;
+    }
+    void set_user_data(py::object obj) {
+        void *old = this->get()->user_data;
+        if(old != nullptr) {
+            delete static_cast<py::object*>(old);
+        }
+        py::object *p = nullptr;
+        if(obj.is_none() == false) p = new py::object(obj);
+        this->get()->user_data = static_cast<void*>(p);
+    }
+    py::object get_user_data() const {
+        void *context = this->get()->user_data;
+        if(context == nullptr) return py::none();
+        return *static_cast<py::object*>(context);
+    }
+    void set_callback(_py_callback_t cb) {
+        auto *task = this->get();
+        void *user_data = task->user_data;
+        task->user_data = nullptr;
+        auto deleter = std::make_shared<TaskDeleterWrapper<_py_callback_t, OriginType>>(
+            std::move(cb), this->get());
+        this->get()->set_callback([deleter](OriginType *p) {
+            py_callback_wrapper(deleter->get_func(), PyWFMySQLBatchTask(p));
+        });
+        task->user_data = user_data;
+    }
 };
 
 #endif // PYWF_MYSQL_TYPES_H
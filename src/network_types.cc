@@ -1,8 +1,220 @@
 #include "network_types.h"
+#include "workflow/WFGlobal.h"
+#include <openssl/ssl.h>
+#include <sys/socket.h>
+#include <strings.h>
+#include <atomic>
+#include <ctime>
+#include <list>
+#include <unordered_map>
+
+/**
+ * SSLSessionCache keeps client sessions keyed by SNI and peer address.
+ * Workflow does not expose the SSL object before connecting, so the cached
+ * session is set when the handshake starts, which is before ClientHello.
+ */
+class SSLSessionCache {
+    struct Entry {
+        std::string key;
+        SSL_SESSION *sess;
+        time_t expire;
+    };
+public:
+    static SSLSessionCache *get_instance() {
+        static SSLSessionCache cache;
+        return &cache;
+    }
+
+    void set_params(size_t size, int ttl) {
+        std::lock_guard<std::mutex> lk(mtx);
+        max_size = size;
+        ttl_seconds = ttl;
+        while(lru.size() > max_size) evict_back();
+        if(!installed && max_size > 0) {
+            SSL_CTX *ctx = WFGlobal::get_ssl_client_ctx();
+            SSL_CTX_set_session_cache_mode(ctx,
+                SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+            SSL_CTX_sess_set_new_cb(ctx, &SSLSessionCache::new_session_callback);
+            SSL_CTX_set_info_callback(ctx, &SSLSessionCache::info_callback);
+            installed = true;
+        }
+    }
+
+    py::dict get_stats() {
+        py::dict d;
+        size_t cur_size;
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            cur_size = lru.size();
+            d["max_size"] = max_size;
+            d["ttl"] = ttl_seconds;
+        }
+        size_t total = handshakes.load();
+        size_t reused = resumed.load();
+        d["size"] = cur_size;
+        d["handshakes"] = total;
+        d["resumed"] = reused;
+        d["reuse_rate"] = total ? (double)reused / total : 0.0;
+        return d;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lk(mtx);
+        while(!lru.empty()) evict_back();
+    }
+
+private:
+    SSLSessionCache() = default;
+
+    static bool make_key(const SSL *ssl, std::string &key) {
+        struct sockaddr_storage addr;
+        socklen_t addrlen = sizeof (addr);
+        char ip_str[INET6_ADDRSTRLEN + 1] = { 0 };
+        uint16_t port = 0;
+        int fd = SSL_get_fd(ssl);
+
+        if(fd < 0 || getpeername(fd, (struct sockaddr *)&addr, &addrlen) != 0)
+            return false;
+        if(addr.ss_family == AF_INET) {
+            struct sockaddr_in *sin = (struct sockaddr_in *)(&addr);
+            inet_ntop(AF_INET, &sin->sin_addr, ip_str, sizeof (ip_str));
+            port = ntohs(sin->sin_port);
+        }
+        else if(addr.ss_family == AF_INET6) {
+            struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)(&addr);
+            inet_ntop(AF_INET6, &sin6->sin6_addr, ip_str, sizeof (ip_str));
+            port = ntohs(sin6->sin6_port);
+        }
+        else
+            return false;
+
+        const char *sni = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+        key.assign(sni ? sni : "");
+        key.append("@").append(ip_str).append(":").append(std::to_string(port));
+        return true;
+    }
+
+    static int new_session_callback(SSL *ssl, SSL_SESSION *sess) {
+        std::string key;
+        if(!make_key(ssl, key)) return 0;
+        return get_instance()->put(key, sess) ? 1 : 0;
+    }
+
+    static void info_callback(const SSL *ssl, int where, int ret) {
+        if(SSL_is_server(const_cast<SSL*>(ssl))) return;
+        SSLSessionCache *cache = get_instance();
+        if(where & SSL_CB_HANDSHAKE_START) {
+            // Only the first handshake of a connection has no session
+            if(SSL_get_session(ssl) != nullptr) return;
+            std::string key;
+            if(make_key(ssl, key)) cache->resume(const_cast<SSL*>(ssl), key);
+        }
+        else if(where & SSL_CB_HANDSHAKE_DONE) {
+            ++cache->handshakes;
+            if(SSL_session_reused(const_cast<SSL*>(ssl))) ++cache->resumed;
+        }
+    }
+
+    // The reference of sess is owned by the cache when return true
+    bool put(const std::string &key, SSL_SESSION *sess) {
+        std::lock_guard<std::mutex> lk(mtx);
+        if(max_size == 0) return false;
+        auto it = index.find(key);
+        if(it != index.end()) {
+            SSL_SESSION_free(it->second->sess);
+            lru.erase(it->second);
+            index.erase(it);
+        }
+        long timeout = SSL_SESSION_get_timeout(sess);
+        if(ttl_seconds > 0 && ttl_seconds < timeout) timeout = ttl_seconds;
+        lru.push_front(Entry{key, sess, time(nullptr) + timeout});
+        index[key] = lru.begin();
+        while(lru.size() > max_size) evict_back();
+        return true;
+    }
+
+    void resume(SSL *ssl, const std::string &key) {
+        std::lock_guard<std::mutex> lk(mtx);
+        auto it = index.find(key);
+        if(it == index.end()) return;
+        auto entry = it->second;
+        if(entry->expire <= time(nullptr)) {
+            SSL_SESSION_free(entry->sess);
+            lru.erase(entry);
+            index.erase(it);
+            return;
+        }
+        // SSL_set_session takes its own reference
+        SSL_set_session(ssl, entry->sess);
+        lru.splice(lru.begin(), lru, entry);
+    }
+
+    void evict_back() {
+        Entry &e = lru.back();
+        SSL_SESSION_free(e.sess);
+        index.erase(e.key);
+        lru.pop_back();
+    }
+
+    std::mutex mtx;
+    std::list<Entry> lru;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    size_t max_size{0};
+    int ttl_seconds{0};
+    bool installed{false};
+    std::atomic<size_t> handshakes{0};
+    std::atomic<size_t> resumed{0};
+};
+
+bool __network_helper::unix_url_addr(const std::string &url, struct sockaddr_un *addr,
+    socklen_t *addrlen) {
+    static const char scheme[] = "unix://";
+    const size_t len = sizeof (scheme) - 1;
+    if(url.size() <= len || strncasecmp(url.c_str(), scheme, len) != 0) return false;
+    return unix_path_addr(url.substr(len), addr, addrlen);
+}
+
+bool __network_helper::unix_path_addr(const std::string &path, struct sockaddr_un *addr,
+    socklen_t *addrlen) {
+    if(path.empty() || path.size() >= sizeof (addr->sun_path)) return false;
+    memset(addr, 0, sizeof (struct sockaddr_un));
+    addr->sun_family = AF_UNIX;
+    memcpy(addr->sun_path, path.c_str(), path.size());
+    *addrlen = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + path.size() + 1);
+    return true;
+}
+
+bool __network_helper::unix_path_in_use(const struct sockaddr_un &addr, socklen_t addrlen) {
+    struct stat st;
+    if(stat(addr.sun_path, &st) != 0 || !S_ISSOCK(st.st_mode)) return false;
+
+    // Never block on a server with a full backlog, it is in use then
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if(fd < 0) return false;
+    int ret = connect(fd, (const struct sockaddr *)&addr, addrlen);
+    int error = errno;
+    close(fd);
+    if(ret == 0 || error == EAGAIN) return true;
+    if(error == ECONNREFUSED) unlink(addr.sun_path);
+    return false;
+}
+
+void set_ssl_session_cache(size_t max_size, int ttl) {
+    SSLSessionCache::get_instance()->set_params(max_size, ttl);
+}
+
+py::dict get_ssl_session_cache_stats() {
+    return SSLSessionCache::get_instance()->get_stats();
+}
+
+void clear_ssl_session_cache() {
+    SSLSessionCache::get_instance()->clear();
+}
 
 void init_http_types(py::module_&);
 void init_redis_types(py::module_&);
 void init_mysql_types(py::module_&);
+void init_websocket_types(py::module_&);
 
 void init_network_types(py::module_ &wf) {
     py::class_<WFServerParams>(wf, "ServerParams")
@@ -15,7 +227,13 @@ void init_network_types(py::module_ &wf) {
         .def_readwrite("ssl_accept_timeout",    &WFServerParams::ssl_accept_timeout)
     ;
 
+    wf.def("set_ssl_session_cache",       &set_ssl_session_cache, py::arg("max_size"),
+                                           py::arg("ttl") = 0);
+    wf.def("get_ssl_session_cache_stats", &get_ssl_session_cache_stats);
+    wf.def("clear_ssl_session_cache",     &clear_ssl_session_cache);
+
     init_http_types(wf);
     init_redis_types(wf);
     init_mysql_types(wf);
+    init_websocket_types(wf);
 }
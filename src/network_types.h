@@ -1,6 +1,12 @@
 #ifndef PYWF_NETWORK_TYPES_H
 #define PYWF_NETWORK_TYPES_H
 #include <arpa/inet.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
 
 #include "common_types.h"
 #include "workflow/HttpMessage.h"
@@ -16,6 +22,48 @@ public:
     template<typename Task>
     static void server_prepare(Task*) {}
     static void server_prepare(WFHttpTask*);
+
+    /**
+     * Fill addr with an unix domain socket path, or an url looks like
+     * unix:///path/to/socket. Return false if url is not an unix url or
+     * the path is too long.
+     */
+    static bool unix_path_addr(const std::string &path, struct sockaddr_un *addr,
+        socklen_t *addrlen);
+    static bool unix_url_addr(const std::string &url, struct sockaddr_un *addr,
+        socklen_t *addrlen);
+    /**
+     * Return true if a server is listening on the socket file. A socket
+     * file refusing connections is left by a dead server and removed.
+     */
+    static bool unix_path_in_use(const struct sockaddr_un &addr, socklen_t addrlen);
+
+    // Return (ip, port) of the peer, or (path, 0) for unix domain socket
+    template<typename Task>
+    static py::object peer_addr(const Task *task) {
+        char ip_str[INET6_ADDRSTRLEN + 1] = { 0 };
+        struct sockaddr_storage addr;
+        socklen_t addrlen = sizeof (addr);
+        uint16_t port = 0;
+
+        if (task->get_peer_addr((struct sockaddr *)&addr, &addrlen) == 0) {
+            if (addr.ss_family == AF_INET) {
+                struct sockaddr_in *sin = (struct sockaddr_in *)(&addr);
+                inet_ntop(AF_INET, &sin->sin_addr, ip_str, addrlen);
+                port = ntohs(sin->sin_port);
+            }
+            else if (addr.ss_family == AF_INET6) {
+                struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)(&addr);
+                inet_ntop(AF_INET6, &sin6->sin6_addr, ip_str, addrlen);
+                port = ntohs(sin6->sin6_port);
+            }
+            else if (addr.ss_family == AF_UNIX) {
+                struct sockaddr_un *sun = (struct sockaddr_un *)(&addr);
+                return py::make_tuple(py::str(sun->sun_path), py::int_(0));
+            }
+        }
+        return py::make_tuple(py::str(ip_str), py::int_(port));
+    }
 };
 
 template<class Req, class Resp>
@@ -50,24 +98,7 @@ public:
     void set_keep_alive(int t)      { this->get()->set_keep_alive(t); }
 
     py::object get_peer_addr() const {
-        char ip_str[INET6_ADDRSTRLEN + 1] = { 0 };
-        struct sockaddr_storage addr;
-        socklen_t addrlen = sizeof (addr);
-        uint16_t port = 0;
-
-        if (this->get()->get_peer_addr((struct sockaddr *)&addr, &addrlen) == 0) {
-            if (addr.ss_family == AF_INET) {
-                struct sockaddr_in *sin = (struct sockaddr_in *)(&addr);
-                inet_ntop(AF_INET, &sin->sin_addr, ip_str, addrlen);
-                port = ntohs(sin->sin_port);
-            }
-            else if (addr.ss_family == AF_INET6) {
-                struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)(&addr);
-                inet_ntop(AF_INET6, &sin6->sin6_addr, ip_str, addrlen);
-                port = ntohs(sin6->sin6_port);
-            }
-        }
-        return py::make_tuple(py::str(ip_str), py::int_(port));
+        return __network_helper::peer_addr(this->get());
     }
 
     void set_callback(_py_callback_t cb) {
@@ -101,27 +132,38 @@ public:
     }
 };
 
-template<typename Req, typename Resp>
+template<typename Req, typename Resp,
+    typename Server = WFServer<typename Req::OriginType, typename Resp::OriginType>>
 class PyWFServer {
 public:
     using ReqType       = Req;
     using RespType      = Resp;
-    using OriginType    = WFServer<typename Req::OriginType, typename Resp::OriginType>;
+    using OriginType    = Server;
     using _py_process_t = std::function<void(PyWFNetworkTask<Req, Resp>)>;
     using _task_t       = WFNetworkTask<typename Req::OriginType, typename Resp::OriginType>;
     using _pytask_t     = PyWFNetworkTask<Req, Resp>;
+    using _native_t     = std::function<bool(_task_t *)>;
 
     PyWFServer(_py_process_t proc)
         : process(std::move(proc)), server([this](_task_t *p) {
+            // Requests handled by native process never acquire gil
+            if(this->native_process && this->native_process(p)) return;
             __network_helper::server_prepare(p);
             py_callback_wrapper(this->process, _pytask_t(p));
         }) {}
     PyWFServer(WFServerParams params, _py_process_t proc)
         : process(std::move(proc)), server(&params, [this](_task_t *p) {
+            if(this->native_process && this->native_process(p)) return;
             __network_helper::server_prepare(p);
             py_callback_wrapper(this->process, _pytask_t(p));
         }) {}
 
+    /**
+     * Set a C++ function which is called before python process, return true
+     * if the request is handled. It must be set before the server starts.
+     */
+    void set_native_process(_native_t f) { native_process = std::move(f); }
+
     int start_0(unsigned short port) {
         return server.start(port);
     }
@@ -141,12 +183,32 @@ public:
         return server.start(family, host.c_str(), port, cert_file.c_str(), key_file.c_str());
     }
 
+    int start_unix(const std::string &path, const std::string &cert_file,
+        const std::string &key_file) {
+        struct sockaddr_un addr;
+        socklen_t addrlen;
+        if(!__network_helper::unix_path_addr(path, &addr, &addrlen)) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        if(__network_helper::unix_path_in_use(addr, addrlen)) {
+            errno = EADDRINUSE;
+            return -1;
+        }
+        const struct sockaddr *bind_addr = (const struct sockaddr *)&addr;
+        if(cert_file.empty() || key_file.empty()) {
+            return server.start(bind_addr, addrlen, nullptr, nullptr);
+        }
+        return server.start(bind_addr, addrlen, cert_file.c_str(), key_file.c_str());
+    }
+
     void shutdown()    { server.shutdown(); }
     void wait_finish() { server.wait_finish(); }
     void stop()        { server.stop(); }
     ~PyWFServer()      { release_wrapped_function(this->process); }
 
     _py_process_t process;
+    _native_t native_process;
 private:
     OriginType server;
 };
@@ -1,4 +1,6 @@
 #include "other_types.h"
+#include "fd_cache.h"
+#include <cstring>
 
 class GoTaskWrapper {
     struct Params {
@@ -26,29 +28,97 @@ private:
     Params *params;
 };
 
-PyWFFileIOTask create_pread_task(int fd, size_t count, off_t offset, py_fio_callback_t cb) {
-    void *buf = malloc(count);
-    FileIOTaskData *data = new FileIOTaskData(buf, nullptr);
-    auto ptr = WFTaskFactory::create_pread_task(fd, buf, count, offset, nullptr);
-    ptr->user_data = data;
+/**
+ * Files opened with O_DIRECT need aligned buffers, take one from the pool,
+ * it is put back when the task and all memoryviews of it are released.
+ */
+static FileBufferTaskData *new_aligned_task_data(size_t size) {
+    std::unique_ptr<FileBufferTaskData> data(new FileBufferTaskData());
+    data->add(py::cast(new AlignedBuffer(size), py::return_value_policy::take_ownership));
+    return data.release();
+}
+
+PyWFFileIOTask create_pread_task(int fd, size_t count, off_t offset, py_fio_callback_t cb,
+    bool direct) {
+    WFFileIOTask *ptr;
+    if(direct) {
+        FileBufferTaskData *data = new_aligned_task_data(count);
+        ptr = FileEngine::create_pread_task(fd, data->get_iov()[0].iov_base, count, offset,
+            true);
+        ptr->user_data = data;
+    }
+    else {
+        void *buf = malloc(count);
+        FileIOTaskData *data = new FileIOTaskData(buf, nullptr);
+        ptr = FileEngine::create_pread_task(fd, buf, count, offset, true);
+        ptr->user_data = data;
+    }
     PyWFFileIOTask t(ptr);
     t.set_callback(std::move(cb));
     return t;
 }
 
-PyWFFileIOTask create_pwrite_task(int fd, const py::bytes &b, size_t count, off_t offset,
+PyWFFileIOTask create_preadinto_task(int fd, py::object buffer, off_t offset,
     py_fio_callback_t cb) {
+    std::unique_ptr<FileBufferTaskData> data(new FileBufferTaskData());
+    data->add(buffer);
+    const struct iovec &iov = data->get_iov()[0];
+    auto ptr = FileEngine::create_pread_task(fd, iov.iov_base, iov.iov_len, offset, true);
+    ptr->user_data = data.release();
+    PyWFFileIOTask t(ptr);
+    t.set_callback(std::move(cb));
+    return t;
+}
+
+PyWFFileVIOTask create_preadv_task(int fd, py::list buffers, off_t offset,
+    py_fvio_callback_t cb) {
+    std::unique_ptr<FileBufferTaskData> data(new FileBufferTaskData());
+    for(py::handle buffer : buffers)
+        data->add(py::reinterpret_borrow<py::object>(buffer));
+    const auto &iov = data->get_iov();
+    auto ptr = FileEngine::create_preadv_task(fd, iov.data(), (int)iov.size(), offset, true);
+    ptr->user_data = data.release();
+    PyWFFileVIOTask t(ptr);
+    t.set_callback(std::move(cb));
+    return t;
+}
+
+PyWFFileIOTask create_pwrite_task(int fd, const py::bytes &b, size_t count, off_t offset,
+    py_fio_callback_t cb, bool direct) {
     char *buffer;
     ssize_t length;
     if(PYBIND11_BYTES_AS_STRING_AND_SIZE(b.ptr(), &buffer, &length)) {
         // there is an error
         return nullptr;
     }
-    py::bytes *bytes = new py::bytes(b);
     size_t write_size = std::min(count, (size_t)length);
-    FileIOTaskData *data = new FileIOTaskData(nullptr, bytes);
-    auto ptr = WFTaskFactory::create_pwrite_task(fd, buffer, write_size, offset, nullptr);
-    ptr->user_data = data;
+    WFFileIOTask *ptr;
+    if(direct) {
+        FileBufferTaskData *data = new_aligned_task_data(write_size);
+        void *aligned = data->get_iov()[0].iov_base;
+        memcpy(aligned, buffer, write_size);
+        ptr = FileEngine::create_pwrite_task(fd, aligned, write_size, offset, true);
+        ptr->user_data = data;
+    }
+    else {
+        py::bytes *bytes = new py::bytes(b);
+        FileIOTaskData *data = new FileIOTaskData(nullptr, bytes);
+        ptr = FileEngine::create_pwrite_task(fd, buffer, write_size, offset, true);
+        ptr->user_data = data;
+    }
+    PyWFFileIOTask t(ptr);
+    t.set_callback(std::move(cb));
+    return t;
+}
+
+PyWFFileIOTask create_pwrite_buffer_task(int fd, py::buffer buffer, size_t count, off_t offset,
+    py_fio_callback_t cb) {
+    std::unique_ptr<FileBufferTaskData> data(new FileBufferTaskData());
+    data->add(buffer, false);
+    const struct iovec &iov = data->get_iov()[0];
+    size_t write_size = std::min(count, iov.iov_len);
+    auto ptr = FileEngine::create_pwrite_task(fd, iov.iov_base, write_size, offset, true);
+    ptr->user_data = data.release();
     PyWFFileIOTask t(ptr);
     t.set_callback(std::move(cb));
     return t;
@@ -77,16 +147,88 @@ PyWFFileVIOTask create_pwritev_task(int fd, const std::vector<py::bytes> &b, off
         return nullptr;
     }
     FileVIOTaskData *data = new FileVIOTaskData(iov, false, bytes, size);
-    auto ptr = WFTaskFactory::create_pwritev_task(fd, iov, (int)size, offset, nullptr);
+    auto ptr = FileEngine::create_pwritev_task(fd, iov, (int)size, offset, true);
     ptr->user_data = data;
     PyWFFileVIOTask t(ptr);
     t.set_callback(std::move(cb));
     return t;
 }
 
+PyWFFileIOTask create_path_pread_task(const std::string &path, size_t count, off_t offset,
+    py_fio_callback_t cb, bool direct) {
+    WFFileIOTask *ptr;
+    if(direct) {
+        FileBufferTaskData *data = new_aligned_task_data(count);
+        ptr = new PathFileIOTask(path, false, data->get_iov()[0].iov_base, count, offset, true);
+        ptr->user_data = data;
+    }
+    else {
+        void *buf = malloc(count);
+        FileIOTaskData *data = new FileIOTaskData(buf, nullptr);
+        ptr = new PathFileIOTask(path, false, buf, count, offset, false);
+        ptr->user_data = data;
+    }
+    PyWFFileIOTask t(ptr);
+    t.set_callback(std::move(cb));
+    return t;
+}
+
+PyWFFileIOTask create_path_preadinto_task(const std::string &path, py::object buffer,
+    off_t offset, py_fio_callback_t cb, bool direct) {
+    std::unique_ptr<FileBufferTaskData> data(new FileBufferTaskData());
+    data->add(buffer);
+    const struct iovec &iov = data->get_iov()[0];
+    auto ptr = new PathFileIOTask(path, false, iov.iov_base, iov.iov_len, offset, direct);
+    ptr->user_data = data.release();
+    PyWFFileIOTask t(ptr);
+    t.set_callback(std::move(cb));
+    return t;
+}
+
+PyWFFileIOTask create_path_pwrite_task(const std::string &path, const py::bytes &b,
+    size_t count, off_t offset, py_fio_callback_t cb, bool direct) {
+    char *buffer;
+    ssize_t length;
+    if(PYBIND11_BYTES_AS_STRING_AND_SIZE(b.ptr(), &buffer, &length)) {
+        // there is an error
+        return nullptr;
+    }
+    size_t write_size = std::min(count, (size_t)length);
+    WFFileIOTask *ptr;
+    if(direct) {
+        FileBufferTaskData *data = new_aligned_task_data(write_size);
+        void *aligned = data->get_iov()[0].iov_base;
+        memcpy(aligned, buffer, write_size);
+        ptr = new PathFileIOTask(path, true, aligned, write_size, offset, true);
+        ptr->user_data = data;
+    }
+    else {
+        py::bytes *bytes = new py::bytes(b);
+        FileIOTaskData *data = new FileIOTaskData(nullptr, bytes);
+        ptr = new PathFileIOTask(path, true, buffer, write_size, offset, false);
+        ptr->user_data = data;
+    }
+    PyWFFileIOTask t(ptr);
+    t.set_callback(std::move(cb));
+    return t;
+}
+
+PyWFFileIOTask create_path_pwrite_buffer_task(const std::string &path, py::buffer buffer,
+    size_t count, off_t offset, py_fio_callback_t cb, bool direct) {
+    std::unique_ptr<FileBufferTaskData> data(new FileBufferTaskData());
+    data->add(buffer, false);
+    const struct iovec &iov = data->get_iov()[0];
+    size_t write_size = std::min(count, iov.iov_len);
+    auto ptr = new PathFileIOTask(path, true, iov.iov_base, write_size, offset, direct);
+    ptr->user_data = data.release();
+    PyWFFileIOTask t(ptr);
+    t.set_callback(std::move(cb));
+    return t;
+}
+
 PyWFFileSyncTask create_fsync_task(int fd, py_fsync_callback_t cb) {
     FileTaskData *data = new FileTaskData();
-    auto ptr = WFTaskFactory::create_fsync_task(fd, nullptr);
+    auto ptr = FileEngine::create_fsync_task(fd, true);
     ptr->user_data = data;
     PyWFFileSyncTask t(ptr);
     t.set_callback(std::move(cb));
@@ -95,13 +237,37 @@ PyWFFileSyncTask create_fsync_task(int fd, py_fsync_callback_t cb) {
 
 PyWFFileSyncTask create_fdsync_task(int fd, py_fsync_callback_t cb) {
     FileTaskData *data = new FileTaskData();
-    auto ptr = WFTaskFactory::create_fdsync_task(fd, nullptr);
+    auto ptr = FileEngine::create_fdsync_task(fd, true);
     ptr->user_data = data;
     PyWFFileSyncTask t(ptr);
     t.set_callback(std::move(cb));
     return t;
 }
 
+PyWFFileCopyTask create_copy_task(const std::string &src, const std::string &dst,
+    size_t chunk_size, int parallelism, PyWFFileCopyTask::_py_callback_t cb, off_t src_offset,
+    off_t dst_offset, long long length, py::object progress) {
+    auto ptr = new FileCopyTask(src, dst, src_offset, dst_offset, length, chunk_size,
+        parallelism, nullptr);
+    PyWFFileCopyTask t(ptr);
+    t.set_callback(std::move(cb));
+    t.set_progress(progress);
+    return t;
+}
+
+// Buffers registered to the io_uring engine, pinned until replaced
+static FileBufferTaskData *registered_buffers = nullptr;
+
+int register_file_buffers(py::list buffers) {
+    std::unique_ptr<FileBufferTaskData> data(new FileBufferTaskData());
+    for(py::handle buffer : buffers)
+        data->add(py::reinterpret_borrow<py::object>(buffer));
+    if(FileEngine::register_buffers(data->get_iov()) < 0) return -1;
+    delete registered_buffers;
+    registered_buffers = data.release();
+    return 0;
+}
+
 PyWFTimerTask create_timer_task(unsigned int microseconds, py_timer_callback_t cb) {
     auto ptr = WFTaskFactory::create_timer_task(microseconds, nullptr);
     PyWFTimerTask task(ptr);
@@ -198,6 +364,28 @@ void init_other_types(py::module_ &wf) {
         .def("get_fd",        &PyWFFileSyncTask::get_fd)
     ;
 
+    py::class_<PyWFFileCopyTask, PySubTask>(wf, "FileCopyTask")
+        .def("is_null",       &PyWFFileCopyTask::is_null)
+        .def("start",         &PyWFFileCopyTask::start)
+        .def("dismiss",       &PyWFFileCopyTask::dismiss)
+        .def("get_state",     &PyWFFileCopyTask::get_state)
+        .def("get_error",     &PyWFFileCopyTask::get_error)
+        .def("get_copied",    &PyWFFileCopyTask::get_copied)
+        .def("get_total",     &PyWFFileCopyTask::get_total)
+        .def("set_callback",  &PyWFFileCopyTask::set_callback)
+        .def("set_progress",  &PyWFFileCopyTask::set_progress)
+        .def("set_user_data", &PyWFFileCopyTask::set_user_data)
+        .def("get_user_data", &PyWFFileCopyTask::get_user_data)
+    ;
+
+    py::class_<AlignedBuffer>(wf, "AlignedBuffer", py::buffer_protocol())
+        .def(py::init<size_t>(), py::arg("size"))
+        .def("__len__", &AlignedBuffer::get_size)
+        .def_buffer([](AlignedBuffer &b) {
+            return py::buffer_info(b.data(), 1, "B", (ssize_t)b.get_size());
+        })
+    ;
+
     py::class_<PyWFTimerTask, PySubTask>(wf, "TimerTask")
         .def("is_null",       &PyWFTimerTask::is_null)
         .def("start",         &PyWFTimerTask::start)
@@ -254,14 +442,74 @@ void init_other_types(py::module_ &wf) {
         .def("wait", &PyWaitGroup::wait, py::call_guard<py::gil_scoped_release>())
     ;
 
+    py::class_<PyAsyncLogWriter>(wf, "AsyncLogWriter")
+        .def(py::init([](const std::string &path, size_t ring_size, size_t flush_bytes,
+            int flush_interval_ms, int sync_interval_ms, size_t max_file_size, int max_files) {
+                AsyncLogWriter::Params params = {ring_size, flush_bytes, flush_interval_ms,
+                    sync_interval_ms, max_file_size, max_files};
+                return new PyAsyncLogWriter(path, params);
+            }), py::arg("path"), py::arg("ring_size") = 65536, py::arg("flush_bytes") = 65536,
+            py::arg("flush_interval_ms") = 100, py::arg("sync_interval_ms") = 1000,
+            py::arg("max_file_size") = 0, py::arg("max_files") = 10)
+        .def("write",       &PyAsyncLogWriter::write)
+        .def("flush",       &PyAsyncLogWriter::flush)
+        .def("close",       &PyAsyncLogWriter::close, py::call_guard<py::gil_scoped_release>())
+        .def("get_written", &PyAsyncLogWriter::get_written)
+        .def("get_dropped", &PyAsyncLogWriter::get_dropped)
+        .def("get_error",   &PyAsyncLogWriter::get_error)
+    ;
+
     wf.def("create_pread_task",   &create_pread_task, py::arg("fd"), py::arg("count"),
+                                   py::arg("offset"), py::arg("callback"),
+                                   py::arg("direct") = false);
+    wf.def("create_preadinto_task", &create_preadinto_task, py::arg("fd"), py::arg("buffer"),
+                                     py::arg("offset"), py::arg("callback"));
+    wf.def("create_pread_task",   &create_path_pread_task, py::arg("path"), py::arg("count"),
+                                   py::arg("offset"), py::arg("callback"),
+                                   py::arg("direct") = false);
+    wf.def("create_preadinto_task", &create_path_preadinto_task, py::arg("path"),
+                                     py::arg("buffer"), py::arg("offset"), py::arg("callback"),
+                                     py::arg("direct") = false);
+    wf.def("create_preadv_task",  &create_preadv_task, py::arg("fd"), py::arg("buffers"),
                                    py::arg("offset"), py::arg("callback"));
     wf.def("create_pwrite_task",  &create_pwrite_task, py::arg("fd"), py::arg("data"),
+                                   py::arg("count"), py::arg("offset"), py::arg("callback"),
+                                   py::arg("direct") = false);
+    wf.def("create_pwrite_task",  &create_pwrite_buffer_task, py::arg("fd"), py::arg("data"),
                                    py::arg("count"), py::arg("offset"), py::arg("callback"));
+    wf.def("create_pwrite_task",  &create_path_pwrite_task, py::arg("path"), py::arg("data"),
+                                   py::arg("count"), py::arg("offset"), py::arg("callback"),
+                                   py::arg("direct") = false);
+    wf.def("create_pwrite_task",  &create_path_pwrite_buffer_task, py::arg("path"),
+                                   py::arg("data"), py::arg("count"), py::arg("offset"),
+                                   py::arg("callback"), py::arg("direct") = false);
     wf.def("create_pwritev_task", &create_pwritev_task, py::arg("fd"), py::arg("data_list"),
                                    py::arg("offset"), py::arg("callback"));
     wf.def("create_fsync_task",   &create_fsync_task, py::arg("fd"), py::arg("callback"));
     wf.def("create_fdsync_task",  &create_fdsync_task, py::arg("fd"), py::arg("callback"));
+    wf.def("create_copy_task",    &create_copy_task, py::arg("src"), py::arg("dst"),
+                                   py::arg("chunk_size"), py::arg("parallelism"),
+                                   py::arg("callback"), py::arg("src_offset") = 0,
+                                   py::arg("dst_offset") = 0, py::arg("length") = -1,
+                                   py::arg("progress") = py::none());
+    wf.def("set_fd_cache_params", [](size_t max_files, int revalidate_ms) {
+        FdCache::get_instance()->set_params(max_files, revalidate_ms);
+    }, py::arg("max_files"), py::arg("revalidate_ms"));
+    wf.def("clear_fd_cache", []() { FdCache::get_instance()->clear(); },
+        py::call_guard<py::gil_scoped_release>());
+    wf.def("get_fd_cache_size", []() { return FdCache::get_instance()->size(); });
+    wf.def("alloc_aligned_buffer", [](size_t size) {
+        py::object buffer = py::cast(new AlignedBuffer(size), py::return_value_policy::take_ownership);
+        return py::memoryview(buffer);
+    }, py::arg("size"));
+    wf.def("get_buffer_alignment", &AlignedBufferPool::get_alignment);
+    wf.def("set_buffer_pool_params", [](size_t max_bytes) {
+        AlignedBufferPool::get_instance()->set_params(max_bytes);
+    }, py::arg("max_bytes"));
+    wf.def("clear_buffer_pool", []() { AlignedBufferPool::get_instance()->clear(); });
+    wf.def("get_buffer_pool_size", []() { return AlignedBufferPool::get_instance()->size(); });
+    wf.def("register_files",      &FileEngine::register_files, py::arg("fds"));
+    wf.def("register_buffers",    &register_file_buffers, py::arg("buffers"));
 
     wf.def("create_timer_task",   &create_timer_task, py::arg("microseconds"), py::arg("callback"));
     wf.def("create_counter_task", &create_counter_task_no_name, py::arg("target"), py::arg("callback"));
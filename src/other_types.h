@@ -1,6 +1,10 @@
 #ifndef PYWF_OTHER_TYPES_H
 #define PYWF_OTHER_TYPES_H
 #include "common_types.h"
+#include "file_engine.h"
+#include "file_copy.h"
+#include "buffer_pool.h"
+#include "log_writer.h"
 #include "workflow/WFTask.h"
 #include "workflow/WFTaskFactory.h"
 #include "workflow/WFFacilities.h"
@@ -53,6 +57,35 @@ private:
     py::object *bytes;
 };
 
+/**
+ * FileBufferTaskData holds buffers of python objects, the buffers are pinned
+ * until the task is destructed, so they are filled or written without copy.
+ **/
+class FileBufferTaskData : public FileTaskData {
+public:
+    FileBufferTaskData() = default;
+    ~FileBufferTaskData() {
+        py::gil_scoped_acquire acquire;
+        for(Py_buffer &view : views) PyBuffer_Release(&view);
+        owners.clear();
+    }
+    // Throw if obj is not a contiguous buffer, or not writable when required
+    void add(const py::object &obj, bool writable = true) {
+        Py_buffer view;
+        if(PyObject_GetBuffer(obj.ptr(), &view, writable ? PyBUF_CONTIG : PyBUF_CONTIG_RO) < 0)
+            throw py::error_already_set();
+        owners.push_back(obj);
+        views.push_back(view);
+        iov.push_back({view.buf, (size_t)view.len});
+    }
+    const py::object &get_owner(size_t i) const { return owners[i]; }
+    const std::vector<struct iovec> &get_iov() const { return iov; }
+private:
+    std::vector<py::object> owners;
+    std::vector<Py_buffer> views;
+    std::vector<struct iovec> iov;
+};
+
 /**
  * FileVIOTaskData OWNS buf[] and bytes[], you need this class
  * to destruct buf[] and bytes[] on the end of task's destructor.
@@ -123,12 +156,25 @@ public:
     static py::object get_data(Task*) { return py::none(); }
     static py::object get_data(WFFileIOTask *t) {
         auto *arg = t->get_args();
+        auto *data = dynamic_cast<FileBufferTaskData*>(static_cast<FileTaskData*>(t->user_data));
+        if(data) {
+            // The caller's buffer, only the bytes read are visible
+            ssize_t n = std::max(FileEngine::get_retval(t), 0L);
+            py::object view = py::memoryview(data->get_owner(0)).attr("cast")("B");
+            return view[py::slice(0, n, 1)];
+        }
         const char *buf = static_cast<const char*>(arg->buf);
         return py::bytes(buf, arg->count);
     }
     static py::object get_data(WFFileVIOTask *t) {
         py::list contents;
         auto *arg = t->get_args();
+        auto *data = dynamic_cast<FileBufferTaskData*>(static_cast<FileTaskData*>(t->user_data));
+        if(data) {
+            for(int i = 0; i < arg->iovcnt; i++)
+                contents.append(py::memoryview(data->get_owner(i)));
+            return static_cast<py::object>(contents);
+        }
         for(int i = 0; i < arg->iovcnt; i++) {
             const iovec &iov = arg->iov[i];
             contents.append(py::bytes((const char*)iov.iov_base, iov.iov_len));
@@ -158,7 +204,7 @@ public:
     off_t get_offset() const    { return __file_helper::get_offset(this->get()); }
     size_t get_count() const    { return __file_helper::get_count(this->get()); }
     py::object get_data() const { return __file_helper::get_data(this->get()); }
-    long get_retval() const { return this->get()->get_retval();        }
+    long get_retval() const { return FileEngine::get_retval(this->get()); }
     int get_state()   const { return this->get()->get_state();         }
     int get_error()   const { return this->get()->get_error();         }
     void set_callback(_py_callback_t cb) {
@@ -209,6 +255,64 @@ public:
     OriginType* get() const { return static_cast<OriginType*>(ptr); }
 };
 
+class PyWFFileCopyTask : public PySubTask {
+public:
+    using OriginType = FileCopyTask;
+    using _py_callback_t = std::function<void(PyWFFileCopyTask)>;
+    PyWFFileCopyTask()                          : PySubTask()  {}
+    PyWFFileCopyTask(OriginType *p)             : PySubTask(p) {}
+    PyWFFileCopyTask(const PyWFFileCopyTask &o) : PySubTask(o) {}
+    OriginType* get() const { return static_cast<OriginType*>(ptr); }
+    void start() {
+        assert(!series_of(this->get()));
+        CountableSeriesWork::start_series_work(this->get(), nullptr);
+    }
+    void dismiss()        { this->get()->dismiss(); }
+    int get_state() const { return this->get()->get_state(); }
+    int get_error() const { return this->get()->get_error(); }
+    size_t get_copied() const { return this->get()->get_copied(); }
+    size_t get_total() const { return this->get()->get_total(); }
+    void set_user_data(py::object obj) {
+        void *old = this->get()->user_data;
+        if(old != nullptr) {
+            delete static_cast<py::object*>(old);
+        }
+        py::object *p = nullptr;
+        if(obj.is_none() == false) p = new py::object(obj);
+        this->get()->user_data = static_cast<void*>(p);
+    }
+    py::object get_user_data() const {
+        void *context = this->get()->user_data;
+        if(context == nullptr) return py::none();
+        return *static_cast<py::object*>(context);
+    }
+    void set_callback(_py_callback_t cb) {
+        auto *task = this->get();
+        void *user_data = task->user_data;
+        task->user_data = nullptr;
+        auto deleter = std::make_shared<TaskDeleterWrapper<_py_callback_t, OriginType>>(
+            std::move(cb), this->get());
+        this->get()->set_callback([deleter](OriginType *p) {
+            py_callback_wrapper(deleter->get_func(), PyWFFileCopyTask(p));
+        });
+        task->user_data = user_data;
+    }
+    void set_progress(py::object cb) {
+        if(cb.is_none()) {
+            this->get()->set_progress(nullptr);
+            return;
+        }
+        // The task may be destructed on any thread
+        std::shared_ptr<py::object> func(new py::object(cb), [](py::object *p) {
+            py::gil_scoped_acquire acquire;
+            delete p;
+        });
+        this->get()->set_progress([func](size_t copied, size_t total) {
+            py_callback_wrapper(*func, copied, total);
+        });
+    }
+};
+
 class PyWFTimerTask : public PySubTask {
 public:
     using OriginType = WFTimerTask;
@@ -382,6 +486,48 @@ private:
     OriginType wg;
 };
 
+// The file is flushed and closed when the python object is released, without
+// waiting, the last reference may be dropped on a handler thread
+class PyAsyncLogWriter {
+public:
+    PyAsyncLogWriter(const std::string &path, const AsyncLogWriter::Params &params) {
+        writer = AsyncLogWriter::create(path, params);
+        if(!writer) {
+            PyErr_SetFromErrnoWithFilename(PyExc_OSError, path.c_str());
+            throw py::error_already_set();
+        }
+    }
+    ~PyAsyncLogWriter() {
+        writer->close(false);
+    }
+    PyAsyncLogWriter(const PyAsyncLogWriter&) = delete;
+    PyAsyncLogWriter& operator=(const PyAsyncLogWriter&) = delete;
+
+    // Accept bytes and str, only copied into the ring while holding gil
+    bool write(const py::object &data) {
+        const char *buf;
+        ssize_t length;
+        if(PyUnicode_Check(data.ptr())) {
+            buf = PyUnicode_AsUTF8AndSize(data.ptr(), &length);
+            if(buf == nullptr) throw py::error_already_set();
+        }
+        else {
+            char *bytes;
+            if(PYBIND11_BYTES_AS_STRING_AND_SIZE(data.ptr(), &bytes, &length))
+                throw py::error_already_set();
+            buf = bytes;
+        }
+        return writer->write(buf, (size_t)length);
+    }
+    void flush()              { writer->flush(); }
+    void close()              { writer->close(); }
+    size_t get_written() const { return writer->get_written(); }
+    size_t get_dropped() const { return writer->get_dropped(); }
+    int get_error() const     { return writer->get_error(); }
+private:
+    std::shared_ptr<AsyncLogWriter> writer;
+};
+
 using PyWFFileIOTask        = PyWFFileTask<PyFileIOArgs>;
 using PyWFFileVIOTask       = PyWFFileTask<PyFileVIOArgs>;
 using PyWFFileSyncTask      = PyWFFileTask<PyFileSyncArgs>;
@@ -0,0 +1,636 @@
+#include "redis_storage.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <functional>
+
+using protocol::RedisValue;
+
+static const char *ERR_WRONGTYPE = "WRONGTYPE Operation against a key holding the wrong kind of value";
+static const char *ERR_NOT_INT = "ERR value is not an integer or out of range";
+static const char *ERR_SYNTAX = "ERR syntax error";
+static const char *ERR_OVERFLOW = "ERR increment or decrement would overflow";
+
+// Check expiration every SWEEP_INTERVAL writes, at most SWEEP_BUCKETS buckets at a time
+static const size_t SWEEP_INTERVAL = 128;
+static const size_t SWEEP_BUCKETS = 32;
+
+static std::string to_upper(const std::string &s) {
+    std::string r(s);
+    for(auto &c : r) c = (char)toupper((unsigned char)c);
+    return r;
+}
+
+static bool parse_int(const std::string &s, int64_t &out) {
+    if(s.empty() || s.size() > 20) return false;
+    char *end;
+    errno = 0;
+    long long v = strtoll(s.c_str(), &end, 10);
+    if(errno != 0 || *end != '\0' || isspace((unsigned char)s[0])) return false;
+    out = (int64_t)v;
+    return true;
+}
+
+static void set_array_of(RedisValue &value, const std::vector<const std::string *> &items) {
+    value.set_array(items.size());
+    for(size_t i = 0; i < items.size(); i++) {
+        if(items[i]) value.arr_at(i).set_string(*items[i]);
+        else value.arr_at(i).set_nil();
+    }
+}
+
+RedisStorage::RedisStorage(size_t shard_count)
+    : shards(shard_count ? shard_count : 1) {
+    handlers = {
+        {"PING",     {&RedisStorage::cmd_ping,        -1}},
+        {"ECHO",     {&RedisStorage::cmd_echo,         2}},
+        {"DBSIZE",   {&RedisStorage::cmd_dbsize,       1}},
+        {"FLUSHDB",  {&RedisStorage::cmd_flushdb,     -1}},
+        {"FLUSHALL", {&RedisStorage::cmd_flushdb,     -1}},
+        {"GET",      {&RedisStorage::cmd_get,          2}},
+        {"SET",      {&RedisStorage::cmd_set,         -3}},
+        {"SETEX",    {&RedisStorage::cmd_setex,        4}},
+        {"PSETEX",   {&RedisStorage::cmd_psetex,       4}},
+        {"SETNX",    {&RedisStorage::cmd_setnx,        3}},
+        {"MGET",     {&RedisStorage::cmd_mget,        -2}},
+        {"MSET",     {&RedisStorage::cmd_mset,        -3}},
+        {"APPEND",   {&RedisStorage::cmd_append,       3}},
+        {"STRLEN",   {&RedisStorage::cmd_strlen,       2}},
+        {"INCR",     {&RedisStorage::cmd_incr,         2}},
+        {"DECR",     {&RedisStorage::cmd_decr,         2}},
+        {"INCRBY",   {&RedisStorage::cmd_incrby,       3}},
+        {"DECRBY",   {&RedisStorage::cmd_decrby,       3}},
+        {"DEL",      {&RedisStorage::cmd_del,         -2}},
+        {"UNLINK",   {&RedisStorage::cmd_del,         -2}},
+        {"EXISTS",   {&RedisStorage::cmd_exists,      -2}},
+        {"TYPE",     {&RedisStorage::cmd_type,         2}},
+        {"EXPIRE",   {&RedisStorage::cmd_expire,       3}},
+        {"PEXPIRE",  {&RedisStorage::cmd_pexpire,      3}},
+        {"TTL",      {&RedisStorage::cmd_ttl,          2}},
+        {"PTTL",     {&RedisStorage::cmd_pttl,         2}},
+        {"PERSIST",  {&RedisStorage::cmd_persist,      2}},
+        {"HGET",     {&RedisStorage::cmd_hget,         3}},
+        {"HSET",     {&RedisStorage::cmd_hset,        -4}},
+        {"HMSET",    {&RedisStorage::cmd_hset,        -4}},
+        {"HDEL",     {&RedisStorage::cmd_hdel,        -3}},
+        {"HMGET",    {&RedisStorage::cmd_hmget,       -3}},
+        {"HGETALL",  {&RedisStorage::cmd_hgetall,      2}},
+        {"HKEYS",    {&RedisStorage::cmd_hkeys,        2}},
+        {"HVALS",    {&RedisStorage::cmd_hvals,        2}},
+        {"HLEN",     {&RedisStorage::cmd_hlen,         2}},
+        {"HEXISTS",  {&RedisStorage::cmd_hexists,      3}},
+        {"HINCRBY",  {&RedisStorage::cmd_hincrby,      4}},
+    };
+}
+
+bool RedisStorage::is_supported(const std::string &command) const {
+    return handlers.find(to_upper(command)) != handlers.end();
+}
+
+bool RedisStorage::execute(const std::string &command, const std::vector<std::string> &params,
+    RedisValue &value) {
+    std::string cmd = to_upper(command);
+    auto it = handlers.find(cmd);
+    if(it == handlers.end()) return false;
+
+    // Arity counts the command itself, negative means at least -arity, as redis does
+    int arity = it->second.second;
+    int n = (int)params.size() + 1;
+    if(arity > 0 ? n != arity : n < -arity) {
+        std::string lower(command);
+        std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+        value.set_error("ERR wrong number of arguments for '" + lower + "' command");
+        return true;
+    }
+
+    (this->*(it->second.first))(params, value);
+    return true;
+}
+
+size_t RedisStorage::size() {
+    size_t total = 0;
+    int64_t now = now_ms();
+    for(auto &shard : shards) {
+        std::lock_guard<std::mutex> lk(shard.mtx);
+        for(auto &kv : shard.map) {
+            if(kv.second.expire_at == 0 || kv.second.expire_at > now) total++;
+        }
+    }
+    return total;
+}
+
+void RedisStorage::clear() {
+    for(auto &shard : shards) {
+        std::lock_guard<std::mutex> lk(shard.mtx);
+        shard.map.clear();
+        shard.sweep_bucket = 0;
+    }
+}
+
+int64_t RedisStorage::now_ms() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+RedisStorage::Shard &RedisStorage::shard_of(const std::string &key) {
+    return shards[std::hash<std::string>()(key) % shards.size()];
+}
+
+RedisStorage::Entry *RedisStorage::find(Shard &shard, const std::string &key, int64_t now) {
+    auto it = shard.map.find(key);
+    if(it == shard.map.end()) return nullptr;
+    if(it->second.expire_at != 0 && it->second.expire_at <= now) {
+        shard.map.erase(it);
+        return nullptr;
+    }
+    return &it->second;
+}
+
+void RedisStorage::after_write(Shard &shard, int64_t now) {
+    if(++shard.writes % SWEEP_INTERVAL != 0) return;
+
+    size_t bucket_count = shard.map.bucket_count();
+    for(size_t i = 0; i < SWEEP_BUCKETS && bucket_count > 0; i++) {
+        size_t b = shard.sweep_bucket++ % bucket_count;
+        std::vector<std::string> expired;
+        for(auto it = shard.map.begin(b); it != shard.map.end(b); ++it) {
+            if(it->second.expire_at != 0 && it->second.expire_at <= now)
+                expired.push_back(it->first);
+        }
+        for(const auto &key : expired) shard.map.erase(key);
+    }
+}
+
+void RedisStorage::cmd_ping(const std::vector<std::string> &params, RedisValue &value) {
+    if(params.empty()) value.set_status("PONG");
+    else value.set_string(params[0]);
+}
+
+void RedisStorage::cmd_echo(const std::vector<std::string> &params, RedisValue &value) {
+    value.set_string(params[0]);
+}
+
+void RedisStorage::cmd_dbsize(const std::vector<std::string> &params, RedisValue &value) {
+    value.set_int(size());
+}
+
+void RedisStorage::cmd_flushdb(const std::vector<std::string> &params, RedisValue &value) {
+    clear();
+    value.set_status("OK");
+}
+
+void RedisStorage::cmd_get(const std::vector<std::string> &params, RedisValue &value) {
+    Shard &shard = shard_of(params[0]);
+    std::lock_guard<std::mutex> lk(shard.mtx);
+    Entry *e = find(shard, params[0], now_ms());
+    if(e == nullptr) value.set_nil();
+    else if(e->type != ENTRY_STRING) value.set_error(ERR_WRONGTYPE);
+    else value.set_string(e->str);
+}
+
+// SET key value [NX|XX] [EX seconds|PX milliseconds|KEEPTTL] [GET]
+void RedisStorage::cmd_set(const std::vector<std::string> &params, RedisValue &value) {
+    bool nx = false, xx = false, keepttl = false, get = false;
+    int64_t ttl = 0;
+    for(size_t i = 2; i < params.size(); i++) {
+        std::string opt = to_upper(params[i]);
+        if(opt == "NX" && !xx) nx = true;
+        else if(opt == "XX" && !nx) xx = true;
+        else if(opt == "KEEPTTL" && ttl == 0) keepttl = true;
+        else if(opt == "GET") get = true;
+        else if((opt == "EX" || opt == "PX") && !keepttl && ttl == 0 && i + 1 < params.size()) {
+            if(!parse_int(params[++i], ttl) || ttl <= 0) {
+                value.set_error("ERR invalid expire time in 'set' command");
+                return;
+            }
+            if(opt == "EX") {
+                if(ttl > LLONG_MAX / 1000) {
+                    value.set_error("ERR invalid expire time in 'set' command");
+                    return;
+                }
+                ttl *= 1000;
+            }
+        }
+        else {
+            value.set_error(ERR_SYNTAX);
+            return;
+        }
+    }
+
+    const std::string &key = params[0];
+    Shard &shard = shard_of(key);
+    std::lock_guard<std::mutex> lk(shard.mtx);
+    int64_t now = now_ms();
+    Entry *e = find(shard, key, now);
+
+    if(get) {
+        if(e && e->type != ENTRY_STRING) {
+            value.set_error(ERR_WRONGTYPE);
+            return;
+        }
+        if(e) value.set_string(e->str);
+        else value.set_nil();
+    }
+
+    if((nx && e) || (xx && !e)) {
+        if(!get) value.set_nil();
+        return;
+    }
+
+    int64_t expire_at = (keepttl && e) ? e->expire_at : 0;
+    Entry &entry = shard.map[key];
+    entry.type = ENTRY_STRING;
+    entry.hash.clear();
+    entry.str = params[1];
+    entry.expire_at = ttl > 0 ? now + ttl : expire_at;
+    after_write(shard, now);
+    if(!get) value.set_status("OK");
+}
+
+void RedisStorage::cmd_setex(const std::vector<std::string> &params, RedisValue &value) {
+    int64_t seconds;
+    if(!parse_int(params[1], seconds) || seconds <= 0 || seconds > LLONG_MAX / 1000) {
+        value.set_error("ERR invalid expire time in 'setex' command");
+        return;
+    }
+    cmd_set({params[0], params[2], "PX", std::to_string(seconds * 1000)}, value);
+}
+
+void RedisStorage::cmd_psetex(const std::vector<std::string> &params, RedisValue &value) {
+    cmd_set({params[0], params[2], "PX", params[1]}, value);
+}
+
+void RedisStorage::cmd_setnx(const std::vector<std::string> &params, RedisValue &value) {
+    RedisValue r;
+    cmd_set({params[0], params[1], "NX"}, r);
+    value.set_int(r.is_nil() ? 0 : 1);
+}
+
+void RedisStorage::cmd_mget(const std::vector<std::string> &params, RedisValue &value) {
+    value.set_array(params.size());
+    int64_t now = now_ms();
+    for(size_t i = 0; i < params.size(); i++) {
+        Shard &shard = shard_of(params[i]);
+        std::lock_guard<std::mutex> lk(shard.mtx);
+        Entry *e = find(shard, params[i], now);
+        if(e && e->type == ENTRY_STRING) value.arr_at(i).set_string(e->str);
+        else value.arr_at(i).set_nil();
+    }
+}
+
+void RedisStorage::cmd_mset(const std::vector<std::string> &params, RedisValue &value) {
+    if(params.size() % 2 != 0) {
+        value.set_error("ERR wrong number of arguments for 'mset' command");
+        return;
+    }
+    // Each key is set atomically, but not all keys as a whole
+    int64_t now = now_ms();
+    for(size_t i = 0; i < params.size(); i += 2) {
+        Shard &shard = shard_of(params[i]);
+        std::lock_guard<std::mutex> lk(shard.mtx);
+        Entry &entry = shard.map[params[i]];
+        entry.type = ENTRY_STRING;
+        entry.hash.clear();
+        entry.str = params[i + 1];
+        entry.expire_at = 0;
+        after_write(shard, now);
+    }
+    value.set_status("OK");
+}
+
+void RedisStorage::cmd_append(const std::vector<std::string> &params, RedisValue &value) {
+    Shard &shard = shard_of(params[0]);
+    std::lock_guard<std::mutex> lk(shard.mtx);
+    int64_t now = now_ms();
+    Entry *e = find(shard, params[0], now);
+    if(e && e->type != ENTRY_STRING) {
+        value.set_error(ERR_WRONGTYPE);
+        return;
+    }
+    if(e == nullptr) e = &shard.map[params[0]];
+    e->str.append(params[1]);
+    after_write(shard, now);
+    value.set_int(e->str.size());
+}
+
+void RedisStorage::cmd_strlen(const std::vector<std::string> &params, RedisValue &value) {
+    Shard &shard = shard_of(params[0]);
+    std::lock_guard<std::mutex> lk(shard.mtx);
+    Entry *e = find(shard, params[0], now_ms());
+    if(e == nullptr) value.set_int(0);
+    else if(e->type != ENTRY_STRING) value.set_error(ERR_WRONGTYPE);
+    else value.set_int(e->str.size());
+}
+
+void RedisStorage::incr_by(const std::string &key, int64_t delta, RedisValue &value) {
+    Shard &shard = shard_of(key);
+    std::lock_guard<std::mutex> lk(shard.mtx);
+    int64_t now = now_ms();
+    Entry *e = find(shard, key, now);
+    int64_t cur = 0;
+    if(e) {
+        if(e->type != ENTRY_STRING) {
+            value.set_error(ERR_WRONGTYPE);
+            return;
+        }
+        if(!parse_int(e->str, cur)) {
+            value.set_error(ERR_NOT_INT);
+            return;
+        }
+    }
+    if((delta > 0 && cur > LLONG_MAX - delta) || (delta < 0 && cur < LLONG_MIN - delta)) {
+        value.set_error(ERR_OVERFLOW);
+        return;
+    }
+    cur += delta;
+    if(e == nullptr) e = &shard.map[key];
+    e->str = std::to_string(cur);
+    after_write(shard, now);
+    value.set_int(cur);
+}
+
+void RedisStorage::cmd_incr(const std::vector<std::string> &params, RedisValue &value) {
+    incr_by(params[0], 1, value);
+}
+
+void RedisStorage::cmd_decr(const std::vector<std::string> &params, RedisValue &value) {
+    incr_by(params[0], -1, value);
+}
+
+void RedisStorage::cmd_incrby(const std::vector<std::string> &params, RedisValue &value) {
+    int64_t delta;
+    if(!parse_int(params[1], delta)) value.set_error(ERR_NOT_INT);
+    else incr_by(params[0], delta, value);
+}
+
+void RedisStorage::cmd_decrby(const std::vector<std::string> &params, RedisValue &value) {
+    int64_t delta;
+    if(!parse_int(params[1], delta) || delta == LLONG_MIN) value.set_error(ERR_NOT_INT);
+    else incr_by(params[0], -delta, value);
+}
+
+void RedisStorage::cmd_del(const std::vector<std::string> &params, RedisValue &value) {
+    int64_t count = 0;
+    int64_t now = now_ms();
+    for(const auto &key : params) {
+        Shard &shard = shard_of(key);
+        std::lock_guard<std::mutex> lk(shard.mtx);
+        if(find(shard, key, now)) {
+            shard.map.erase(key);
+            count++;
+        }
+    }
+    value.set_int(count);
+}
+
+void RedisStorage::cmd_exists(const std::vector<std::string> &params, RedisValue &value) {
+    int64_t count = 0;
+    int64_t now = now_ms();
+    for(const auto &key : params) {
+        Shard &shard = shard_of(key);
+        std::lock_guard<std::mutex> lk(shard.mtx);
+        if(find(shard, key, now)) count++;
+    }
+    value.set_int(count);
+}
+
+void RedisStorage::cmd_type(const std::vector<std::string> &params, RedisValue &value) {
+    Shard &shard = shard_of(params[0]);
+    std::lock_guard<std::mutex> lk(shard.mtx);
+    Entry *e = find(shard, params[0], now_ms());
+    if(e == nullptr) value.set_status("none");
+    else value.set_status(e->type == ENTRY_STRING ? "string" : "hash");
+}
+
+void RedisStorage::set_expire(const std::string &key, int64_t ms, RedisValue &value) {
+    Shard &shard = shard_of(key);
+    std::lock_guard<std::mutex> lk(shard.mtx);
+    int64_t now = now_ms();
+    Entry *e = find(shard, key, now);
+    if(e == nullptr) {
+        value.set_int(0);
+        return;
+    }
+    if(ms <= 0) shard.map.erase(key);
+    else e->expire_at = now + ms;
+    value.set_int(1);
+}
+
+void RedisStorage::cmd_expire(const std::vector<std::string> &params, RedisValue &value) {
+    int64_t seconds;
+    if(!parse_int(params[1], seconds) || seconds > LLONG_MAX / 1000 || seconds < LLONG_MIN / 1000)
+        value.set_error(ERR_NOT_INT);
+    else
+        set_expire(params[0], seconds * 1000, value);
+}
+
+void RedisStorage::cmd_pexpire(const std::vector<std::string> &params, RedisValue &value) {
+    int64_t ms;
+    if(!parse_int(params[1], ms)) value.set_error(ERR_NOT_INT);
+    else set_expire(params[0], ms, value);
+}
+
+void RedisStorage::get_ttl(const std::string &key, bool in_ms, RedisValue &value) {
+    Shard &shard = shard_of(key);
+    std::lock_guard<std::mutex> lk(shard.mtx);
+    int64_t now = now_ms();
+    Entry *e = find(shard, key, now);
+    if(e == nullptr) value.set_int(-2);
+    else if(e->expire_at == 0) value.set_int(-1);
+    else if(in_ms) value.set_int(e->expire_at - now);
+    else value.set_int((e->expire_at - now + 500) / 1000);
+}
+
+void RedisStorage::cmd_ttl(const std::vector<std::string> &params, RedisValue &value) {
+    get_ttl(params[0], false, value);
+}
+
+void RedisStorage::cmd_pttl(const std::vector<std::string> &params, RedisValue &value) {
+    get_ttl(params[0], true, value);
+}
+
+void RedisStorage::cmd_persist(const std::vector<std::string> &params, RedisValue &value) {
+    Shard &shard = shard_of(params[0]);
+    std::lock_guard<std::mutex> lk(shard.mtx);
+    Entry *e = find(shard, params[0], now_ms());
+    if(e == nullptr || e->expire_at == 0) {
+        value.set_int(0);
+        return;
+    }
+    e->expire_at = 0;
+    value.set_int(1);
+}
+
+void RedisStorage::cmd_hget(const std::vector<std::string> &params, RedisValue &value) {
+    Shard &shard = shard_of(params[0]);
+    std::lock_guard<std::mutex> lk(shard.mtx);
+    Entry *e = find(shard, params[0], now_ms());
+    if(e == nullptr) {
+        value.set_nil();
+        return;
+    }
+    if(e->type != ENTRY_HASH) {
+        value.set_error(ERR_WRONGTYPE);
+        return;
+    }
+    auto it = e->hash.find(params[1]);
+    if(it == e->hash.end()) value.set_nil();
+    else value.set_string(it->second);
+}
+
+void RedisStorage::cmd_hset(const std::vector<std::string> &params, RedisValue &value) {
+    if(params.size() % 2 != 1) {
+        value.set_error("ERR wrong number of arguments for 'hset' command");
+        return;
+    }
+    Shard &shard = shard_of(params[0]);
+    std::lock_guard<std::mutex> lk(shard.mtx);
+    int64_t now = now_ms();
+    Entry *e = find(shard, params[0], now);
+    if(e && e->type != ENTRY_HASH) {
+        value.set_error(ERR_WRONGTYPE);
+        return;
+    }
+    if(e == nullptr) {
+        e = &shard.map[params[0]];
+        e->type = ENTRY_HASH;
+    }
+
+    int64_t added = 0;
+    for(size_t i = 1; i < params.size(); i += 2) {
+        auto ret = e->hash.emplace(params[i], params[i + 1]);
+        if(ret.second) added++;
+        else ret.first->second = params[i + 1];
+    }
+    after_write(shard, now);
+    value.set_int(added);
+}
+
+void RedisStorage::cmd_hdel(const std::vector<std::string> &params, RedisValue &value) {
+    Shard &shard = shard_of(params[0]);
+    std::lock_guard<std::mutex> lk(shard.mtx);
+    Entry *e = find(shard, params[0], now_ms());
+    if(e == nullptr) {
+        value.set_int(0);
+        return;
+    }
+    if(e->type != ENTRY_HASH) {
+        value.set_error(ERR_WRONGTYPE);
+        return;
+    }
+    int64_t count = 0;
+    for(size_t i = 1; i < params.size(); i++) {
+        count += e->hash.erase(params[i]);
+    }
+    // Empty hash is removed, as redis does
+    if(e->hash.empty()) shard.map.erase(params[0]);
+    value.set_int(count);
+}
+
+void RedisStorage::cmd_hmget(const std::vector<std::string> &params, RedisValue &value) {
+    Shard &shard = shard_of(params[0]);
+    std::lock_guard<std::mutex> lk(shard.mtx);
+    Entry *e = find(shard, params[0], now_ms());
+    if(e && e->type != ENTRY_HASH) {
+        value.set_error(ERR_WRONGTYPE);
+        return;
+    }
+    std::vector<const std::string *> items(params.size() - 1, nullptr);
+    for(size_t i = 1; e && i < params.size(); i++) {
+        auto it = e->hash.find(params[i]);
+        if(it != e->hash.end()) items[i - 1] = &it->second;
+    }
+    set_array_of(value, items);
+}
+
+void RedisStorage::hash_fields(const std::string &key, bool keys, bool vals, RedisValue &value) {
+    Shard &shard = shard_of(key);
+    std::lock_guard<std::mutex> lk(shard.mtx);
+    Entry *e = find(shard, key, now_ms());
+    if(e == nullptr) {
+        value.set_array(0);
+        return;
+    }
+    if(e->type != ENTRY_HASH) {
+        value.set_error(ERR_WRONGTYPE);
+        return;
+    }
+    std::vector<const std::string *> items;
+    items.reserve(e->hash.size() * ((keys && vals) ? 2 : 1));
+    for(const auto &kv : e->hash) {
+        if(keys) items.push_back(&kv.first);
+        if(vals) items.push_back(&kv.second);
+    }
+    set_array_of(value, items);
+}
+
+void RedisStorage::cmd_hgetall(const std::vector<std::string> &params, RedisValue &value) {
+    hash_fields(params[0], true, true, value);
+}
+
+void RedisStorage::cmd_hkeys(const std::vector<std::string> &params, RedisValue &value) {
+    hash_fields(params[0], true, false, value);
+}
+
+void RedisStorage::cmd_hvals(const std::vector<std::string> &params, RedisValue &value) {
+    hash_fields(params[0], false, true, value);
+}
+
+void RedisStorage::cmd_hlen(const std::vector<std::string> &params, RedisValue &value) {
+    Shard &shard = shard_of(params[0]);
+    std::lock_guard<std::mutex> lk(shard.mtx);
+    Entry *e = find(shard, params[0], now_ms());
+    if(e == nullptr) value.set_int(0);
+    else if(e->type != ENTRY_HASH) value.set_error(ERR_WRONGTYPE);
+    else value.set_int(e->hash.size());
+}
+
+void RedisStorage::cmd_hexists(const std::vector<std::string> &params, RedisValue &value) {
+    Shard &shard = shard_of(params[0]);
+    std::lock_guard<std::mutex> lk(shard.mtx);
+    Entry *e = find(shard, params[0], now_ms());
+    if(e == nullptr) value.set_int(0);
+    else if(e->type != ENTRY_HASH) value.set_error(ERR_WRONGTYPE);
+    else value.set_int(e->hash.count(params[1]));
+}
+
+void RedisStorage::cmd_hincrby(const std::vector<std::string> &params, RedisValue &value) {
+    int64_t delta;
+    if(!parse_int(params[2], delta)) {
+        value.set_error(ERR_NOT_INT);
+        return;
+    }
+
+    Shard &shard = shard_of(params[0]);
+    std::lock_guard<std::mutex> lk(shard.mtx);
+    int64_t now = now_ms();
+    Entry *e = find(shard, params[0], now);
+    if(e && e->type != ENTRY_HASH) {
+        value.set_error(ERR_WRONGTYPE);
+        return;
+    }
+
+    int64_t cur = 0;
+    if(e) {
+        auto it = e->hash.find(params[1]);
+        if(it != e->hash.end() && !parse_int(it->second, cur)) {
+            value.set_error("ERR hash value is not an integer");
+            return;
+        }
+    }
+    if((delta > 0 && cur > LLONG_MAX - delta) || (delta < 0 && cur < LLONG_MIN - delta)) {
+        value.set_error(ERR_OVERFLOW);
+        return;
+    }
+    if(e == nullptr) {
+        e = &shard.map[params[0]];
+        e->type = ENTRY_HASH;
+    }
+    cur += delta;
+    e->hash[params[1]] = std::to_string(cur);
+    after_write(shard, now);
+    value.set_int(cur);
+}
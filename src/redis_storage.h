@@ -0,0 +1,110 @@
+#ifndef PYWF_REDIS_STORAGE_H
+#define PYWF_REDIS_STORAGE_H
+
+#include "workflow/RedisMessage.h"
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * RedisStorage is an in-memory key-value storage which answers common redis
+ * commands in C++, it is used by RedisServer to serve requests without gil.
+ * Keys are distributed to shards by hash, each shard has its own lock.
+ * Expired keys are removed when accessed, and a few keys are checked for
+ * expiration every several writes to a shard.
+ */
+class RedisStorage {
+public:
+    RedisStorage(size_t shard_count);
+    RedisStorage(const RedisStorage&) = delete;
+    RedisStorage& operator=(const RedisStorage&) = delete;
+
+    /**
+     * Execute command, command is case insensitive. Return false if the
+     * command is not supported, value is not touched in this case.
+     */
+    bool execute(const std::string &command, const std::vector<std::string> &params,
+        protocol::RedisValue &value);
+
+    bool is_supported(const std::string &command) const;
+    size_t size();
+    void clear();
+
+private:
+    enum EntryType {
+        ENTRY_STRING,
+        ENTRY_HASH,
+    };
+
+    struct Entry {
+        EntryType type{ENTRY_STRING};
+        std::string str;
+        std::unordered_map<std::string, std::string> hash;
+        int64_t expire_at{0}; // milliseconds of steady clock, 0 means no ttl
+    };
+
+    struct Shard {
+        std::mutex mtx;
+        std::unordered_map<std::string, Entry> map;
+        size_t writes{0};
+        size_t sweep_bucket{0};
+    };
+
+    using Handler = void (RedisStorage::*)(const std::vector<std::string> &,
+        protocol::RedisValue &);
+
+    Shard &shard_of(const std::string &key);
+    // Return nullptr if key not exists or expired, shard must be locked
+    Entry *find(Shard &shard, const std::string &key, int64_t now);
+    void after_write(Shard &shard, int64_t now);
+
+    static int64_t now_ms();
+
+    void cmd_ping(const std::vector<std::string> &params, protocol::RedisValue &value);
+    void cmd_echo(const std::vector<std::string> &params, protocol::RedisValue &value);
+    void cmd_dbsize(const std::vector<std::string> &params, protocol::RedisValue &value);
+    void cmd_flushdb(const std::vector<std::string> &params, protocol::RedisValue &value);
+    void cmd_get(const std::vector<std::string> &params, protocol::RedisValue &value);
+    void cmd_set(const std::vector<std::string> &params, protocol::RedisValue &value);
+    void cmd_setex(const std::vector<std::string> &params, protocol::RedisValue &value);
+    void cmd_psetex(const std::vector<std::string> &params, protocol::RedisValue &value);
+    void cmd_setnx(const std::vector<std::string> &params, protocol::RedisValue &value);
+    void cmd_mget(const std::vector<std::string> &params, protocol::RedisValue &value);
+    void cmd_mset(const std::vector<std::string> &params, protocol::RedisValue &value);
+    void cmd_append(const std::vector<std::string> &params, protocol::RedisValue &value);
+    void cmd_strlen(const std::vector<std::string> &params, protocol::RedisValue &value);
+    void cmd_incr(const std::vector<std::string> &params, protocol::RedisValue &value);
+    void cmd_decr(const std::vector<std::string> &params, protocol::RedisValue &value);
+    void cmd_incrby(const std::vector<std::string> &params, protocol::RedisValue &value);
+    void cmd_decrby(const std::vector<std::string> &params, protocol::RedisValue &value);
+    void cmd_del(const std::vector<std::string> &params, protocol::RedisValue &value);
+    void cmd_exists(const std::vector<std::string> &params, protocol::RedisValue &value);
+    void cmd_type(const std::vector<std::string> &params, protocol::RedisValue &value);
+    void cmd_expire(const std::vector<std::string> &params, protocol::RedisValue &value);
+    void cmd_pexpire(const std::vector<std::string> &params, protocol::RedisValue &value);
+    void cmd_ttl(const std::vector<std::string> &params, protocol::RedisValue &value);
+    void cmd_pttl(const std::vector<std::string> &params, protocol::RedisValue &value);
+    void cmd_persist(const std::vector<std::string> &params, protocol::RedisValue &value);
+    void cmd_hget(const std::vector<std::string> &params, protocol::RedisValue &value);
+    void cmd_hset(const std::vector<std::string> &params, protocol::RedisValue &value);
+    void cmd_hdel(const std::vector<std::string> &params, protocol::RedisValue &value);
+    void cmd_hmget(const std::vector<std::string> &params, protocol::RedisValue &value);
+    void cmd_hgetall(const std::vector<std::string> &params, protocol::RedisValue &value);
+    void cmd_hkeys(const std::vector<std::string> &params, protocol::RedisValue &value);
+    void cmd_hvals(const std::vector<std::string> &params, protocol::RedisValue &value);
+    void cmd_hlen(const std::vector<std::string> &params, protocol::RedisValue &value);
+    void cmd_hexists(const std::vector<std::string> &params, protocol::RedisValue &value);
+    void cmd_hincrby(const std::vector<std::string> &params, protocol::RedisValue &value);
+
+    void incr_by(const std::string &key, int64_t delta, protocol::RedisValue &value);
+    void set_expire(const std::string &key, int64_t ms, protocol::RedisValue &value);
+    void get_ttl(const std::string &key, bool in_ms, protocol::RedisValue &value);
+    void hash_fields(const std::string &key, bool keys, bool vals, protocol::RedisValue &value);
+
+    std::vector<Shard> shards;
+    std::unordered_map<std::string, std::pair<Handler, int>> handlers; // handler and arity
+};
+
+#endif // PYWF_REDIS_STORAGE_H
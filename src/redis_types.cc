@@ -1,37 +1,244 @@
 #include "redis_types.h"
+#include "workflow/URIParser.h"
+#include "workflow/StringUtil.h"
+#include "workflow/WFTaskError.h"
+#include <strings.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <set>
 using namespace std;
 
 using protocol::RedisValue;
-py::object redis_as_object(RedisValue &value) {
+
+// Exception type used for error replies when error_as_exception is set
+static PyObject *redis_error_type = nullptr;
+
+struct RedisConvertOptions {
+    const char *encoding{nullptr};
+    const char *errors{"strict"};
+    bool status_as_str{false};
+    bool error_as_exception{false};
+};
+
+// Return a new reference, or nullptr with python error set
+static PyObject *redis_scalar_object(RedisValue &value, const RedisConvertOptions &opt) {
     switch(value.get_type()) {
     case REDIS_REPLY_TYPE_STRING:
+    {
+        const std::string *sv = value.string_view();
+        if(opt.encoding == nullptr)
+            return PyBytes_FromStringAndSize(sv->data(), sv->size());
+        return PyUnicode_Decode(sv->data(), sv->size(), opt.encoding, opt.errors);
+    }
     case REDIS_REPLY_TYPE_STATUS:
+    {
+        const std::string *sv = value.string_view();
+        if(opt.status_as_str || opt.encoding)
+            return PyUnicode_DecodeUTF8(sv->data(), sv->size(), "replace");
+        return PyBytes_FromStringAndSize(sv->data(), sv->size());
+    }
     case REDIS_REPLY_TYPE_ERROR:
-        return py::bytes(value.string_value());
-    case REDIS_REPLY_TYPE_ARRAY:
     {
-        py::list lst;
-        for(size_t i = 0; i < value.arr_size(); i++) {
-            lst.append(redis_as_object(value[i]));
+        const std::string *sv = value.string_view();
+        if(opt.error_as_exception) {
+            PyObject *msg = PyUnicode_DecodeUTF8(sv->data(), sv->size(), "replace");
+            if(msg == nullptr) return nullptr;
+            PyObject *err = PyObject_CallFunctionObjArgs(redis_error_type, msg, nullptr);
+            Py_DECREF(msg);
+            return err;
         }
-        return static_cast<py::object>(lst);
+        return PyBytes_FromStringAndSize(sv->data(), sv->size());
     }
     case REDIS_REPLY_TYPE_INTEGER:
-        return py::int_(value.int_value());
+        return PyLong_FromLongLong(value.int_value());
     case REDIS_REPLY_TYPE_NIL:
     default:
-        return py::none();
+        Py_RETURN_NONE;
+    }
+}
+
+/**
+ * Convert RedisValue without recursion, lists are created with their final
+ * size and filled in place, which is much faster than py::list::append for
+ * large replies such as MGET, HGETALL and LRANGE.
+ */
+static PyObject *redis_to_pyobject(RedisValue &value, const RedisConvertOptions &opt) {
+    struct Frame {
+        RedisValue *value;
+        PyObject *list;
+        size_t pos;
+    };
+
+    if(!value.is_array()) return redis_scalar_object(value, opt);
+
+    PyObject *root = PyList_New(value.arr_size());
+    if(root == nullptr) return nullptr;
+
+    std::vector<Frame> stack;
+    stack.push_back({&value, root, 0});
+    while(!stack.empty()) {
+        Frame &f = stack.back();
+        if(f.pos == f.value->arr_size()) {
+            stack.pop_back();
+            continue;
+        }
+
+        RedisValue &v = f.value->arr_at(f.pos);
+        PyObject *item;
+        if(v.is_array())
+            item = PyList_New(v.arr_size());
+        else
+            item = redis_scalar_object(v, opt);
+
+        if(item == nullptr) {
+            // Unfilled slots are NULL, which is safe for list dealloc
+            Py_DECREF(root);
+            return nullptr;
+        }
+
+        PyList_SET_ITEM(f.list, f.pos, item);
+        f.pos++;
+        if(v.is_array())
+            stack.push_back({&v, item, 0}); // f is invalid after push_back
+    }
+    return root;
+}
+
+// Turn [k1, v1, k2, v2, ...] into {k1: v1, k2: v2, ...}
+static PyObject *redis_pairs_to_dict(PyObject *list) {
+    Py_ssize_t n = PyList_GET_SIZE(list);
+    PyObject *d = PyDict_New();
+    if(d == nullptr) return nullptr;
+    for(Py_ssize_t i = 0; i + 1 < n; i += 2) {
+        if(PyDict_SetItem(d, PyList_GET_ITEM(list, i), PyList_GET_ITEM(list, i + 1)) != 0) {
+            Py_DECREF(d);
+            return nullptr;
+        }
     }
+    return d;
+}
+
+py::object redis_as_object_ex(RedisValue &value, py::object encoding, const std::string &errors,
+    bool pairs_as_dict, bool status_as_str, bool error_as_exception) {
+    RedisConvertOptions opt;
+    std::string enc;
+    if(!encoding.is_none()) {
+        enc = encoding.cast<std::string>();
+        opt.encoding = enc.c_str();
+    }
+    opt.errors = errors.c_str();
+    opt.status_as_str = status_as_str;
+    opt.error_as_exception = error_as_exception;
+
+    PyObject *obj = redis_to_pyobject(value, opt);
+    if(obj == nullptr) throw py::error_already_set();
+
+    // Only the outermost array is shaped, such as the reply of HGETALL
+    if(pairs_as_dict && value.is_array() && value.arr_size() % 2 == 0) {
+        PyObject *d = redis_pairs_to_dict(obj);
+        Py_DECREF(obj);
+        if(d == nullptr) throw py::error_already_set();
+        obj = d;
+    }
+    return py::reinterpret_steal<py::object>(obj);
+}
+
+py::object redis_as_object(RedisValue &value) {
+    RedisConvertOptions opt;
+    PyObject *obj = redis_to_pyobject(value, opt);
+    if(obj == nullptr) throw py::error_already_set();
+    return py::reinterpret_steal<py::object>(obj);
+}
+
+// Count of exported buffers of each RedisValue, guarded by gil
+static std::unordered_map<const RedisValue *, size_t> redis_exports;
+
+/**
+ * Raise BufferError if value or any value in it has exported buffers, which
+ * point into the strings that the modification would free.
+ */
+static void redis_check_mutable(RedisValue &value) {
+    if(redis_exports.empty()) return;
+
+    std::vector<RedisValue *> stack{&value};
+    while(!stack.empty()) {
+        RedisValue *v = stack.back();
+        stack.pop_back();
+        if(redis_exports.count(v))
+            throw py::buffer_error("RedisValue can not be modified while its buffer is exported");
+        if(v->is_array()) {
+            for(size_t i = 0; i < v->arr_size(); i++) stack.push_back(&v->arr_at(i));
+        }
+    }
+}
+
+static int redis_value_getbuffer(PyObject *obj, Py_buffer *view, int flags) {
+    static char empty[1] = "";
+    RedisValue *value;
+    try {
+        value = py::handle(obj).cast<RedisValue *>();
+    }
+    catch(const py::cast_error &e) {
+        PyErr_SetString(PyExc_BufferError, e.what());
+        return -1;
+    }
+    if(value == nullptr) {
+        PyErr_SetString(PyExc_BufferError, "RedisValue is not initialized");
+        return -1;
+    }
+
+    const std::string *sv = value->string_view();
+    char *data = sv ? const_cast<char *>(sv->data()) : empty;
+    Py_ssize_t size = sv ? (Py_ssize_t)sv->size() : 0;
+    if(PyBuffer_FillInfo(view, obj, data, size, 1, flags) < 0) return -1;
+
+    view->internal = value;
+    redis_exports[value]++;
+    return 0;
+}
+
+static void redis_value_releasebuffer(PyObject *, Py_buffer *view) {
+    auto it = redis_exports.find(static_cast<RedisValue *>(view->internal));
+    if(it != redis_exports.end() && --it->second == 0) redis_exports.erase(it);
+}
+
+void redis_set_nil(RedisValue &value) {
+    redis_check_mutable(value);
+    value.set_nil();
+}
+void redis_set_int(RedisValue &value, int64_t n) {
+    redis_check_mutable(value);
+    value.set_int(n);
+}
+void redis_set_array(RedisValue &value, size_t size) {
+    redis_check_mutable(value);
+    value.set_array(size);
 }
 void redis_set_string(RedisValue &value, const string &s) {
+    redis_check_mutable(value);
     value.set_string(s);
 }
 void redis_set_status(RedisValue &value, const string &s) {
+    redis_check_mutable(value);
     value.set_status(s);
 }
 void redis_set_error(RedisValue &value, const string &s) {
+    redis_check_mutable(value);
     value.set_error(s);
 }
+void redis_arr_clear(RedisValue &value) {
+    redis_check_mutable(value);
+    value.arr_clear();
+}
+void redis_arr_resize(RedisValue &value, size_t size) {
+    redis_check_mutable(value);
+    value.arr_resize(size);
+}
+void redis_clear(RedisValue &value) {
+    redis_check_mutable(value);
+    value.clear();
+}
 
 py::bytes redis_bytes_value(RedisValue &value) {
     const std::string *sv = value.string_view();
@@ -43,10 +250,12 @@ py::bytes redis_debug_bytes(RedisValue &value) {
     return py::bytes(str);
 }
 
-py::object redis_arr_at_ref(RedisValue &value, size_t pos) {
+// The returned object keeps self alive
+py::object redis_arr_at_ref(py::object self, size_t pos) {
+    RedisValue &value = self.cast<RedisValue &>();
     if(pos >= value.arr_size()) return py::none();
     auto &v = value.arr_at(pos);
-    return py::cast(v, py::return_value_policy::reference);
+    return py::cast(v, py::return_value_policy::reference_internal, self);
 }
 py::object redis_arr_at_object(RedisValue &value, size_t pos) {
     if(pos >= value.arr_size()) return py::none();
@@ -59,6 +268,7 @@ py::object redis_arr_at(RedisValue &value, size_t pos) {
 void redis_arr_set(RedisValue &value, size_t pos, RedisValue &v) {
     // if pos is invalid, do nothing
     if(pos < value.arr_size()) {
+        redis_check_mutable(value.arr_at(pos));
         value.arr_at(pos) = v;
     }
 }
@@ -67,22 +277,1220 @@ RedisValue redis_copy(RedisValue &value) {
     return value;
 }
 void redis_move_to(RedisValue &value, RedisValue &o) {
+    redis_check_mutable(value);
+    redis_check_mutable(o);
     o = std::move(value);
 }
 void redis_move_from(RedisValue &value, RedisValue &o) {
+    redis_check_mutable(value);
+    redis_check_mutable(o);
     value = std::move(o);
 }
 
+// Arguments not smaller than this are sent by reference
+static const size_t REDIS_NOCOPY_THRESHOLD = 4096;
+
+using RedisCommandList = std::vector<std::pair<std::string, std::vector<std::string>>>;
+
+// AUTH and SELECT as workflow's redis task sends
+static RedisCommandList redis_uri_prefix(const ParsedURI &uri) {
+    RedisCommandList cmds;
+    if(uri.userinfo && *uri.userinfo) {
+        std::string info(uri.userinfo);
+        size_t pos = info.find(':');
+        if(pos == std::string::npos) {
+            StringUtil::url_decode(info);
+            cmds.push_back({"AUTH", {info}});
+        }
+        else {
+            std::string user = info.substr(0, pos);
+            std::string pass = info.substr(pos + 1);
+            StringUtil::url_decode(user);
+            StringUtil::url_decode(pass);
+            if(user.empty()) cmds.push_back({"AUTH", {pass}});
+            else cmds.push_back({"AUTH", {user, pass}});
+        }
+    }
+    if(uri.path && uri.path[0] == '/' && uri.path[1] != '\0') {
+        cmds.push_back({"SELECT", {std::string(uri.path + 1)}});
+    }
+    return cmds;
+}
+
+// Connections are shared only by the tasks with the same password and dbnum
+static std::string redis_uri_info(const char *prefix, const ParsedURI &uri) {
+    std::string info(prefix);
+    if(uri.userinfo) info += uri.userinfo;
+    info += '|';
+    if(uri.path) info += uri.path;
+    return info;
+}
+
+/**
+ * The params of a request set from python, encoded as a command of
+ * RedisPipelineRequest which refers to the large buffers. The request itself
+ * only keeps the command.
+ */
+class RedisRequestArgs : public protocol::ProtocolMessage::Attachment {
+public:
+    struct Arg {
+        const char *data; // nullptr if it is in the buf of cmd
+        size_t offset;
+        size_t size;
+    };
+
+    RedisPipelineRequest cmd;
+    std::vector<Arg> args;
+};
+
+// Return the params of req, wherever they are kept
+static void redis_request_params(protocol::RedisRequest &req, std::vector<std::string> &params) {
+    auto *ra = dynamic_cast<RedisRequestArgs *>(req.get_attachment());
+    if(ra == nullptr) {
+        req.get_params(params);
+        return;
+    }
+
+    params.clear();
+    for(const RedisRequestArgs::Arg &arg : ra->args)
+        params.emplace_back(arg.data ? arg.data : ra->cmd.get_buf() + arg.offset, arg.size);
+}
+
+/**
+ * Parse the replies of the commands sent before the one of the task, then
+ * give the rest to the response of the task. A connection on which one of
+ * them failed is not kept alive.
+ */
+class RedisPrefixedResponse : public protocol::ProtocolMessage {
+public:
+    void reset(size_t n, WFRedisTask *t) {
+        parser.reset();
+        skip = n;
+        parsed = 0;
+        failed = (size_t)-1;
+        task = t;
+    }
+    // The position of the first failed reply, or -1
+    size_t get_failed() const { return failed; }
+
+protected:
+    virtual int append(const void *buf, size_t *size);
+
+private:
+    std::unique_ptr<RedisReplyParser> parser;
+    size_t skip{0};
+    size_t parsed{0};
+    size_t failed{(size_t)-1};
+    WFRedisTask *task{nullptr};
+};
+
+int RedisPrefixedResponse::append(const void *buf, size_t *size) {
+    static const auto response_append = &RedisReplyParser::append;
+    const char *p = static_cast<const char *>(buf);
+    size_t total = *size;
+    size_t offset = 0;
+
+    while(parsed < skip && offset < total) {
+        if(!parser) parser.reset(new RedisReplyParser);
+
+        size_t n = total - offset;
+        int ret = parser->append(p + offset, &n);
+        if(ret <= 0) return ret;
+
+        offset += n;
+        RedisValue value;
+        parser->get_result(value);
+        if(value.is_error() && failed == (size_t)-1) {
+            failed = parsed;
+            task->set_keep_alive(0);
+        }
+        parser.reset();
+        parsed++;
+    }
+    if(offset == total) return 0;
+
+    size_t n = total - offset;
+    int ret = (task->get_resp()->*response_append)(p + offset, &n);
+    if(ret > 0) *size = offset + n;
+    return ret;
+}
+
+/**
+ * RedisClientTask is the redis task of pyworkflow. As workflow's one, AUTH
+ * and SELECT are sent on a new connection, but in one write with the command.
+ * A command set from python with large buffers is sent from them directly.
+ * Otherwise the request encodes itself as usual.
+ */
+class RedisClientTask : public WFComplexClientTask<protocol::RedisRequest,
+    protocol::RedisResponse> {
+public:
+    RedisClientTask(int retry_max, redis_callback_t &&cb)
+        : WFComplexClientTask(retry_max, std::move(cb)) {}
+
+protected:
+    virtual bool init_success();
+    virtual CommMessageOut *message_out();
+    virtual CommMessageIn *message_in();
+    virtual bool finish_once();
+
+private:
+    RedisCommandList prefix;
+    RedisPipelineRequest out;
+    RedisPrefixedResponse in;
+    size_t prefix_sent{0};
+    bool use_in{false};
+};
+
+bool RedisClientTask::init_success() {
+    enum TransportType type;
+    if(uri_.scheme && strcasecmp(uri_.scheme, "redis") == 0)
+        type = TT_TCP;
+    else if(uri_.scheme && strcasecmp(uri_.scheme, "rediss") == 0)
+        type = TT_TCP_SSL;
+    else {
+        this->state = WFT_STATE_TASK_ERROR;
+        this->error = WFT_ERR_URI_SCHEME_INVALID;
+        return false;
+    }
+
+    prefix = redis_uri_prefix(uri_);
+    this->set_transport_type(type);
+    this->set_info(redis_uri_info("pywf-redis|", uri_));
+    return true;
+}
+
+// The seq of the task is 0 on a new connection
+CommMessageOut *RedisClientTask::message_out() {
+    auto *ra = dynamic_cast<RedisRequestArgs *>(this->req.get_attachment());
+    bool asking = this->req.is_asking();
+    prefix_sent = this->get_seq() == 0 ? prefix.size() : 0;
+    size_t skip = prefix_sent + (asking ? 1 : 0);
+    use_in = skip > 0;
+    if(!use_in && ra == nullptr) return WFComplexClientTask::message_out();
+
+    out.clear();
+    for(size_t i = 0; i < prefix_sent; i++)
+        out.add_command(prefix[i].first, prefix[i].second);
+    if(asking) out.add_command("ASKING", {});
+    if(ra)
+        out.add_request(ra->cmd);
+    else {
+        std::string cmd;
+        std::vector<std::string> params;
+        this->req.get_command(cmd);
+        this->req.get_params(params);
+        out.add_command(cmd, params);
+    }
+
+    if(use_in) in.reset(skip, this);
+    return &out;
+}
+
+CommMessageIn *RedisClientTask::message_in() {
+    if(use_in) return &in;
+    return WFComplexClientTask::message_in();
+}
+
+bool RedisClientTask::finish_once() {
+    if(use_in && this->state == WFT_STATE_SUCCESS && in.get_failed() < prefix_sent) {
+        bool auth = prefix[in.get_failed()].first == "AUTH";
+        this->state = WFT_STATE_TASK_ERROR;
+        this->error = auth ? WFT_ERR_REDIS_ACCESS_DENIED : WFT_ERR_REDIS_COMMAND_DISALLOWED;
+    }
+    return true;
+}
+
+static WFRedisTask *redis_client_task(const std::string &url, int retry_max,
+    redis_callback_t cb) {
+    RedisClientTask *task = new RedisClientTask(retry_max, std::move(cb));
+    struct sockaddr_un addr;
+    socklen_t addrlen;
+    if(__network_helper::unix_url_addr(url, &addr, &addrlen))
+        task->init(TT_TCP, (const struct sockaddr *)&addr, addrlen, "");
+    else {
+        // If url is invalid, the error is reported by the task
+        ParsedURI uri;
+        URIParser::parse(url, uri);
+        task->init(std::move(uri));
+    }
+    task->set_keep_alive(60 * 1000);
+    return task;
+}
+
 PyWFRedisTask create_redis_task(const std::string &url, int retry_max, py_redis_callback_t cb) {
-    WFRedisTask *ptr = WFTaskFactory::create_redis_task(url, retry_max, nullptr);
-    PyWFRedisTask t(ptr);
+    PyWFRedisTask t(redis_client_task(url, retry_max, nullptr));
     t.set_callback(std::move(cb));
     return t;
 }
 
+// Hold a buffer of python object until the request is destroyed
+class RedisBufferRef : public protocol::ProtocolMessage::Attachment {
+public:
+    RedisBufferRef() { memset(&view, 0, sizeof (view)); }
+    RedisBufferRef(const RedisBufferRef&) = delete;
+    RedisBufferRef& operator=(const RedisBufferRef&) = delete;
+
+    // Must be called with gil
+    bool acquire(PyObject *obj) {
+        return PyObject_GetBuffer(obj, &view, PyBUF_SIMPLE) == 0;
+    }
+
+    virtual ~RedisBufferRef() {
+        if(view.obj) {
+            py::gil_scoped_acquire acquire;
+            PyBuffer_Release(&view);
+        }
+    }
+
+    Py_buffer view;
+};
+
+struct RedisParam {
+    const char *data;
+    size_t size;
+    std::unique_ptr<RedisBufferRef> ref; // nullptr for str
+};
+
+/**
+ * Convert all params before any of them is used, so an invalid one leaves the
+ * request unchanged. The data of str params is valid while lst is alive.
+ */
+static std::vector<RedisParam> redis_convert_params(const py::list &lst) {
+    std::vector<RedisParam> result;
+    result.reserve(lst.size());
+    for(py::handle item : lst) {
+        if(PyUnicode_Check(item.ptr())) {
+            Py_ssize_t size;
+            const char *data = PyUnicode_AsUTF8AndSize(item.ptr(), &size);
+            if(data == nullptr) throw py::error_already_set();
+            result.push_back({data, (size_t)size, nullptr});
+        }
+        else {
+            std::unique_ptr<RedisBufferRef> ref(new RedisBufferRef);
+            if(!ref->acquire(item.ptr())) throw py::error_already_set();
+            const char *data = (const char *)ref->view.buf;
+            size_t size = (size_t)ref->view.len;
+            result.push_back({data, size, std::move(ref)});
+        }
+    }
+    return result;
+}
+
+// A str or bytes is iterable, but never a list of params
+static py::list redis_params_list(py::iterable params) {
+    PyObject *obj = params.ptr();
+    if(PyUnicode_Check(obj) || PyBytes_Check(obj) || PyByteArray_Check(obj))
+        throw py::type_error("params should be a list of str or bytes-like objects");
+    return py::list(params);
+}
+
+void PyRedisRequest::set_request(const std::string &cmd, py::iterable params) {
+    py::list lst = redis_params_list(params);
+    std::vector<RedisParam> args = redis_convert_params(lst);
+    protocol::RedisRequest *req = this->get();
+    bool nocopy = false;
+    for(const RedisParam &param : args)
+        nocopy |= param.ref && param.size >= REDIS_NOCOPY_THRESHOLD;
+
+    // RedisRequest only accepts std::string, small params are copied into it
+    if(!nocopy) {
+        std::vector<std::string> strs;
+        strs.reserve(args.size());
+        for(const RedisParam &param : args)
+            strs.emplace_back(param.data, param.size);
+        req->set_request(cmd, strs);
+        req->set_attachment(nullptr);
+        return;
+    }
+
+    std::unique_ptr<RedisRequestArgs> ra(new RedisRequestArgs);
+    ra->cmd.begin_command(args.size() + 1);
+    ra->cmd.add_arg(cmd.data(), cmd.size());
+    for(RedisParam &param : args) {
+        if(param.ref && param.size >= REDIS_NOCOPY_THRESHOLD) {
+            ra->cmd.add_arg_nocopy(param.data, param.size);
+            ra->cmd.add_reference(param.ref.release());
+            ra->args.push_back({param.data, 0, param.size});
+        }
+        else {
+            size_t offset = ra->cmd.add_arg(param.data, param.size);
+            ra->args.push_back({nullptr, offset, param.size});
+        }
+    }
+    req->set_request(cmd, {});
+    req->set_attachment(ra.release());
+}
+
+py::list PyRedisRequest::get_params() const {
+    py::list params;
+    std::vector<std::string> params_vec;
+    redis_request_params(*this->get(), params_vec);
+    for(const auto &param : params_vec) {
+        params.append(py::bytes(param));
+    }
+    return params;
+}
+
+void PyRedisPipelineRequest::add_command(const std::string &cmd, py::iterable params) {
+    py::list lst = redis_params_list(params);
+    std::vector<RedisParam> args = redis_convert_params(lst);
+    RedisPipelineRequest *req = this->get();
+    req->begin_command(args.size() + 1);
+    req->add_arg(cmd.data(), cmd.size());
+    for(RedisParam &param : args) {
+        if(param.ref && param.size >= REDIS_NOCOPY_THRESHOLD) {
+            req->add_arg_nocopy(param.data, param.size);
+            req->add_reference(param.ref.release());
+        }
+        else
+            req->add_arg(param.data, param.size);
+    }
+}
+
+// The memoryview holds a reference of the python RedisValue object
+py::memoryview redis_string_view(py::object self) {
+    return py::memoryview(self);
+}
+
+// CRC16 XMODEM, the same as the one used by redis cluster
+static const uint16_t redis_crc16_table[256] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+    0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+    0x1231, 0x0210, 0x3273, 0x2252, 0x52b5, 0x4294, 0x72f7, 0x62d6,
+    0x9339, 0x8318, 0xb37b, 0xa35a, 0xd3bd, 0xc39c, 0xf3ff, 0xe3de,
+    0x2462, 0x3443, 0x0420, 0x1401, 0x64e6, 0x74c7, 0x44a4, 0x5485,
+    0xa56a, 0xb54b, 0x8528, 0x9509, 0xe5ee, 0xf5cf, 0xc5ac, 0xd58d,
+    0x3653, 0x2672, 0x1611, 0x0630, 0x76d7, 0x66f6, 0x5695, 0x46b4,
+    0xb75b, 0xa77a, 0x9719, 0x8738, 0xf7df, 0xe7fe, 0xd79d, 0xc7bc,
+    0x48c4, 0x58e5, 0x6886, 0x78a7, 0x0840, 0x1861, 0x2802, 0x3823,
+    0xc9cc, 0xd9ed, 0xe98e, 0xf9af, 0x8948, 0x9969, 0xa90a, 0xb92b,
+    0x5af5, 0x4ad4, 0x7ab7, 0x6a96, 0x1a71, 0x0a50, 0x3a33, 0x2a12,
+    0xdbfd, 0xcbdc, 0xfbbf, 0xeb9e, 0x9b79, 0x8b58, 0xbb3b, 0xab1a,
+    0x6ca6, 0x7c87, 0x4ce4, 0x5cc5, 0x2c22, 0x3c03, 0x0c60, 0x1c41,
+    0xedae, 0xfd8f, 0xcdec, 0xddcd, 0xad2a, 0xbd0b, 0x8d68, 0x9d49,
+    0x7e97, 0x6eb6, 0x5ed5, 0x4ef4, 0x3e13, 0x2e32, 0x1e51, 0x0e70,
+    0xff9f, 0xefbe, 0xdfdd, 0xcffc, 0xbf1b, 0xaf3a, 0x9f59, 0x8f78,
+    0x9188, 0x81a9, 0xb1ca, 0xa1eb, 0xd10c, 0xc12d, 0xf14e, 0xe16f,
+    0x1080, 0x00a1, 0x30c2, 0x20e3, 0x5004, 0x4025, 0x7046, 0x6067,
+    0x83b9, 0x9398, 0xa3fb, 0xb3da, 0xc33d, 0xd31c, 0xe37f, 0xf35e,
+    0x02b1, 0x1290, 0x22f3, 0x32d2, 0x4235, 0x5214, 0x6277, 0x7256,
+    0xb5ea, 0xa5cb, 0x95a8, 0x8589, 0xf56e, 0xe54f, 0xd52c, 0xc50d,
+    0x34e2, 0x24c3, 0x14a0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+    0xa7db, 0xb7fa, 0x8799, 0x97b8, 0xe75f, 0xf77e, 0xc71d, 0xd73c,
+    0x26d3, 0x36f2, 0x0691, 0x16b0, 0x6657, 0x7676, 0x4615, 0x5634,
+    0xd94c, 0xc96d, 0xf90e, 0xe92f, 0x99c8, 0x89e9, 0xb98a, 0xa9ab,
+    0x5844, 0x4865, 0x7806, 0x6827, 0x18c0, 0x08e1, 0x3882, 0x28a3,
+    0xcb7d, 0xdb5c, 0xeb3f, 0xfb1e, 0x8bf9, 0x9bd8, 0xabbb, 0xbb9a,
+    0x4a75, 0x5a54, 0x6a37, 0x7a16, 0x0af1, 0x1ad0, 0x2ab3, 0x3a92,
+    0xfd2e, 0xed0f, 0xdd6c, 0xcd4d, 0xbdaa, 0xad8b, 0x9de8, 0x8dc9,
+    0x7c26, 0x6c07, 0x5c64, 0x4c45, 0x3ca2, 0x2c83, 0x1ce0, 0x0cc1,
+    0xef1f, 0xff3e, 0xcf5d, 0xdf7c, 0xaf9b, 0xbfba, 0x8fd9, 0x9ff8,
+    0x6e17, 0x7e36, 0x4e55, 0x5e74, 0x2e93, 0x3eb2, 0x0ed1, 0x1ef0
+};
+
+static uint16_t redis_crc16(const char *buf, size_t len) {
+    uint16_t crc = 0;
+    for(size_t i = 0; i < len; i++)
+        crc = (crc << 8) ^ redis_crc16_table[((crc >> 8) ^ (uint8_t)buf[i]) & 0xff];
+    return crc;
+}
+
+/**
+ * Return the hash slot of key in redis cluster. If the key contains a
+ * non-empty hash tag such as {user1000}, only the tag is hashed.
+ */
+unsigned int redis_key_slot(const std::string &key) {
+    size_t start = key.find('{');
+    if(start != std::string::npos) {
+        size_t end = key.find('}', start + 1);
+        if(end != std::string::npos && end != start + 1)
+            return redis_crc16(key.data() + start + 1, end - start - 1) & 16383;
+    }
+    return redis_crc16(key.data(), key.size()) & 16383;
+}
+
+void RedisPipelineRequest::bind_task(WFNetworkTask<RedisPipelineRequest,
+    RedisPipelineResponse> *t) {
+    task = t;
+}
+
+void RedisPipelineRequest::append(const char *data, size_t size) {
+    if(pieces.size() == prefix_pieces || pieces.back().data != nullptr)
+        pieces.push_back({nullptr, buf.size(), 0});
+    buf.append(data, size);
+    pieces.back().size += size;
+}
+
+void RedisPipelineRequest::begin_command(size_t argc) {
+    std::string header = "*" + std::to_string(argc) + "\r\n";
+    append(header.data(), header.size());
+    count++;
+}
+
+size_t RedisPipelineRequest::add_arg(const char *data, size_t size) {
+    std::string header = "$" + std::to_string(size) + "\r\n";
+    append(header.data(), header.size());
+    size_t offset = buf.size();
+    append(data, size);
+    append("\r\n", 2);
+    return offset;
+}
+
+void RedisPipelineRequest::add_arg_nocopy(const char *data, size_t size) {
+    std::string header = "$" + std::to_string(size) + "\r\n";
+    append(header.data(), header.size());
+    pieces.push_back({data, 0, size});
+    append("\r\n", 2);
+}
+
+void RedisPipelineRequest::add_request(const RedisPipelineRequest &o) {
+    for(const Piece &piece : o.pieces) {
+        const char *p = piece.data ? piece.data : o.buf.data() + piece.offset;
+        pieces.push_back({p, 0, piece.size});
+    }
+    count += o.count;
+}
+
+void RedisPipelineRequest::clear() {
+    buf.clear();
+    flat.clear();
+    pieces.clear();
+    refs.clear();
+    count = 0;
+    prefix_count = 0;
+    prefix_pieces = 0;
+}
+
+void RedisPipelineRequest::add_command(const std::string &cmd,
+    const std::vector<std::string> &params) {
+    begin_command(params.size() + 1);
+    add_arg(cmd.data(), cmd.size());
+    for(const auto &param : params) {
+        add_arg(param.data(), param.size());
+    }
+}
+
+// The seq of the task is 0 on a new connection, then the prefix is sent
+int RedisPipelineRequest::encode(struct iovec vectors[], int max) {
+    bool first = task == nullptr || task->get_task_seq() <= 0;
+    size_t start = first ? 0 : prefix_pieces;
+    size_t n = first ? count : count - prefix_count;
+    if(n == 0 || max <= (int)prefix_pieces) {
+        errno = EINVAL;
+        return -1;
+    }
+    if(task) task->get_resp()->expect(n, first ? prefix_count : 0, task);
+
+    int i = 0;
+    auto set_piece = [this, vectors, &i](const Piece &piece) {
+        const char *p = piece.data ? piece.data : buf.data() + piece.offset;
+        vectors[i].iov_base = const_cast<char *>(p);
+        vectors[i].iov_len = piece.size;
+        i++;
+    };
+
+    if(pieces.size() - start <= (size_t)max) {
+        for(size_t j = start; j < pieces.size(); j++) set_piece(pieces[j]);
+        return i;
+    }
+
+    // Too many pieces, send a flat copy of the commands after the prefix
+    if(flat.empty()) {
+        for(size_t j = prefix_pieces; j < pieces.size(); j++) {
+            const Piece &piece = pieces[j];
+            flat.append(piece.data ? piece.data : buf.data() + piece.offset, piece.size);
+        }
+    }
+    for(size_t j = start; j < prefix_pieces; j++) set_piece(pieces[j]);
+    vectors[i].iov_base = const_cast<char *>(flat.data());
+    vectors[i].iov_len = flat.size();
+    return i + 1;
+}
+
+int RedisPipelineResponse::append(const void *buf, size_t *size) {
+    const char *p = static_cast<const char *>(buf);
+    size_t total = *size;
+    size_t offset = 0;
+
+    if(parsed_count >= expected) {
+        errno = EBADMSG;
+        return -1;
+    }
+
+    while(offset < total) {
+        if(parsers.size() == parsed_count)
+            parsers.emplace_back(new RedisReplyParser);
+
+        // The parser tells how many bytes it used when a reply is completed
+        size_t n = total - offset;
+        int ret = parsers.back()->append(p + offset, &n);
+        if(ret < 0) return -1;
+        if(ret == 0) n = total - offset;
+
+        // size_limit is for the whole pipeline, not each reply
+        received += n;
+        if(received > this->size_limit) {
+            errno = EMSGSIZE;
+            return -1;
+        }
+        if(ret == 0) break;
+
+        offset += n;
+        // Never reuse a connection on which AUTH or SELECT failed
+        if(++parsed_count <= prefix_count && task) {
+            RedisValue value;
+            parsers.back()->get_result(value);
+            if(value.is_error()) task->set_keep_alive(0);
+        }
+        if(parsed_count == expected) {
+            *size = offset;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+bool RedisPipelineResponse::get_result(size_t pos, RedisValue &value) {
+    if(pos >= size()) return false;
+    // None of the commands run as expected if AUTH or SELECT failed
+    for(size_t i = 0; i < prefix_count; i++) {
+        parsers[i]->get_result(value);
+        if(value.is_error()) return true;
+    }
+    return parsers[prefix_count + pos]->get_result(value);
+}
+
+static WFRedisPipelineTask *redis_pipeline_task(const std::string &url, int retry_max,
+    std::function<void (WFRedisPipelineTask *)> cb) {
+    using factory = WFNetworkTaskFactory<RedisPipelineRequest, RedisPipelineResponse>;
+    WFRedisPipelineTask *task;
+    struct sockaddr_un addr;
+    socklen_t addrlen;
+    if(__network_helper::unix_url_addr(url, &addr, &addrlen)) {
+        task = factory::create_client_task(TT_TCP, (const struct sockaddr *)&addr,
+            addrlen, retry_max, std::move(cb));
+    }
+    else {
+        // If url is invalid, the error is reported by the task
+        ParsedURI uri;
+        URIParser::parse(url, uri);
+        enum TransportType type = TT_TCP;
+        if(uri.scheme && strcasecmp(uri.scheme, "rediss") == 0) type = TT_TCP_SSL;
+        task = factory::create_client_task(type, uri, retry_max, std::move(cb));
+        if(uri.state == URI_STATE_SUCCESS) {
+            for(auto &cmd : redis_uri_prefix(uri))
+                task->get_req()->add_prefix_command(cmd.first, cmd.second);
+            // AUTH and SELECT are sent once on a connection
+            using complex_task = WFComplexClientTask<RedisPipelineRequest, RedisPipelineResponse>;
+            static_cast<complex_task *>(task)->set_info(redis_uri_info("pywf-redis-pipeline|", uri));
+        }
+    }
+    task->get_req()->bind_task(task);
+    task->set_keep_alive(60 * 1000);
+    return task;
+}
+
+PyWFRedisPipelineTask create_redis_pipeline_task(const std::string &url, int retry_max,
+    py_redis_pipeline_callback_t cb) {
+    PyWFRedisPipelineTask t(redis_pipeline_task(url, retry_max, nullptr));
+    t.set_callback(std::move(cb));
+    return t;
+}
+
+void RedisBatchTask::dispatch() {
+    batcher->push(this);
+}
+
+void RedisBatcher::push(RedisBatchTask *task) {
+    std::vector<RedisBatchTask *> batch;
+    bool arm = false;
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        pending.push_back(task);
+        if(pending.size() >= max_batch) {
+            batch.swap(pending);
+        }
+        else if(!timer_armed) {
+            timer_armed = true;
+            arm = true;
+        }
+    }
+
+    if(!batch.empty()) {
+        flush(std::move(batch));
+    }
+    else if(arm) {
+        // Commands arrive in the window are sent together when timer fires
+        std::shared_ptr<RedisBatcher> self = shared_from_this();
+        WFTimerTask *timer = WFTaskFactory::create_timer_task(window_us, [self](WFTimerTask *) {
+            std::vector<RedisBatchTask *> batch;
+            {
+                std::lock_guard<std::mutex> lk(self->mtx);
+                self->timer_armed = false;
+                batch.swap(self->pending);
+            }
+            if(!batch.empty()) self->flush(std::move(batch));
+        });
+        timer->start();
+    }
+}
+
+void RedisBatcher::flush(std::vector<RedisBatchTask *> &&batch) {
+    auto tasks = std::make_shared<std::vector<RedisBatchTask *>>(std::move(batch));
+    WFRedisPipelineTask *pipeline = redis_pipeline_task(url, retry_max,
+        [tasks](WFRedisPipelineTask *p) {
+        int state = p->get_state();
+        int error = p->get_error();
+        RedisPipelineResponse *resp = p->get_resp();
+        if(state == WFT_STATE_SUCCESS && resp->size() != tasks->size()) {
+            state = WFT_STATE_TASK_ERROR;
+            error = EBADMSG;
+        }
+
+        for(size_t i = 0; i < tasks->size(); i++) {
+            RedisBatchTask *t = (*tasks)[i];
+            if(state == WFT_STATE_SUCCESS) resp->get_result(i, *t->get_result());
+            t->finish(state, error);
+        }
+    });
+
+    for(RedisBatchTask *t : *tasks) {
+        pipeline->get_req()->add_command(t->get_command(), t->get_params());
+    }
+    pipeline->start();
+}
+
+void RedisSubscribeContext::push(RedisValue &&value) {
+    bool start = false;
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        queue.push_back(std::move(value));
+        if(!delivering) {
+            delivering = true;
+            start = true;
+        }
+    }
+
+    if(start) start_drain();
+}
+
+void RedisSubscribeContext::start_drain() {
+    std::shared_ptr<RedisSubscribeContext> self = shared_from_this();
+    WFGoTask *go = WFTaskFactory::create_go_task("pywf-redis-subscriber", [self]() {
+        self->drain();
+    });
+    go->start();
+}
+
+void RedisSubscribeContext::drain() {
+    WFRedisSubscribeTask *task;
+    WFCounterTask *counter;
+    while(true) {
+        std::vector<RedisValue> batch;
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            if(queue.empty()) {
+                task = finished;
+                counter = finish_counter;
+                finished = nullptr;
+                finish_counter = nullptr;
+                if(task == nullptr) delivering = false;
+                break;
+            }
+            batch.swap(queue);
+        }
+
+        py::gil_scoped_acquire acquire;
+        RedisConvertOptions opt;
+        py::list messages(batch.size());
+        for(size_t i = 0; i < batch.size(); i++) {
+            PyObject *obj = redis_to_pyobject(batch[i], opt);
+            if(obj == nullptr) {
+                PyErr_Clear();
+                obj = Py_None;
+                Py_INCREF(obj);
+            }
+            PyList_SET_ITEM(messages.ptr(), i, obj);
+        }
+        py_callback_wrapper(process, messages);
+    }
+
+    if(task == nullptr) return;
+
+    // All messages are delivered, it is the last run of drain
+    py_callback_wrapper(callback, PyWFRedisSubscribeTask(task));
+    {
+        py::gil_scoped_acquire acquire;
+        if(task->user_data) {
+            delete static_cast<py::object*>(task->user_data);
+            task->user_data = nullptr;
+        }
+    }
+    task->release();
+    counter->count();
+}
+
+/**
+ * The rest messages and the callback are delivered by drain on a go task,
+ * the series waits on a counter until then, so tasks after the subscribe
+ * task still run after its callback, and no handler thread is blocked.
+ */
+void RedisSubscribeContext::finish(WFRedisSubscribeTask *task) {
+    WFCounterTask *counter = WFTaskFactory::create_counter_task(1, nullptr);
+    series_of(task)->push_front(counter);
+
+    bool start = false;
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        finished = task;
+        finish_counter = counter;
+        if(!delivering) {
+            delivering = true;
+            start = true;
+        }
+    }
+
+    if(start) start_drain();
+}
+
+PyWFRedisSubscribeTask PyRedisSubscriber::create_subscribe_task(
+    const std::vector<std::string> &channels, py_redis_message_t process,
+    py_redis_subscribe_t callback) {
+    auto ctx = std::make_shared<RedisSubscribeContext>(std::move(process), std::move(callback));
+    auto *task = subscriber.create_subscribe_task(channels,
+        [ctx](WFRedisSubscribeTask *t) {
+            RedisValue v;
+            t->get_resp()->get_result(v);
+            ctx->push(std::move(v));
+        },
+        [ctx](WFRedisSubscribeTask *t) {
+            // Keep ctx alive even if the task is deleted in finish
+            std::shared_ptr<RedisSubscribeContext> c = ctx;
+            c->finish(t);
+        });
+    return PyWFRedisSubscribeTask(task);
+}
+
+PyWFRedisSubscribeTask PyRedisSubscriber::create_psubscribe_task(
+    const std::vector<std::string> &patterns, py_redis_message_t process,
+    py_redis_subscribe_t callback) {
+    auto ctx = std::make_shared<RedisSubscribeContext>(std::move(process), std::move(callback));
+    auto *task = subscriber.create_psubscribe_task(patterns,
+        [ctx](WFRedisSubscribeTask *t) {
+            RedisValue v;
+            t->get_resp()->get_result(v);
+            ctx->push(std::move(v));
+        },
+        [ctx](WFRedisSubscribeTask *t) {
+            std::shared_ptr<RedisSubscribeContext> c = ctx;
+            c->finish(t);
+        });
+    return PyWFRedisSubscribeTask(task);
+}
+
+static std::string redis_upper(const std::string &s) {
+    std::string r(s);
+    for(auto &c : r) c = (char)toupper((unsigned char)c);
+    return r;
+}
+
+static int64_t redis_cache_now() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static size_t redis_value_bytes(const RedisValue &value) {
+    size_t bytes = sizeof (RedisValue);
+    if(value.is_array()) {
+        for(size_t i = 0; i < value.arr_size(); i++)
+            bytes += redis_value_bytes(value.arr_at(i));
+    }
+    else if(value.is_string() || value.is_status() || value.is_error())
+        bytes += value.string_value().size();
+    return bytes;
+}
+
+static size_t redis_cache_slot(const std::string &key, size_t slots) {
+    return std::hash<std::string>()(key) % slots;
+}
+
+void RedisCacheTask::dispatch() {
+    std::string command;
+    std::vector<std::string> params;
+    std::vector<std::string> keys;
+    std::string key;
+    req.get_command(command);
+
+    int ttl = cache_ttl < 0 ? cache->get_default_ttl() : cache_ttl;
+    bool use_cache = ttl > 0 && cache->enabled();
+    if(use_cache) {
+        redis_request_params(req, params);
+        use_cache = RedisCache::cacheable(command, params, keys);
+    }
+    if(use_cache) {
+        key = RedisCache::make_key(url, command, params);
+        RedisValue value;
+        if(cache->get(key, value)) {
+            resp.set_result(value);
+            cache_hit = true;
+            this->state = WFT_STATE_SUCCESS;
+            this->error = 0;
+            this->subtask_done();
+            return;
+        }
+    }
+
+    std::shared_ptr<RedisCache> c = cache;
+    uint64_t generation = c->get_generation();
+    int db = use_cache ? RedisCache::url_db(url) : 0;
+    WFRedisTask *task = redis_client_task(url, retry_max,
+        [this, c, use_cache, key, db, keys, ttl, generation](WFRedisTask *t) {
+        this->state = t->get_state();
+        this->error = t->get_error();
+        this->timeout_reason = t->get_timeout_reason();
+        this->task_seq = t->get_task_seq();
+        socklen_t addrlen = sizeof (this->peer_addr);
+        if(t->get_peer_addr((struct sockaddr *)&this->peer_addr, &addrlen) == 0)
+            this->peer_addrlen = addrlen;
+        this->req = std::move(*t->get_req());
+        this->resp = std::move(*t->get_resp());
+        if(use_cache && this->state == WFT_STATE_SUCCESS) {
+            RedisValue value;
+            this->resp.get_result(value);
+            if(!value.is_error()) c->put(key, db, keys, value, ttl, generation);
+        }
+        this->subtask_done();
+    });
+
+    // The request is sent as it is, with the buffers it refers to
+    *task->get_req() = std::move(req);
+    task->get_resp()->set_size_limit(resp.get_size_limit());
+    if(send_timeout >= 0) task->set_send_timeout(send_timeout);
+    if(receive_timeout >= 0) task->set_receive_timeout(receive_timeout);
+    if(keep_alive >= 0) task->set_keep_alive(keep_alive);
+    task->start();
+}
+
+bool RedisCache::cacheable(const std::string &command, const std::vector<std::string> &params,
+    std::vector<std::string> &keys) {
+    const char *cmd = command.c_str();
+    if(strcasecmp(cmd, "GET") == 0 || strcasecmp(cmd, "HGETALL") == 0) {
+        if(params.size() != 1) return false;
+        keys.assign(1, params[0]);
+    }
+    else if(strcasecmp(cmd, "HGET") == 0) {
+        if(params.size() != 2) return false;
+        keys.assign(1, params[0]);
+    }
+    else if(strcasecmp(cmd, "MGET") == 0) {
+        if(params.empty()) return false;
+        keys = params;
+    }
+    else
+        return false;
+    return true;
+}
+
+std::string RedisCache::make_key(const std::string &url, const std::string &command,
+    const std::vector<std::string> &params) {
+    // Length prefixed, so different params never make the same key
+    std::string key;
+    auto add = [&key](const std::string &s) {
+        key.append(std::to_string(s.size()));
+        key.push_back(':');
+        key.append(s);
+    };
+    add(url);
+    add(redis_upper(command));
+    for(const auto &p : params) add(p);
+    return key;
+}
+
+int RedisCache::url_db(const std::string &url) {
+    ParsedURI uri;
+    if(URIParser::parse(url, uri) < 0 || uri.path == nullptr || uri.path[0] != '/')
+        return 0;
+    return atoi(uri.path + 1);
+}
+
+bool RedisCache::enabled() {
+    std::lock_guard<std::mutex> lk(mtx);
+    return !listening || connected;
+}
+
+bool RedisCache::get(const std::string &key, RedisValue &value) {
+    std::lock_guard<std::mutex> lk(mtx);
+    auto it = entries.find(key);
+    if(it == entries.end()) {
+        misses++;
+        return false;
+    }
+
+    if(it->second->expire_at <= redis_cache_now()) {
+        erase(it->second);
+        misses++;
+        return false;
+    }
+
+    lru.splice(lru.begin(), lru, it->second);
+    value = it->second->value;
+    hits++;
+    return true;
+}
+
+void RedisCache::put(const std::string &key, int db, const std::vector<std::string> &keys,
+    const RedisValue &value, int ttl, uint64_t generation) {
+    size_t bytes = sizeof (Entry) + key.size() * 2 + redis_value_bytes(value);
+    for(const auto &k : keys) bytes += k.size() * 2;
+    if(bytes > max_memory) return;
+
+    std::lock_guard<std::mutex> lk(mtx);
+    if(listening && !connected) return;
+    if(cleared_at > generation) return;
+    // The reply may be older than an invalidation received while waiting for it
+    for(const auto &k : keys) {
+        if(stamps[redis_cache_slot(k, STAMP_SLOTS)] > generation) return;
+    }
+
+    auto it = entries.find(key);
+    if(it != entries.end()) erase(it->second);
+
+    lru.emplace_front();
+    Entry &e = lru.front();
+    e.key = key;
+    e.db = db;
+    e.keys = keys;
+    e.value = value;
+    e.expire_at = redis_cache_now() + ttl;
+    e.bytes = bytes;
+    entries.emplace(key, lru.begin());
+    for(const auto &k : keys) index[k].push_back(key);
+
+    used += bytes;
+    while(used > max_memory) erase(std::prev(lru.end()));
+}
+
+uint64_t RedisCache::get_generation() {
+    std::lock_guard<std::mutex> lk(mtx);
+    return generation;
+}
+
+void RedisCache::invalidate(const std::string &key, int db) {
+    std::lock_guard<std::mutex> lk(mtx);
+    // Stamps ignore db, a reply of another db in flight is dropped at worst
+    stamps[redis_cache_slot(key, STAMP_SLOTS)] = ++generation;
+    auto it = index.find(key);
+    if(it == index.end()) return;
+
+    // erase changes the index, so collect the cache keys first
+    std::vector<std::string> cache_keys;
+    for(const auto &k : it->second) {
+        auto e = entries.find(k);
+        if(e != entries.end() && (db < 0 || e->second->db == db)) cache_keys.push_back(k);
+    }
+    for(const auto &k : cache_keys) {
+        auto e = entries.find(k);
+        if(e != entries.end()) erase(e->second);
+    }
+}
+
+void RedisCache::clear() {
+    std::lock_guard<std::mutex> lk(mtx);
+    clear_locked();
+}
+
+size_t RedisCache::size() {
+    std::lock_guard<std::mutex> lk(mtx);
+    return entries.size();
+}
+
+size_t RedisCache::memory() {
+    std::lock_guard<std::mutex> lk(mtx);
+    return used;
+}
+
+void RedisCache::erase(EntryList::iterator it) {
+    for(const auto &k : it->keys) {
+        auto idx = index.find(k);
+        if(idx == index.end()) continue;
+        auto &v = idx->second;
+        v.erase(std::remove(v.begin(), v.end(), it->key), v.end());
+        if(v.empty()) index.erase(idx);
+    }
+    used -= it->bytes;
+    entries.erase(it->key);
+    lru.erase(it);
+}
+
+void RedisCache::clear_locked() {
+    lru.clear();
+    entries.clear();
+    index.clear();
+    used = 0;
+    cleared_at = ++generation;
+}
+
+int RedisCache::listen(const std::string &url) {
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        if(listening) {
+            errno = EALREADY;
+            return -1;
+        }
+        if(subscriber.init(url) < 0) return -1;
+        listening = true;
+        connected = false;
+        stopped = false;
+    }
+    start_subscribe();
+    return 0;
+}
+
+void RedisCache::stop() {
+    WFRedisSubscribeTask *task;
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        stopped = true;
+        // Not connected yet, the task quits when psubscribe is confirmed
+        if(!connected || current == nullptr) return;
+        task = current;
+        quitting = true;
+    }
+
+    task->quit();
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        quitting = false;
+    }
+    cv.notify_all();
+}
+
+void RedisCache::start_subscribe() {
+    std::shared_ptr<RedisCache> self = shared_from_this();
+    WFRedisSubscribeTask *task;
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        if(stopped) {
+            listening = false;
+            return;
+        }
+        task = subscriber.create_psubscribe_task({"__keyspace@*__:*"},
+            [self](WFRedisSubscribeTask *t) {
+                RedisValue value;
+                t->get_resp()->get_result(value);
+                self->on_message(t, value);
+            },
+            [self](WFRedisSubscribeTask *t) {
+                self->on_finish(t);
+            });
+        current = task;
+    }
+    task->start();
+}
+
+void RedisCache::on_message(WFRedisSubscribeTask *task, RedisValue &value) {
+    // [pmessage, pattern, __keyspace@0__:key, event] or [psubscribe, pattern, count]
+    if(!value.is_array() || value.arr_size() < 3) return;
+    const std::string &type = value.arr_at(0).string_value();
+    if(type == "pmessage" && value.arr_size() == 4) {
+        const std::string &channel = value.arr_at(2).string_value();
+        size_t at = channel.find('@');
+        size_t pos = channel.find("__:");
+        if(at != std::string::npos && pos != std::string::npos && at < pos)
+            invalidate(channel.substr(pos + 3), atoi(channel.c_str() + at + 1));
+    }
+    else if(type == "psubscribe") {
+        bool quit;
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            connected = true;
+            quit = stopped;
+        }
+        if(quit) task->quit();
+    }
+}
+
+void RedisCache::on_finish(WFRedisSubscribeTask *task) {
+    bool restart;
+    {
+        std::unique_lock<std::mutex> lk(mtx);
+        cv.wait(lk, [this]() { return !quitting; });
+        current = nullptr;
+        connected = false;
+        restart = !stopped;
+        if(!restart) listening = false;
+        // Notifications may be lost, entries can not be trusted any more
+        clear_locked();
+    }
+    task->release();
+
+    if(restart) {
+        std::shared_ptr<RedisCache> self = shared_from_this();
+        WFTimerTask *timer = WFTaskFactory::create_timer_task(1000 * 1000,
+            [self](WFTimerTask *) { self->start_subscribe(); });
+        timer->start();
+    }
+}
+
+// With a RedisCache, the task is a RedisCacheTask which has the same usage
+py::object create_redis_task_with_cache(const std::string &url, int retry_max, py::object cb,
+    py::object cache) {
+    if(cache.is_none())
+        return py::cast(create_redis_task(url, retry_max, cb.cast<py_redis_callback_t>()));
+
+    PyRedisCache &c = cache.cast<PyRedisCache &>();
+    return py::cast(c.create_redis_task(url, retry_max, cb.cast<PyRedisCache::_py_callback_t>()));
+}
+
+/**
+ * Answer commands supported by storage on the handler thread. Commands in
+ * overrides, and commands not supported if there is a python process, are
+ * passed to python.
+ */
+void redis_server_set_storage(PyWFRedisServer &server, std::shared_ptr<RedisStorage> storage,
+    const std::vector<std::string> &overrides) {
+    std::set<std::string> skip;
+    for(const auto &cmd : overrides) skip.insert(redis_upper(cmd));
+    bool has_process = (bool)server.process;
+
+    server.set_native_process([storage, skip, has_process](WFRedisTask *task) -> bool {
+        std::string cmd;
+        std::vector<std::string> params;
+        protocol::RedisRequest *req = task->get_req();
+        if(!req->get_command(cmd)) return false;
+        cmd = redis_upper(cmd);
+        if(skip.count(cmd)) return false;
+
+        RedisValue value;
+        req->get_params(params);
+        if(!storage->execute(cmd, params, value)) {
+            if(has_process) return false;
+            value.set_error("ERR unknown command '" + cmd + "'");
+        }
+        task->get_resp()->set_result(value);
+        return true;
+    });
+}
+
+RedisValue redis_storage_execute(RedisStorage &storage, const std::string &cmd,
+    const std::vector<std::string> &params) {
+    RedisValue value;
+    if(!storage.execute(cmd, params, value))
+        value.set_error("ERR unknown command '" + cmd + "'");
+    return value;
+}
+
 void init_redis_types(py::module_ &wf) {
+    redis_error_type = PyErr_NewException("pywf.RedisError", PyExc_Exception, nullptr);
+    wf.attr("RedisError") = py::handle(redis_error_type);
+
+    py::class_<RedisValue> redis_value(wf, "RedisValue", py::buffer_protocol());
+    // Replace the buffer slots of pybind11, to count the exported buffers
+    PyTypeObject *redis_value_type = (PyTypeObject *)redis_value.ptr();
+    redis_value_type->tp_as_buffer->bf_getbuffer = redis_value_getbuffer;
+    redis_value_type->tp_as_buffer->bf_releasebuffer = redis_value_releasebuffer;
 
-    py::class_<RedisValue>(wf, "RedisValue")
+    redis_value
         .def(py::init())
         .def(py::init<const RedisValue&>())
 
@@ -96,9 +1504,9 @@ void init_redis_types(py::module_ &wf) {
         .def("move_to",       &redis_move_to)
         .def("move_from",     &redis_move_from)
 
-        .def("set_nil",       &RedisValue::set_nil)
-        .def("set_int",       &RedisValue::set_int)
-        .def("set_array",     &RedisValue::set_array)
+        .def("set_nil",       &redis_set_nil)
+        .def("set_int",       &redis_set_int)
+        .def("set_array",     &redis_set_array)
         .def("set_string",    &redis_set_string)
         .def("set_status",    &redis_set_status)
         .def("set_error",     &redis_set_error)
@@ -111,17 +1519,21 @@ void init_redis_types(py::module_ &wf) {
         .def("is_string",     &RedisValue::is_string)
 
         .def("string_value",  &redis_bytes_value)
+        .def("string_view",   &redis_string_view)
         .def("int_value",     &RedisValue::int_value)
         .def("arr_size",      &RedisValue::arr_size)
-        .def("arr_clear",     &RedisValue::arr_clear)
-        .def("arr_resize",    &RedisValue::arr_resize)
+        .def("arr_clear",     &redis_arr_clear)
+        .def("arr_resize",    &redis_arr_resize)
 
-        .def("clear",         &RedisValue::clear)
+        .def("clear",         &redis_clear)
         .def("debug_string",  &redis_debug_bytes)
         .def("arr_at",        &redis_arr_at)
         .def("arr_at_ref",    &redis_arr_at_ref)
         .def("arr_at_object", &redis_arr_at_object)
         .def("as_object",     &redis_as_object)
+        .def("as_object",     &redis_as_object_ex, py::kw_only(), py::arg("encoding") = py::none(),
+                               py::arg("errors") = std::string("strict"), py::arg("pairs_as_dict") = false,
+                               py::arg("status_as_str") = false, py::arg("error_as_exception") = false)
     ;
 
     py::class_<PyWFRedisTask, PySubTask>(wf, "RedisTask")
@@ -150,6 +1562,8 @@ void init_redis_types(py::module_ &wf) {
         .def("set_request",    &PyRedisRequest::set_request)
         .def("get_command",    &PyRedisRequest::get_command)
         .def("get_params",     &PyRedisRequest::get_params)
+        .def("set_asking",     &PyRedisRequest::set_asking)
+        .def("is_asking",      &PyRedisRequest::is_asking)
 
         .def("set_size_limit", &PyRedisRequest::set_size_limit)
         .def("get_size_limit", &PyRedisRequest::get_size_limit)
@@ -165,6 +1579,148 @@ void init_redis_types(py::module_ &wf) {
         .def("get_size_limit", &PyRedisResponse::get_size_limit)
     ;
 
+    py::class_<PyWFRedisPipelineTask, PySubTask>(wf, "RedisPipelineTask")
+        .def("is_null",             &PyWFRedisPipelineTask::is_null)
+        .def("start",               &PyWFRedisPipelineTask::start)
+        .def("dismiss",             &PyWFRedisPipelineTask::dismiss)
+        .def("get_req",             &PyWFRedisPipelineTask::get_req)
+        .def("get_resp",            &PyWFRedisPipelineTask::get_resp)
+        .def("get_state",           &PyWFRedisPipelineTask::get_state)
+        .def("get_error",           &PyWFRedisPipelineTask::get_error)
+        .def("get_timeout_reason",  &PyWFRedisPipelineTask::get_timeout_reason)
+        .def("get_task_seq",        &PyWFRedisPipelineTask::get_task_seq)
+        .def("set_send_timeout",    &PyWFRedisPipelineTask::set_send_timeout)
+        .def("set_receive_timeout", &PyWFRedisPipelineTask::set_receive_timeout)
+        .def("set_keep_alive",      &PyWFRedisPipelineTask::set_keep_alive)
+        .def("get_peer_addr",       &PyWFRedisPipelineTask::get_peer_addr)
+        .def("set_callback",        &PyWFRedisPipelineTask::set_callback)
+        .def("set_user_data",       &PyWFRedisPipelineTask::set_user_data)
+        .def("get_user_data",       &PyWFRedisPipelineTask::get_user_data)
+    ;
+
+    py::class_<PyRedisPipelineRequest, PyWFBase>(wf, "RedisPipelineRequest")
+        .def("is_null",        &PyRedisPipelineRequest::is_null)
+        .def("add_command",    &PyRedisPipelineRequest::add_command, py::arg("command"),
+                                py::arg("params") = py::list())
+        .def("__len__",        &PyRedisPipelineRequest::size)
+        .def("size",           &PyRedisPipelineRequest::size)
+        .def("set_size_limit", &PyRedisPipelineRequest::set_size_limit)
+        .def("get_size_limit", &PyRedisPipelineRequest::get_size_limit)
+    ;
+
+    py::class_<PyRedisPipelineResponse, PyWFBase>(wf, "RedisPipelineResponse")
+        .def("is_null",        &PyRedisPipelineResponse::is_null)
+        .def("__len__",        &PyRedisPipelineResponse::size)
+        .def("size",           &PyRedisPipelineResponse::size)
+        .def("get_result",     &PyRedisPipelineResponse::get_result)
+        .def("get_results",    &PyRedisPipelineResponse::get_results)
+        .def("set_size_limit", &PyRedisPipelineResponse::set_size_limit)
+        .def("get_size_limit", &PyRedisPipelineResponse::get_size_limit)
+    ;
+
+    py::class_<PyWFRedisBatchTask, PySubTask>(wf, "RedisBatchTask")
+        .def("is_null",       &PyWFRedisBatchTask::is_null)
+        .def("start",         &PyWFRedisBatchTask::start)
+        .def("dismiss",       &PyWFRedisBatchTask::dismiss)
+        .def("get_state",     &PyWFRedisBatchTask::get_state)
+        .def("get_error",     &PyWFRedisBatchTask::get_error)
+        .def("get_result",    &PyWFRedisBatchTask::get_result)
+        .def("set_callback",  &PyWFRedisBatchTask::set_callback)
+        .def("set_user_data", &PyWFRedisBatchTask::set_user_data)
+        .def("get_user_data", &PyWFRedisBatchTask::get_user_data)
+    ;
+
+    py::class_<PyRedisBatchClient>(wf, "RedisBatchClient")
+        .def(py::init<const std::string &, int, size_t, unsigned int>(), py::arg("url"),
+             py::arg("retry_max") = 0, py::arg("max_batch") = 128, py::arg("window_us") = 200)
+        .def("create_task", &PyRedisBatchClient::create_task, py::arg("command"),
+             py::arg("params"), py::arg("callback"))
+    ;
+
+    py::class_<PyWFRedisCacheTask, PySubTask>(wf, "RedisCacheTask")
+        .def("is_null",             &PyWFRedisCacheTask::is_null)
+        .def("start",               &PyWFRedisCacheTask::start)
+        .def("dismiss",             &PyWFRedisCacheTask::dismiss)
+        .def("get_req",             &PyWFRedisCacheTask::get_req)
+        .def("get_resp",            &PyWFRedisCacheTask::get_resp)
+        .def("get_state",           &PyWFRedisCacheTask::get_state)
+        .def("get_error",           &PyWFRedisCacheTask::get_error)
+        .def("get_timeout_reason",  &PyWFRedisCacheTask::get_timeout_reason)
+        .def("get_task_seq",        &PyWFRedisCacheTask::get_task_seq)
+        .def("set_send_timeout",    &PyWFRedisCacheTask::set_send_timeout)
+        .def("set_receive_timeout", &PyWFRedisCacheTask::set_receive_timeout)
+        .def("set_keep_alive",      &PyWFRedisCacheTask::set_keep_alive)
+        .def("get_peer_addr",       &PyWFRedisCacheTask::get_peer_addr)
+        .def("is_cache_hit",        &PyWFRedisCacheTask::is_cache_hit)
+        .def("set_cache_ttl",       &PyWFRedisCacheTask::set_cache_ttl, py::arg("ttl"))
+        .def("set_callback",        &PyWFRedisCacheTask::set_callback)
+        .def("set_user_data",       &PyWFRedisCacheTask::set_user_data)
+        .def("get_user_data",       &PyWFRedisCacheTask::get_user_data)
+    ;
+
+    py::class_<PyRedisCache>(wf, "RedisCache")
+        .def(py::init<size_t, int>(), py::arg("max_memory") = 64 * 1024 * 1024,
+             py::arg("default_ttl") = 60 * 1000)
+        .def("create_redis_task", &PyRedisCache::create_redis_task, py::arg("url"),
+             py::arg("retry_max"), py::arg("callback"))
+        .def("listen",     &PyRedisCache::listen, py::arg("url"))
+        .def("stop",       &PyRedisCache::stop, py::call_guard<py::gil_scoped_release>())
+        .def("invalidate", &PyRedisCache::invalidate, py::arg("key"), py::arg("db") = -1)
+        .def("clear",      &PyRedisCache::clear)
+        .def("size",       &PyRedisCache::size)
+        .def("memory",     &PyRedisCache::memory)
+        .def("get_hits",   &PyRedisCache::get_hits)
+        .def("get_misses", &PyRedisCache::get_misses)
+    ;
+
+    py::class_<PyWFRedisSubscribeTask, PySubTask>(wf, "RedisSubscribeTask")
+        .def("is_null",           &PyWFRedisSubscribeTask::is_null)
+        .def("start",             &PyWFRedisSubscribeTask::start)
+        .def("dismiss",           &PyWFRedisSubscribeTask::dismiss)
+        .def("get_state",         &PyWFRedisSubscribeTask::get_state)
+        .def("get_error",         &PyWFRedisSubscribeTask::get_error)
+        .def("subscribe",         &PyWFRedisSubscribeTask::subscribe, py::arg("channels"),
+                                   py::call_guard<py::gil_scoped_release>())
+        .def("unsubscribe",       &PyWFRedisSubscribeTask::unsubscribe,
+                                   py::arg("channels") = std::vector<std::string>(),
+                                   py::call_guard<py::gil_scoped_release>())
+        .def("psubscribe",        &PyWFRedisSubscribeTask::psubscribe, py::arg("patterns"),
+                                   py::call_guard<py::gil_scoped_release>())
+        .def("punsubscribe",      &PyWFRedisSubscribeTask::punsubscribe,
+                                   py::arg("patterns") = std::vector<std::string>(),
+                                   py::call_guard<py::gil_scoped_release>())
+        .def("ping",              &PyWFRedisSubscribeTask::ping, py::arg("message") = std::string(),
+                                   py::call_guard<py::gil_scoped_release>())
+        .def("quit",              &PyWFRedisSubscribeTask::quit,
+                                   py::call_guard<py::gil_scoped_release>())
+        .def("set_watch_timeout", &PyWFRedisSubscribeTask::set_watch_timeout)
+        .def("set_recv_timeout",  &PyWFRedisSubscribeTask::set_recv_timeout)
+        .def("set_send_timeout",  &PyWFRedisSubscribeTask::set_send_timeout)
+        .def("set_keep_alive",    &PyWFRedisSubscribeTask::set_keep_alive)
+        .def("set_user_data",     &PyWFRedisSubscribeTask::set_user_data)
+        .def("get_user_data",     &PyWFRedisSubscribeTask::get_user_data)
+    ;
+
+    py::class_<PyRedisSubscriber>(wf, "RedisSubscriber")
+        .def(py::init())
+        .def("init",                   &PyRedisSubscriber::init, py::arg("url"))
+        .def("deinit",                 &PyRedisSubscriber::deinit, py::call_guard<py::gil_scoped_release>())
+        .def("create_subscribe_task",  &PyRedisSubscriber::create_subscribe_task, py::arg("channels"),
+                                        py::arg("process"), py::arg("callback"))
+        .def("create_psubscribe_task", &PyRedisSubscriber::create_psubscribe_task, py::arg("patterns"),
+                                        py::arg("process"), py::arg("callback"))
+    ;
+
+    py::class_<RedisStorage, std::shared_ptr<RedisStorage>>(wf, "RedisStorage")
+        .def(py::init<size_t>(), py::arg("shards") = 16)
+        .def("execute",      &redis_storage_execute, py::arg("command"),
+                              py::arg("params") = std::vector<std::string>(),
+                              py::call_guard<py::gil_scoped_release>())
+        .def("is_supported", &RedisStorage::is_supported)
+        .def("size",         &RedisStorage::size, py::call_guard<py::gil_scoped_release>())
+        .def("clear",        &RedisStorage::clear, py::call_guard<py::gil_scoped_release>())
+    ;
+
     py::class_<PyWFRedisServer>(wf, "RedisServer")
         .def(py::init<py_redis_process_t>())
         .def(py::init<WFServerParams, py_redis_process_t>())
@@ -172,11 +1728,18 @@ void init_redis_types(py::module_ &wf) {
                              py::arg("key_file") = std::string())
         .def("start",       &PyWFRedisServer::start_2, py::arg("family"), py::arg("host"), py::arg("port"),
                              py::arg("cert_file") = std::string(), py::arg("key_file") = std::string())
+        .def("start_unix",  &PyWFRedisServer::start_unix, py::arg("path"),
+                             py::arg("cert_file") = std::string(), py::arg("key_file") = std::string())
+        .def("set_storage", &redis_server_set_storage, py::arg("storage"),
+                             py::arg("overrides") = std::vector<std::string>())
         .def("shutdown",    &PyWFRedisServer::shutdown, py::call_guard<py::gil_scoped_release>())
         .def("wait_finish", &PyWFRedisServer::wait_finish, py::call_guard<py::gil_scoped_release>())
         .def("stop",        &PyWFRedisServer::stop, py::call_guard<py::gil_scoped_release>())
     ;
 
-    wf.def("create_redis_task", &create_redis_task, py::arg("url"), py::arg("retry_max"),
-        py::arg("callback"));
+    wf.def("create_redis_task", &create_redis_task_with_cache, py::arg("url"),
+        py::arg("retry_max"), py::arg("callback"), py::kw_only(), py::arg("cache") = py::none());
+    wf.def("redis_key_slot", &redis_key_slot, py::arg("key"));
+    wf.def("create_redis_pipeline_task", &create_redis_pipeline_task, py::arg("url"),
+        py::arg("retry_max"), py::arg("callback"));
 }
@@ -2,7 +2,15 @@
 #define PYWF_REDIS_TYPES_H
 
 #include "network_types.h"
+#include "redis_storage.h"
 #include "workflow/RedisMessage.h"
+#include "workflow/WFTaskFactory.h"
+#include "workflow/WFRedisSubscriber.h"
+#include <atomic>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
 
 class PyRedisRequest : public PyWFBase {
 public:
@@ -16,9 +24,12 @@ public:
         *(o.get()) = std::move(*(this->get()));
     }
 
-    void set_request(const std::string &cmd, const std::vector<std::string> &params) {
-        this->get()->set_request(cmd, params);
-    }
+    /**
+     * params may be str or any object supports buffer protocol, large buffers
+     * are referenced by the request and sent without copy by the tasks of
+     * create_redis_task.
+     */
+    void set_request(const std::string &cmd, py::iterable params);
 
     py::str get_command() const {
         std::string cmd;
@@ -26,15 +37,11 @@ public:
         return cmd;
     }
 
-    py::list get_params() const {
-        py::list params;
-        std::vector<std::string> params_vec;
-        this->get()->get_params(params_vec);
-        for(const auto &param : params_vec) {
-            params.append(py::bytes(param));
-        }
-        return params;
-    }
+    py::list get_params() const;
+
+    // Send ASKING before the command, used to follow ASK redirection of redis cluster
+    void set_asking(bool asking) { this->get()->set_asking(asking); }
+    bool is_asking() const       { return this->get()->is_asking(); }
 
     void set_size_limit(size_t limit) { this->get()->set_size_limit(limit); }
     size_t get_size_limit() const     { return this->get()->get_size_limit(); }
@@ -66,9 +73,624 @@ public:
     size_t get_size_limit() const     { return this->get()->get_size_limit(); }
 };
 
+class RedisPipelineResponse;
+
+// Expose the protected parser of RedisResponse
+class RedisReplyParser : public protocol::RedisResponse {
+public:
+    using protocol::RedisResponse::append;
+};
+
+/**
+ * RedisPipelineRequest encodes several commands into one buffer, so they
+ * are written by one send. The response parses the same number of replies.
+ * The prefix commands are only sent on a new connection, as workflow's
+ * redis task sends AUTH and SELECT.
+ */
+class RedisPipelineRequest : public protocol::ProtocolMessage {
+public:
+    void add_command(const std::string &cmd, const std::vector<std::string> &params);
+
+    /**
+     * Build a command argument by argument. The data passed to add_arg_nocopy
+     * is sent without copy, use add_reference to keep it alive until the
+     * request is destroyed.
+     */
+    void begin_command(size_t argc);
+    // Return the offset of the data in get_buf()
+    size_t add_arg(const char *data, size_t size);
+    void add_arg_nocopy(const char *data, size_t size);
+    void add_reference(Attachment *ref) { refs.emplace_back(ref); }
+    // Add the commands of o by reference, o must live until this is sent
+    void add_request(const RedisPipelineRequest &o);
+    const char *get_buf() const { return buf.data(); }
+    void clear();
+    // Commands added by pyworkflow itself, such as AUTH and SELECT
+    void add_prefix_command(const std::string &cmd, const std::vector<std::string> &params) {
+        add_command(cmd, params);
+        prefix_count++;
+        prefix_pieces = pieces.size();
+    }
+    size_t size() const               { return count - prefix_count; }
+    size_t get_prefix_count() const   { return prefix_count; }
+    void bind_task(WFNetworkTask<RedisPipelineRequest, RedisPipelineResponse> *t);
+
+protected:
+    virtual int encode(struct iovec vectors[], int max);
+
+private:
+    // A piece refers to external data, or a range of buf if data is nullptr
+    struct Piece {
+        const char *data;
+        size_t offset;
+        size_t size;
+    };
+
+    void append(const char *data, size_t size);
+
+    std::string buf;
+    std::string flat;
+    std::vector<Piece> pieces;
+    std::vector<std::unique_ptr<Attachment>> refs;
+    size_t count{0};
+    size_t prefix_count{0};
+    // The prefix commands are in their own pieces, never merged with others
+    size_t prefix_pieces{0};
+    WFNetworkTask<RedisPipelineRequest, RedisPipelineResponse> *task{nullptr};
+};
+
+class RedisPipelineResponse : public protocol::ProtocolMessage {
+public:
+    size_t size() const {
+        return parsed_count > prefix_count ? parsed_count - prefix_count : 0;
+    }
+    bool get_result(size_t pos, protocol::RedisValue &value);
+
+protected:
+    virtual int append(const void *buf, size_t *size);
+
+private:
+    std::vector<std::unique_ptr<RedisReplyParser>> parsers;
+    size_t expected{0};
+    size_t prefix_count{0};
+    size_t parsed_count{0};
+    // Bytes of all replies, limited by size_limit
+    size_t received{0};
+    WFNetworkTask<RedisPipelineRequest, RedisPipelineResponse> *task{nullptr};
+
+    /**
+     * The response may be reconstructed before retry, so the request tells
+     * the number of replies each time it is encoded.
+     */
+    void expect(size_t n, size_t prefix,
+        WFNetworkTask<RedisPipelineRequest, RedisPipelineResponse> *t) {
+        expected = n;
+        prefix_count = prefix;
+        task = t;
+    }
+    friend class RedisPipelineRequest;
+};
+
+class PyRedisPipelineRequest : public PyWFBase {
+public:
+    using OriginType = RedisPipelineRequest;
+    PyRedisPipelineRequest()                                : PyWFBase()  {}
+    PyRedisPipelineRequest(OriginType *p)                   : PyWFBase(p) {}
+    PyRedisPipelineRequest(const PyRedisPipelineRequest &o) : PyWFBase(o) {}
+    OriginType* get() const { return static_cast<OriginType*>(ptr); }
+
+    // params may be str or any object supports buffer protocol
+    void add_command(const std::string &cmd, py::iterable params);
+    size_t size() const { return this->get()->size(); }
+
+    void set_size_limit(size_t limit) { this->get()->set_size_limit(limit); }
+    size_t get_size_limit() const     { return this->get()->get_size_limit(); }
+};
+
+class PyRedisPipelineResponse : public PyWFBase {
+public:
+    using OriginType = RedisPipelineResponse;
+    PyRedisPipelineResponse()                                 : PyWFBase()  {}
+    PyRedisPipelineResponse(OriginType *p)                    : PyWFBase(p) {}
+    PyRedisPipelineResponse(const PyRedisPipelineResponse &o) : PyWFBase(o) {}
+    OriginType* get() const { return static_cast<OriginType*>(ptr); }
+
+    size_t size() const { return this->get()->size(); }
+
+    py::object get_result(size_t pos) const {
+        protocol::RedisValue v;
+        if(!this->get()->get_result(pos, v)) return py::none();
+        return py::cast(std::move(v));
+    }
+
+    py::list get_results() const {
+        size_t n = this->get()->size();
+        py::list lst(n);
+        for(size_t i = 0; i < n; i++) {
+            protocol::RedisValue v;
+            this->get()->get_result(i, v);
+            lst[i] = py::cast(std::move(v));
+        }
+        return lst;
+    }
+
+    void set_size_limit(size_t limit) { this->get()->set_size_limit(limit); }
+    size_t get_size_limit() const     { return this->get()->get_size_limit(); }
+};
+
+class RedisBatcher;
+
+/**
+ * RedisBatchTask carries one command, commands started within a short
+ * window are sent by one pipeline task.
+ */
+class RedisBatchTask : public WFGenericTask {
+public:
+    using callback_t = std::function<void (RedisBatchTask *)>;
+
+    RedisBatchTask(std::shared_ptr<RedisBatcher> batcher, const std::string &cmd,
+        const std::vector<std::string> &params, callback_t &&cb)
+        : batcher(std::move(batcher)), command(cmd), params(params), callback(std::move(cb)) {}
+
+    const std::string &get_command() const            { return command; }
+    const std::vector<std::string> &get_params() const { return params; }
+    protocol::RedisValue *get_result()                 { return &result; }
+    void set_callback(callback_t cb)                   { callback = std::move(cb); }
+
+protected:
+    virtual void dispatch();
+    virtual SubTask *done() {
+        SeriesWork *series = series_of(this);
+        if(callback) callback(this);
+        delete this;
+        return series->pop();
+    }
+
+private:
+    std::shared_ptr<RedisBatcher> batcher;
+    std::string command;
+    std::vector<std::string> params;
+    protocol::RedisValue result;
+    callback_t callback;
+
+    void finish(int state, int error) {
+        this->state = state;
+        this->error = error;
+        this->subtask_done();
+    }
+    friend class RedisBatcher;
+};
+
+class RedisBatcher : public std::enable_shared_from_this<RedisBatcher> {
+public:
+    RedisBatcher(const std::string &url, int retry_max, size_t max_batch,
+        unsigned int window_us)
+        : url(url), retry_max(retry_max), max_batch(max_batch ? max_batch : 1),
+          window_us(window_us) {}
+
+    void push(RedisBatchTask *task);
+
+private:
+    void flush(std::vector<RedisBatchTask *> &&batch);
+
+    std::string url;
+    int retry_max;
+    size_t max_batch;
+    unsigned int window_us;
+
+    std::mutex mtx;
+    std::vector<RedisBatchTask *> pending;
+    bool timer_armed{false};
+};
+
+class PyWFRedisBatchTask : public PySubTask {
+public:
+    using OriginType = RedisBatchTask;
+    using _py_callback_t = std::function<void(PyWFRedisBatchTask)>;
+    PyWFRedisBatchTask()                            : PySubTask()  {}
+    PyWFRedisBatchTask(OriginType *p)               : PySubTask(p) {}
+    PyWFRedisBatchTask(const PyWFRedisBatchTask &o) : PySubTask(o) {}
+    OriginType* get() const { return static_cast<OriginType*>(ptr); }
+    void start() {
+        assert(!series_of(this->get()));
+        CountableSeriesWork::start_series_work(this->get(), nullptr);
+    }
+    void dismiss()        { this->get()->dismiss(); }
+    int get_state() const { return this->get()->get_state(); }
+    int get_error() const { return this->get()->get_error(); }
+    protocol::RedisValue get_result() const { return *this->get()->get_result(); }
+    void set_user_data(py::object obj) {
+        void *old = this->get()->user_data;
+        if(old != nullptr) {
+            delete static_cast<py::object*>(old);
+        }
+        py::object *p = nullptr;
+        if(obj.is_none() == false) p = new py::object(obj);
+        this->get()->user_data = static_cast<void*>(p);
+    }
+    py::object get_user_data() const {
+        void *context = this->get()->user_data;
+        if(context == nullptr) return py::none();
+        return *static_cast<py::object*>(context);
+    }
+    void set_callback(_py_callback_t cb) {
+        auto *task = this->get();
+        void *user_data = task->user_data;
+        task->user_data = nullptr;
+        auto deleter = std::make_shared<TaskDeleterWrapper<_py_callback_t, OriginType>>(
+            std::move(cb), this->get());
+        this->get()->set_callback([deleter](OriginType *p) {
+            py_callback_wrapper(deleter->get_func(), PyWFRedisBatchTask(p));
+        });
+        task->user_data = user_data;
+    }
+};
+
+class PyRedisBatchClient {
+public:
+    using _py_callback_t = std::function<void(PyWFRedisBatchTask)>;
+    PyRedisBatchClient(const std::string &url, int retry_max, size_t max_batch,
+        unsigned int window_us)
+        : batcher(std::make_shared<RedisBatcher>(url, retry_max, max_batch, window_us)) {}
+
+    PyWFRedisBatchTask create_task(const std::string &cmd, const std::vector<std::string> &params,
+        _py_callback_t cb) {
+        auto *ptr = new RedisBatchTask(batcher, cmd, params, nullptr);
+        PyWFRedisBatchTask t(ptr);
+        t.set_callback(std::move(cb));
+        return t;
+    }
+
+private:
+    std::shared_ptr<RedisBatcher> batcher;
+};
+
+class RedisCache;
+
+/**
+ * RedisCacheTask sends one command like RedisTask. GET, HGET, HGETALL and MGET
+ * are answered from the cache if possible, and the task finishes in dispatch
+ * without network io. Other commands and misses are sent by a redis task,
+ * which gets the timeouts of this task, and gives back its seq, timeout
+ * reason and peer address. On a cache hit there is no peer address and the
+ * seq is -1.
+ */
+class RedisCacheTask : public WFGenericTask {
+public:
+    using callback_t = std::function<void (RedisCacheTask *)>;
+
+    RedisCacheTask(std::shared_ptr<RedisCache> cache, const std::string &url,
+        int retry_max, callback_t &&cb)
+        : cache(std::move(cache)), url(url), retry_max(retry_max), callback(std::move(cb)) {}
+
+    protocol::RedisRequest *get_req()   { return &req; }
+    protocol::RedisResponse *get_resp() { return &resp; }
+    bool is_cache_hit() const           { return cache_hit; }
+    // Milliseconds the reply is cached, -1 means the default of cache, 0 means do not cache
+    void set_cache_ttl(int ttl)         { cache_ttl = ttl; }
+    void set_callback(callback_t cb)    { callback = std::move(cb); }
+
+    void set_send_timeout(int timeout)    { send_timeout = timeout; }
+    void set_receive_timeout(int timeout) { receive_timeout = timeout; }
+    void set_keep_alive(int timeout)      { keep_alive = timeout; }
+    int get_timeout_reason() const        { return timeout_reason; }
+    long long get_task_seq() const        { return task_seq; }
+    int get_peer_addr(struct sockaddr *addr, socklen_t *addrlen) const {
+        if(peer_addrlen == 0 || *addrlen < peer_addrlen) {
+            errno = peer_addrlen == 0 ? ENOTCONN : ENOBUFS;
+            return -1;
+        }
+        memcpy(addr, &peer_addr, peer_addrlen);
+        *addrlen = peer_addrlen;
+        return 0;
+    }
+
+protected:
+    virtual void dispatch();
+    virtual SubTask *done() {
+        SeriesWork *series = series_of(this);
+        if(callback) callback(this);
+        delete this;
+        return series->pop();
+    }
+
+private:
+    std::shared_ptr<RedisCache> cache;
+    std::string url;
+    int retry_max;
+    int cache_ttl{-1};
+    bool cache_hit{false};
+    int send_timeout{-1};
+    int receive_timeout{-1};
+    int keep_alive{-1};
+    int timeout_reason{TOR_NOT_TIMEOUT};
+    long long task_seq{-1};
+    struct sockaddr_storage peer_addr;
+    socklen_t peer_addrlen{0};
+    protocol::RedisRequest req;
+    protocol::RedisResponse resp;
+    callback_t callback;
+};
+
+/**
+ * RedisCache keeps replies of read commands in memory, entries are removed
+ * by ttl, by lru when memory exceeds the limit, and by keyspace notifications
+ * if listen is called. While the notification connection is not established,
+ * the cache is bypassed, so no stale reply is returned because of lost
+ * notifications. The server needs notify-keyspace-events, such as KA.
+ */
+class RedisCache : public std::enable_shared_from_this<RedisCache> {
+public:
+    RedisCache(size_t max_memory, int default_ttl)
+        : max_memory(max_memory), default_ttl(default_ttl) {}
+    RedisCache(const RedisCache&) = delete;
+    RedisCache& operator=(const RedisCache&) = delete;
+    ~RedisCache() { subscriber.deinit(); }
+
+    // Return false if command is not cacheable, otherwise keys read by it are filled
+    static bool cacheable(const std::string &command, const std::vector<std::string> &params,
+        std::vector<std::string> &keys);
+    static std::string make_key(const std::string &url, const std::string &command,
+        const std::vector<std::string> &params);
+    // The dbnum in url, 0 if there is none
+    static int url_db(const std::string &url);
+
+    bool enabled();
+    bool get(const std::string &key, protocol::RedisValue &value);
+    // Generation is taken before the request is sent, the reply is dropped if
+    // any key was invalidated since then
+    void put(const std::string &key, int db, const std::vector<std::string> &keys,
+        const protocol::RedisValue &value, int ttl, uint64_t generation);
+    uint64_t get_generation();
+    // Invalidate entries of key in db, or in all dbs if db is negative
+    void invalidate(const std::string &key, int db);
+    void clear();
+
+    int listen(const std::string &url);
+    void stop();
+
+    int get_default_ttl() const { return default_ttl; }
+    size_t size();
+    size_t memory();
+    size_t get_hits() const   { return hits; }
+    size_t get_misses() const { return misses; }
+
+private:
+    struct Entry {
+        std::string key;
+        int db;
+        std::vector<std::string> keys;
+        protocol::RedisValue value;
+        int64_t expire_at; // milliseconds of steady clock
+        size_t bytes;
+    };
+    using EntryList = std::list<Entry>;
+
+    // Called with mtx locked
+    void erase(EntryList::iterator it);
+    void clear_locked();
+
+    void start_subscribe();
+    void on_message(WFRedisSubscribeTask *task, protocol::RedisValue &value);
+    void on_finish(WFRedisSubscribeTask *task);
+
+    static const size_t STAMP_SLOTS = 4096;
+
+    size_t max_memory;
+    int default_ttl;
+
+    std::mutex mtx;
+    EntryList lru;
+    std::unordered_map<std::string, EntryList::iterator> entries;
+    std::unordered_map<std::string, std::vector<std::string>> index; // redis key to cache keys
+    size_t used{0};
+    uint64_t generation{0};
+    uint64_t cleared_at{0};
+    // Generation of the last invalidation of keys hashed to each slot
+    uint64_t stamps[STAMP_SLOTS] = {};
+    std::atomic<size_t> hits{0};
+    std::atomic<size_t> misses{0};
+
+    WFRedisSubscriber subscriber;
+    WFRedisSubscribeTask *current{nullptr};
+    std::condition_variable cv;
+    bool quitting{false};
+    bool listening{false};
+    bool connected{false};
+    bool stopped{false};
+};
+
+class PyWFRedisCacheTask : public PySubTask {
+public:
+    using OriginType = RedisCacheTask;
+    using _py_callback_t = std::function<void(PyWFRedisCacheTask)>;
+    PyWFRedisCacheTask()                            : PySubTask()  {}
+    PyWFRedisCacheTask(OriginType *p)               : PySubTask(p) {}
+    PyWFRedisCacheTask(const PyWFRedisCacheTask &o) : PySubTask(o) {}
+    OriginType* get() const { return static_cast<OriginType*>(ptr); }
+    void start() {
+        assert(!series_of(this->get()));
+        CountableSeriesWork::start_series_work(this->get(), nullptr);
+    }
+    void dismiss()                { this->get()->dismiss(); }
+    PyRedisRequest get_req()      { return PyRedisRequest(this->get()->get_req()); }
+    PyRedisResponse get_resp()    { return PyRedisResponse(this->get()->get_resp()); }
+    int get_state() const         { return this->get()->get_state(); }
+    int get_error() const         { return this->get()->get_error(); }
+    bool is_cache_hit() const     { return this->get()->is_cache_hit(); }
+    void set_cache_ttl(int ttl)   { this->get()->set_cache_ttl(ttl); }
+    int get_timeout_reason() const  { return this->get()->get_timeout_reason(); }
+    long long get_task_seq() const  { return this->get()->get_task_seq(); }
+    void set_send_timeout(int t)    { this->get()->set_send_timeout(t); }
+    void set_receive_timeout(int t) { this->get()->set_receive_timeout(t); }
+    void set_keep_alive(int t)      { this->get()->set_keep_alive(t); }
+    py::object get_peer_addr() const {
+        return __network_helper::peer_addr(this->get());
+    }
+    void set_user_data(py::object obj) {
+        void *old = this->get()->user_data;
+        if(old != nullptr) {
+            delete static_cast<py::object*>(old);
+        }
+        py::object *p = nullptr;
+        if(obj.is_none() == false) p = new py::object(obj);
+        this->get()->user_data = static_cast<void*>(p);
+    }
+    py::object get_user_data() const {
+        void *context = this->get()->user_data;
+        if(context == nullptr) return py::none();
+        return *static_cast<py::object*>(context);
+    }
+    void set_callback(_py_callback_t cb) {
+        auto *task = this->get();
+        void *user_data = task->user_data;
+        task->user_data = nullptr;
+        auto deleter = std::make_shared<TaskDeleterWrapper<_py_callback_t, OriginType>>(
+            std::move(cb), this->get());
+        this->get()->set_callback([deleter](OriginType *p) {
+            py_callback_wrapper(deleter->get_func(), PyWFRedisCacheTask(p));
+        });
+        task->user_data = user_data;
+    }
+};
+
+class PyRedisCache {
+public:
+    using _py_callback_t = std::function<void(PyWFRedisCacheTask)>;
+    PyRedisCache(size_t max_memory, int default_ttl)
+        : cache(std::make_shared<RedisCache>(max_memory, default_ttl)) {}
+    PyRedisCache(const PyRedisCache&) = delete;
+    PyRedisCache& operator=(const PyRedisCache&) = delete;
+    // The subscribe task keeps the cache alive and reconnects until stopped
+    ~PyRedisCache() { cache->stop(); }
+
+    PyWFRedisCacheTask create_redis_task(const std::string &url, int retry_max, _py_callback_t cb) {
+        auto *ptr = new RedisCacheTask(cache, url, retry_max, nullptr);
+        PyWFRedisCacheTask t(ptr);
+        t.set_callback(std::move(cb));
+        return t;
+    }
+
+    int listen(const std::string &url)     { return cache->listen(url); }
+    void stop()                            { cache->stop(); }
+    void invalidate(const std::string &key, int db) { cache->invalidate(key, db); }
+    void clear()                           { cache->clear(); }
+    size_t size()                          { return cache->size(); }
+    size_t memory()                        { return cache->memory(); }
+    size_t get_hits() const                { return cache->get_hits(); }
+    size_t get_misses() const              { return cache->get_misses(); }
+
+private:
+    std::shared_ptr<RedisCache> cache;
+};
+
+class PyWFRedisSubscribeTask;
+using py_redis_message_t   = std::function<void(py::list)>;
+using py_redis_subscribe_t = std::function<void(PyWFRedisSubscribeTask)>;
+
+/**
+ * Messages are extracted on the poller thread and queued here, then a go task
+ * delivers all queued messages to python at once, so messages arrive in one
+ * read are passed to process as one list and the poller never waits for gil.
+ */
+class RedisSubscribeContext : public std::enable_shared_from_this<RedisSubscribeContext> {
+public:
+    RedisSubscribeContext(py_redis_message_t &&process, py_redis_subscribe_t &&callback)
+        : process(std::move(process)), callback(std::move(callback)) {}
+    RedisSubscribeContext(const RedisSubscribeContext&) = delete;
+    RedisSubscribeContext& operator=(const RedisSubscribeContext&) = delete;
+
+    void push(protocol::RedisValue &&value);
+    void finish(WFRedisSubscribeTask *task);
+
+    ~RedisSubscribeContext() {
+        release_wrapped_function(process);
+        release_wrapped_function(callback);
+    }
+
+private:
+    void start_drain();
+    void drain();
+
+    py_redis_message_t process;
+    py_redis_subscribe_t callback;
+    std::mutex mtx;
+    std::vector<protocol::RedisValue> queue;
+    bool delivering{false};
+    WFRedisSubscribeTask *finished{nullptr};
+    WFCounterTask *finish_counter{nullptr};
+};
+
+class PyWFRedisSubscribeTask : public PySubTask {
+public:
+    using OriginType = WFRedisSubscribeTask;
+    PyWFRedisSubscribeTask()                                : PySubTask()  {}
+    PyWFRedisSubscribeTask(OriginType *p)                   : PySubTask(p) {}
+    PyWFRedisSubscribeTask(const PyWFRedisSubscribeTask &o) : PySubTask(o) {}
+    OriginType* get() const { return static_cast<OriginType*>(ptr); }
+    void start() {
+        assert(!series_of(this->get()));
+        CountableSeriesWork::start_series_work(this->get(), nullptr);
+    }
+    void dismiss()        { this->get()->dismiss(); }
+    int get_state() const { return this->get()->get_state(); }
+    int get_error() const { return this->get()->get_error(); }
+
+    int subscribe(const std::vector<std::string> &channels)   { return this->get()->subscribe(channels); }
+    int unsubscribe(const std::vector<std::string> &channels) {
+        if(channels.empty()) return this->get()->unsubscribe();
+        return this->get()->unsubscribe(channels);
+    }
+    int psubscribe(const std::vector<std::string> &patterns)   { return this->get()->psubscribe(patterns); }
+    int punsubscribe(const std::vector<std::string> &patterns) {
+        if(patterns.empty()) return this->get()->punsubscribe();
+        return this->get()->punsubscribe(patterns);
+    }
+    int ping(const std::string &message) { return this->get()->ping(message); }
+    int quit()                           { return this->get()->quit(); }
+
+    void set_watch_timeout(int t) { this->get()->set_watch_timeout(t); }
+    void set_recv_timeout(int t)  { this->get()->set_recv_timeout(t); }
+    void set_send_timeout(int t)  { this->get()->set_send_timeout(t); }
+    void set_keep_alive(int t)    { this->get()->set_keep_alive(t); }
+
+    void set_user_data(py::object obj) {
+        void *old = this->get()->user_data;
+        if(old != nullptr) {
+            delete static_cast<py::object*>(old);
+        }
+        py::object *p = nullptr;
+        if(obj.is_none() == false) p = new py::object(obj);
+        this->get()->user_data = static_cast<void*>(p);
+    }
+    py::object get_user_data() const {
+        void *context = this->get()->user_data;
+        if(context == nullptr) return py::none();
+        return *static_cast<py::object*>(context);
+    }
+};
+
+class PyRedisSubscriber {
+public:
+    int init(const std::string &url) { return subscriber.init(url); }
+    void deinit()                    { subscriber.deinit(); }
+
+    PyWFRedisSubscribeTask create_subscribe_task(const std::vector<std::string> &channels,
+        py_redis_message_t process, py_redis_subscribe_t callback);
+    PyWFRedisSubscribeTask create_psubscribe_task(const std::vector<std::string> &patterns,
+        py_redis_message_t process, py_redis_subscribe_t callback);
+
+private:
+    WFRedisSubscriber subscriber;
+};
+
 using PyWFRedisTask       = PyWFNetworkTask<PyRedisRequest, PyRedisResponse>;
 using PyWFRedisServer     = PyWFServer<PyRedisRequest, PyRedisResponse>;
 using py_redis_callback_t = std::function<void(PyWFRedisTask)>;
 using py_redis_process_t  = std::function<void(PyWFRedisTask)>;
 
+using WFRedisPipelineTask          = WFNetworkTask<RedisPipelineRequest, RedisPipelineResponse>;
+using PyWFRedisPipelineTask        = PyWFNetworkTask<PyRedisPipelineRequest, PyRedisPipelineResponse>;
+using py_redis_pipeline_callback_t = std::function<void(PyWFRedisPipelineTask)>;
+
 #endif // PYWF_REDIS_TYPES_H
@@ -0,0 +1,127 @@
+#include "websocket_types.h"
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// The payloads and memoryviews given out for each frame, guarded by gil
+using WebSocketViews = std::vector<std::pair<py::object, py::object>>;
+static std::unordered_map<protocol::WebSocketFrame *, WebSocketViews> websocket_views;
+std::atomic<size_t> websocket_view_frames{0};
+
+static int websocket_payload_getbuffer(PyObject *obj, Py_buffer *view, int flags) {
+    static char empty[1] = "";
+    WebSocketPayload *payload;
+    try {
+        payload = py::handle(obj).cast<WebSocketPayload *>();
+    }
+    catch(const py::cast_error &e) {
+        PyErr_SetString(PyExc_BufferError, e.what());
+        return -1;
+    }
+    if(payload == nullptr || payload->released) {
+        PyErr_SetString(PyExc_BufferError, "the frame is freed after the callback of its task");
+        return -1;
+    }
+
+    char *data = payload->size ? const_cast<char *>(payload->data) : empty;
+    if(PyBuffer_FillInfo(view, obj, data, (Py_ssize_t)payload->size, 1, flags) < 0) return -1;
+
+    view->internal = payload;
+    payload->exports++;
+    return 0;
+}
+
+static void websocket_payload_releasebuffer(PyObject *, Py_buffer *view) {
+    static_cast<WebSocketPayload *>(view->internal)->exports--;
+}
+
+py::object websocket_frame_view(protocol::WebSocketFrame *frame, const char *data, size_t size) {
+    py::object payload = py::cast(new WebSocketPayload(data, size),
+        py::return_value_policy::take_ownership);
+    PyObject *view = PyMemoryView_FromObject(payload.ptr());
+    if(view == nullptr) throw py::error_already_set();
+
+    py::object mv = py::reinterpret_steal<py::object>(view);
+    WebSocketViews &views = websocket_views[frame];
+    if(views.empty()) websocket_view_frames++;
+    views.emplace_back(payload, mv);
+    return mv;
+}
+
+void websocket_release_views(protocol::WebSocketFrame *frame) {
+    if(websocket_view_frames == 0) return;
+
+    py::gil_scoped_acquire acquire;
+    auto it = websocket_views.find(frame);
+    if(it == websocket_views.end()) return;
+
+    WebSocketViews views = std::move(it->second);
+    websocket_views.erase(it);
+    websocket_view_frames--;
+
+    bool leaked = false;
+    for(auto &v : views) {
+        WebSocketPayload *payload = v.first.cast<WebSocketPayload *>();
+        // Fails if a buffer is exported by the memoryview itself
+        PyObject *ret = PyObject_CallMethod(v.second.ptr(), "release", nullptr);
+        if(ret == nullptr) PyErr_Clear();
+        Py_XDECREF(ret);
+
+        payload->released = true;
+        if(payload->exports > 0) leaked = true;
+    }
+
+    // Slices of the memoryview, or objects made from them, still refer to it
+    if(leaked && PyErr_WarnEx(PyExc_RuntimeWarning,
+        "WebSocketFrame.get_data() is used after the callback, copy it by bytes()", 1) < 0)
+        PyErr_Print();
+}
+
+void init_websocket_types(py::module_ &wf) {
+    wf.attr("WebSocketFrameContinuation")    = (int)WebSocketFrameContinuation;
+    wf.attr("WebSocketFrameText")            = (int)WebSocketFrameText;
+    wf.attr("WebSocketFrameBinary")          = (int)WebSocketFrameBinary;
+    wf.attr("WebSocketFrameConnectionClose") = (int)WebSocketFrameConnectionClose;
+    wf.attr("WebSocketFramePing")            = (int)WebSocketFramePing;
+    wf.attr("WebSocketFramePong")            = (int)WebSocketFramePong;
+
+    py::class_<WebSocketPayload> payload(wf, "WebSocketPayload", py::buffer_protocol());
+    // Replace the buffer slots of pybind11, to count the exported buffers
+    PyTypeObject *payload_type = (PyTypeObject *)payload.ptr();
+    payload_type->tp_as_buffer->bf_getbuffer = websocket_payload_getbuffer;
+    payload_type->tp_as_buffer->bf_releasebuffer = websocket_payload_releasebuffer;
+
+    py::class_<PyWebSocketFrame, PyWFBase>(wf, "WebSocketFrame")
+        .def("is_null",         &PyWebSocketFrame::is_null)
+        .def("get_opcode",      &PyWebSocketFrame::get_opcode)
+        .def("set_opcode",      &PyWebSocketFrame::set_opcode)
+        .def("finished",        &PyWebSocketFrame::finished)
+        .def("get_data",        &PyWebSocketFrame::get_data)
+        .def("get_bytes",       &PyWebSocketFrame::get_bytes)
+        .def("set_binary_data", &PyWebSocketFrame::set_binary_data)
+        .def("set_text_data",   &PyWebSocketFrame::set_text_data)
+        .def("set_size_limit",  &PyWebSocketFrame::set_size_limit)
+        .def("get_size_limit",  &PyWebSocketFrame::get_size_limit)
+    ;
+
+    py::class_<PyWFWebSocketTask, PySubTask>(wf, "WebSocketTask")
+        .def("is_null",       &PyWFWebSocketTask::is_null)
+        .def("start",         &PyWFWebSocketTask::start)
+        .def("dismiss",       &PyWFWebSocketTask::dismiss)
+        .def("get_state",     &PyWFWebSocketTask::get_state)
+        .def("get_error",     &PyWFWebSocketTask::get_error)
+        .def("get_msg",       &PyWFWebSocketTask::get_msg)
+        .def("set_callback",  &PyWFWebSocketTask::set_callback)
+        .def("set_user_data", &PyWFWebSocketTask::set_user_data)
+        .def("get_user_data", &PyWFWebSocketTask::get_user_data)
+    ;
+
+    py::class_<PyWebSocketClient>(wf, "WebSocketClient")
+        .def(py::init<py_websocket_process_t>())
+        .def("init",                  &PyWebSocketClient::init, py::arg("url"))
+        .def("deinit",                &PyWebSocketClient::deinit, py::call_guard<py::gil_scoped_release>())
+        .def("create_websocket_task", &PyWebSocketClient::create_websocket_task, py::arg("callback"))
+        .def("create_ping_task",      &PyWebSocketClient::create_ping_task, py::arg("callback"))
+        .def("create_close_task",     &PyWebSocketClient::create_close_task, py::arg("callback"))
+    ;
+}
@@ -0,0 +1,196 @@
+#ifndef PYWF_WEBSOCKET_TYPES_H
+#define PYWF_WEBSOCKET_TYPES_H
+
+#include "network_types.h"
+#include "workflow/WebSocketMessage.h"
+#include "workflow/WFWebSocketClient.h"
+#include <atomic>
+
+/**
+ * Keep a python object alive as long as the frame that refers to it,
+ * it is released by the frame's destructor.
+ */
+class WebSocketAttachment final : public protocol::ProtocolMessage::Attachment {
+public:
+    WebSocketAttachment(py::object o) : obj(std::move(o)) {}
+    WebSocketAttachment(const WebSocketAttachment&) = delete;
+    ~WebSocketAttachment() {
+        py::gil_scoped_acquire acquire;
+        obj = py::object();
+    }
+private:
+    py::object obj;
+};
+
+/**
+ * WebSocketPayload exports the payload of a frame to python without a copy.
+ * The frame is freed after the callback of its task, then the memoryviews
+ * given out are released and the payload can not be exported any more.
+ */
+class WebSocketPayload {
+public:
+    WebSocketPayload(const char *data, size_t size) : data(data), size(size) {}
+
+    const char *data;
+    size_t size;
+    Py_ssize_t exports{0};
+    bool released{false};
+};
+
+extern std::atomic<size_t> websocket_view_frames;
+// Return a read only memoryview on the payload of frame
+py::object websocket_frame_view(protocol::WebSocketFrame *frame, const char *data, size_t size);
+// Release the memoryviews on the payload of frame, called before it is freed
+void websocket_release_views(protocol::WebSocketFrame *frame);
+
+class PyWebSocketFrame : public PyWFBase {
+public:
+    using OriginType = protocol::WebSocketFrame;
+    PyWebSocketFrame()                          : PyWFBase()  {}
+    PyWebSocketFrame(OriginType *p)             : PyWFBase(p) {}
+    PyWebSocketFrame(const PyWebSocketFrame &o) : PyWFBase(o) {}
+    OriginType* get() const { return static_cast<OriginType*>(ptr); }
+
+    int get_opcode() const       { return this->get()->get_opcode(); }
+    bool set_opcode(int opcode)  { return this->get()->set_opcode(opcode); }
+    bool finished() const        { return this->get()->finished(); }
+
+    /**
+     * The memoryview refers to the frame's payload directly, it is released
+     * when the callback which owns this frame returns.
+     */
+    py::object get_data() const {
+        const char *data = nullptr;
+        size_t size = 0;
+        if(!this->get()->get_data(&data, &size)) return py::none();
+        return websocket_frame_view(this->get(), data, size);
+    }
+
+    py::bytes get_bytes() const {
+        const char *data = nullptr;
+        size_t size = 0;
+        if(!this->get()->get_data(&data, &size)) return py::bytes();
+        return py::bytes(data, size);
+    }
+
+    bool set_binary_data(py::bytes b) {
+        char *buffer = nullptr;
+        ssize_t length = 0;
+        if(PYBIND11_BYTES_AS_STRING_AND_SIZE(b.ptr(), &buffer, &length)) {
+            // there is an error
+            return false;
+        }
+        if(!this->get()->set_binary_data(buffer, (size_t)length)) return false;
+        this->get()->set_attachment(new WebSocketAttachment(b));
+        return true;
+    }
+
+    bool set_text_data(py::str s) {
+        py::bytes b = (py::bytes)s;
+        char *buffer = nullptr;
+        ssize_t length = 0;
+        if(PYBIND11_BYTES_AS_STRING_AND_SIZE(b.ptr(), &buffer, &length)) {
+            // there is an error
+            return false;
+        }
+        if(!this->get()->set_text_data(buffer, (size_t)length, true)) return false;
+        this->get()->set_attachment(new WebSocketAttachment(b));
+        return true;
+    }
+
+    void set_size_limit(size_t limit) { this->get()->set_size_limit(limit); }
+    size_t get_size_limit() const     { return this->get()->get_size_limit(); }
+};
+
+class PyWFWebSocketTask : public PySubTask {
+public:
+    using OriginType = WFWebSocketTask;
+    using _py_callback_t = std::function<void(PyWFWebSocketTask)>;
+    PyWFWebSocketTask()                           : PySubTask()  {}
+    PyWFWebSocketTask(OriginType *p)              : PySubTask(p) {}
+    PyWFWebSocketTask(const PyWFWebSocketTask &o) : PySubTask(o) {}
+    OriginType* get() const { return static_cast<OriginType*>(ptr); }
+    void start() {
+        assert(!series_of(this->get()));
+        CountableSeriesWork::start_series_work(this->get(), nullptr);
+    }
+    void dismiss() {
+        websocket_release_views(this->get()->get_msg());
+        this->get()->dismiss();
+    }
+    int get_state() const     { return this->get()->get_state(); }
+    int get_error() const     { return this->get()->get_error(); }
+    PyWebSocketFrame get_msg() { return PyWebSocketFrame(this->get()->get_msg()); }
+    void set_user_data(py::object obj) {
+        void *old = this->get()->user_data;
+        if(old != nullptr) {
+            delete static_cast<py::object*>(old);
+        }
+        py::object *p = nullptr;
+        if(obj.is_none() == false) p = new py::object(obj);
+        this->get()->user_data = static_cast<void*>(p);
+    }
+    py::object get_user_data() const {
+        void *context = this->get()->user_data;
+        if(context == nullptr) return py::none();
+        return *static_cast<py::object*>(context);
+    }
+    void set_callback(_py_callback_t cb) {
+        auto *task = this->get();
+        void *user_data = task->user_data;
+        task->user_data = nullptr;
+        auto deleter = std::make_shared<TaskDeleterWrapper<_py_callback_t, OriginType>>(
+            std::move(cb), this->get());
+        this->get()->set_callback([deleter](OriginType *p) {
+            py_callback_wrapper(deleter->get_func(), PyWFWebSocketTask(p));
+            websocket_release_views(p->get_msg());
+        });
+        task->user_data = user_data;
+    }
+};
+
+using py_websocket_callback_t = std::function<void(PyWFWebSocketTask)>;
+using py_websocket_process_t  = std::function<void(PyWFWebSocketTask)>;
+
+/**
+ * The process function is called once for each frame received from the
+ * server, the tasks created by this client are used to send frames.
+ */
+class PyWebSocketClient {
+public:
+    using OriginType = WebSocketClient;
+    PyWebSocketClient(py_websocket_process_t proc)
+        : process(std::move(proc)), client([this](WFWebSocketTask *p) {
+            py_callback_wrapper(this->process, PyWFWebSocketTask(p));
+            websocket_release_views(p->get_msg());
+        }) {}
+    PyWebSocketClient(const PyWebSocketClient&) = delete;
+    PyWebSocketClient& operator=(const PyWebSocketClient&) = delete;
+
+    int init(const std::string &url) { return client.init(url); }
+    void deinit()                    { client.deinit(); }
+
+    PyWFWebSocketTask create_websocket_task(py_websocket_callback_t cb) {
+        PyWFWebSocketTask t(client.create_websocket_task(nullptr));
+        t.set_callback(std::move(cb));
+        return t;
+    }
+    PyWFWebSocketTask create_ping_task(py_websocket_callback_t cb) {
+        PyWFWebSocketTask t(client.create_ping_task(nullptr));
+        t.set_callback(std::move(cb));
+        return t;
+    }
+    PyWFWebSocketTask create_close_task(py_websocket_callback_t cb) {
+        PyWFWebSocketTask t(client.create_close_task(nullptr));
+        t.set_callback(std::move(cb));
+        return t;
+    }
+
+    ~PyWebSocketClient() { release_wrapped_function(this->process); }
+
+    py_websocket_process_t process;
+private:
+    OriginType client;
+};
+
+#endif // PYWF_WEBSOCKET_TYPES_H
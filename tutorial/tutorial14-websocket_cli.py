@@ -0,0 +1,65 @@
+import signal
+import sys
+import threading
+
+import pywf as wf
+
+cv = threading.Condition()
+
+
+def Stop(signum, frame):
+    print("Stop client:", signum)
+    cv.acquire()
+    cv.notify()
+    cv.release()
+
+
+def process(t):
+    frame = t.get_msg()
+    opcode = frame.get_opcode()
+    if opcode == wf.WebSocketFrameText or opcode == wf.WebSocketFrameBinary:
+        # get_data returns a memoryview of the frame, it is valid only in this function
+        data = frame.get_data()
+        print("Receive {} bytes: {}".format(len(data), bytes(data[:64])))
+    elif opcode == wf.WebSocketFrameConnectionClose:
+        print("Connection closed by server")
+
+
+def send_callback(t):
+    if t.get_state() != wf.WFT_STATE_SUCCESS:
+        print(
+            "Send failed, state:{} error:{} errstr:{}".format(
+                t.get_state(),
+                t.get_error(),
+                wf.get_error_string(t.get_state(), t.get_error()),
+            )
+        )
+
+
+def main():
+    if len(sys.argv) != 3:
+        print("Usage {} <ws URL> <text>".format(sys.argv[0]))
+        sys.exit(1)
+    signal.signal(signal.SIGINT, Stop)
+    client = wf.WebSocketClient(process)
+    if client.init(sys.argv[1]) != 0:
+        print("Invalid URL")
+        sys.exit(1)
+
+    task = client.create_websocket_task(send_callback)
+    task.get_msg().set_text_data(sys.argv[2])
+    task.start()
+
+    cv.acquire()
+    cv.wait()
+    cv.release()
+
+    close_task = client.create_close_task(None)
+    close_task.start()
+    wf.wait_finish()
+    client.deinit()
+
+
+# Usage: python3 tutorial14-websocket_cli.py ws://127.0.0.1:9001/ "hello"
+if __name__ == "__main__":
+    main()